@@ -0,0 +1,208 @@
+#pragma once
+
+#include <functional>
+#include <string>
+#include <vector>
+#include "cellsim_core.hpp"
+
+// Canned worlds for simbench. Every scene is built through the same actions
+// the game sends, `setup` runs once before timing starts and `input` (if set)
+// runs before every timed tick to stand in for a user painting.
+
+namespace bench_scenes {
+
+struct Scene {
+    std::string name;
+    std::function<void(PixelGrid&)> setup;
+    std::function<void(PixelGrid&, int tick)> input;
+};
+
+inline Pixel pixelOf(uint8_t material) {
+    return Pixel{material, 0, 0};
+}
+
+// inclusive rectangle, drawn as a parallelogram with vertical sides
+inline void fillRect(PixelGrid& grid, int x0, int y0, int x1, int y1, uint8_t material) {
+    grid.userAction(DrawParallelogramAction{{x0, y0}, {x1, y0}, {x1, y1}, pixelOf(material)});
+}
+
+inline void floorAndWalls(PixelGrid& grid, uint8_t material) {
+    int w = grid.getWidth();
+    int h = grid.getHeight();
+    fillRect(grid, 0, h - 8, w - 1, h - 1, material);
+    fillRect(grid, 0, 0, 7, h - 1, material);
+    fillRect(grid, w - 8, 0, w - 1, h - 1, material);
+}
+
+// a tall block of sand on a ledge collapses into a heap
+inline Scene sandAvalanche() {
+    return Scene{"sand_avalanche",
+        [](PixelGrid& grid) {
+            int w = grid.getWidth();
+            int h = grid.getHeight();
+            floorAndWalls(grid, materials::stone);
+            fillRect(grid, w / 8, h / 2, w / 2, h / 2 + 10, materials::stone);
+            fillRect(grid, w / 8, h / 10, w / 2, h / 2 - 1, materials::sand);
+        },
+        nullptr};
+}
+
+// a wide block of sand dropped into a stone basin while a brush keeps
+// pouring more on the heap, most of the heap rests while its surface slides
+inline Scene sandPour() {
+    return Scene{"sand_pour",
+        [](PixelGrid& grid) {
+            int w = grid.getWidth();
+            int h = grid.getHeight();
+            floorAndWalls(grid, materials::stone);
+            fillRect(grid, w / 4, h / 10, 3 * w / 4, h / 2, materials::sand);
+        },
+        [](PixelGrid& grid, int tick) {
+            int w = grid.getWidth();
+            int x = w / 2 - 40 + (tick * 11) % 80;
+            grid.userAction(DrawLineAction{{x, 12}, {x + 8, 12}, 4, pixelOf(materials::sand)});
+        }};
+}
+
+// a sealed stone tank of steam with sand poured on its roof, the sand
+// slides down the tank's sides and keeps the chunks it shares with the
+// steam awake. The steam cannot move but is a gas, so it never counts as
+// settled.
+inline Scene steamTank() {
+    return Scene{"steam_tank",
+        [](PixelGrid& grid) {
+            int w = grid.getWidth();
+            int h = grid.getHeight();
+            floorAndWalls(grid, materials::stone);
+            fillRect(grid, w / 4, h / 3, 3 * w / 4, h - 9, materials::stone);
+            fillRect(grid, w / 4 + 4, h / 3 + 4, 3 * w / 4 - 4, h - 13, materials::steam);
+        },
+        [](PixelGrid& grid, int tick) {
+            int w = grid.getWidth();
+            int h = grid.getHeight();
+            int x = w / 4 + 10 + (tick * 37) % (w / 2 - 20);
+            grid.userAction(DrawLineAction{{x, h / 4}, {x + 8, h / 4}, 4, pixelOf(materials::sand)});
+        }};
+}
+
+// water dropped into a stone basin while a brush keeps pouring more
+inline Scene waterBasin() {
+    return Scene{"water_basin",
+        [](PixelGrid& grid) {
+            int w = grid.getWidth();
+            int h = grid.getHeight();
+            floorAndWalls(grid, materials::stone);
+            fillRect(grid, w / 4, h / 3, w / 4 + 10, h - 9, materials::stone);
+            fillRect(grid, 3 * w / 4, h / 3, 3 * w / 4 + 10, h - 9, materials::stone);
+            fillRect(grid, w / 4 + 20, h / 8, 3 * w / 4 - 20, h / 3, materials::water);
+        },
+        [](PixelGrid& grid, int tick) {
+            int w = grid.getWidth();
+            int x = w / 4 + 20 + (tick * 7) % (w / 2 - 40);
+            grid.userAction(DrawLineAction{{x, 20}, {x + 6, 22}, 3, pixelOf(materials::water)});
+        }};
+}
+
+// a pool of oil and wooden posts set alight at a few points
+inline Scene oilFire() {
+    return Scene{"oil_fire",
+        [](PixelGrid& grid) {
+            int w = grid.getWidth();
+            int h = grid.getHeight();
+            floorAndWalls(grid, materials::stone);
+            fillRect(grid, 8, h - 60, w - 9, h - 9, materials::oil);
+            for (int x = w / 10; x < w - 20; x += w / 10) {
+                fillRect(grid, x, h / 3, x + 6, h - 61, materials::wood);
+            }
+        },
+        [](PixelGrid& grid, int tick) {
+            if (tick % 10 == 0) {
+                int w = grid.getWidth();
+                int h = grid.getHeight();
+                grid.userAction(IgnitionAction{{8 + (tick * 37) % (w - 16), h - 60}});
+            }
+        }};
+}
+
+// lava poured from one side runs into a lake of water
+inline Scene lavaMeetsWater() {
+    return Scene{"lava_meets_water",
+        [](PixelGrid& grid) {
+            int w = grid.getWidth();
+            int h = grid.getHeight();
+            floorAndWalls(grid, materials::stone);
+            fillRect(grid, w / 2, h - 80, w - 9, h - 9, materials::water);
+            fillRect(grid, 8, h / 4, w / 4, h / 2, materials::lava);
+        },
+        nullptr};
+}
+
+// a large world where almost nothing moves, measures the cost of idle area
+inline Scene mostlyEmpty() {
+    return Scene{"mostly_empty",
+        [](PixelGrid& grid) {
+            int w = grid.getWidth();
+            int h = grid.getHeight();
+            fillRect(grid, 0, h - 8, w - 1, h - 1, materials::stone);
+            fillRect(grid, 0, h - 40, w - 1, h - 9, materials::stone);
+        },
+        [](PixelGrid& grid, int tick) {
+            int w = grid.getWidth();
+            int x = 20 + (tick * 3) % (w - 40);
+            grid.userAction(DrawLineAction{{x, 10}, {x + 3, 10}, 2, pixelOf(materials::sand)});
+        }};
+}
+
+// every material class at once in vertical bands, powders and liquids fall
+// through gas onto solid shelves, nothing burns so the time is spent moving
+// pixels rather than in the fire code. For comparing physics dispatch.
+inline Scene mixedMaterials() {
+    return Scene{"mixed_materials",
+        [](PixelGrid& grid) {
+            int w = grid.getWidth();
+            int h = grid.getHeight();
+            floorAndWalls(grid, materials::stone);
+            const uint8_t bands[] = {materials::sand, materials::water, materials::steam, materials::oil,
+                                     materials::coal, materials::steam, materials::ash, materials::water};
+            int bandWidth = (w - 16) / 8;
+            for (int i = 0; i < 8; i++) {
+                int x0 = 8 + i * bandWidth;
+                fillRect(grid, x0, h / 10, x0 + bandWidth - 1, h / 3, bands[i]);
+                fillRect(grid, x0 + bandWidth / 4, h / 2, x0 + bandWidth / 2, h / 2 + 4,
+                         i % 2 == 0 ? materials::steel : materials::stone);
+                fillRect(grid, x0 + bandWidth / 2, 2 * h / 3, x0 + bandWidth / 2 + 4, h - 9, materials::wood);
+            }
+        },
+        [](PixelGrid& grid, int tick) {
+            // keep pouring so the scene never settles
+            int w = grid.getWidth();
+            int bandWidth = (w - 16) / 8;
+            int x = 8 + (tick * 13) % (8 * bandWidth - 8);
+            uint8_t material = (tick % 2 == 0) ? materials::sand : materials::water;
+            grid.userAction(DrawLineAction{{x, 12}, {x + 8, 12}, 3, pixelOf(material)});
+        }};
+}
+
+// a fast brush drag, every tick queues a long stroke of short overlapping
+// segments the way the game does when the mouse moves far between frames
+inline Scene brushDrag() {
+    return Scene{"brush_drag",
+        [](PixelGrid& grid) {
+            floorAndWalls(grid, materials::stone);
+        },
+        [](PixelGrid& grid, int tick) {
+            int w = grid.getWidth();
+            int h = grid.getHeight();
+            uint8_t material = (tick / 50) % 2 == 0 ? materials::sand : materials::water;
+            for (int i = 0; i < 64; i++) {
+                int t = tick * 64 + i;
+                Vec2i start{16 + (t * 5) % (w - 32), h / 4 + (t * 3) % (h / 4)};
+                grid.userAction(DrawLineAction{start, start + Vec2i{4, 2}, 6, pixelOf(material)});
+            }
+        }};
+}
+
+inline std::vector<Scene> allScenes() {
+    return {sandAvalanche(), sandPour(), steamTank(), waterBasin(), oilFire(), lavaMeetsWater(), mostlyEmpty(), mixedMaterials(), brushDrag()};
+}
+}
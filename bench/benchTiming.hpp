@@ -0,0 +1,70 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <ostream>
+#include <vector>
+
+// Timing helpers shared by the headless tools, every stage of update() is
+// timed on its own and reported as percentiles.
+
+namespace bench_timing {
+
+using clock_type = std::chrono::steady_clock;
+
+struct StageTimes {
+    std::vector<double> ns;
+
+    double percentile(double p) const {
+        if (ns.empty()) { return 0.0; }
+        std::vector<double> sorted = ns;
+        std::sort(sorted.begin(), sorted.end());
+        size_t index = static_cast<size_t>(p * static_cast<double>(sorted.size() - 1));
+        return sorted[index];
+    }
+
+    double total() const {
+        double sum = 0.0;
+        for (double t : ns) { sum += t; }
+        return sum;
+    }
+};
+
+constexpr const char* layoutName() {
+#ifdef CELLSIM_AOS_PIXELS
+    return "AoS";
+#else
+    return "SoA";
+#endif
+}
+
+constexpr const char* dispatchName() {
+#ifdef CELLSIM_FLAG_CHAIN_DISPATCH
+    return "flag_chain";
+#else
+    return "kernel_table";
+#endif
+}
+
+constexpr const char* sweepName() {
+#if defined(CELLSIM_SCALAR_SWEEP) || defined(CELLSIM_FLAG_CHAIN_DISPATCH)
+    return "scalar";
+#else
+    return "occupancy_planes";
+#endif
+}
+
+template<typename F>
+double timeNs(F&& f) {
+    auto start = clock_type::now();
+    f();
+    return std::chrono::duration<double, std::nano>(clock_type::now() - start).count();
+}
+
+inline void printStage(std::ostream& os, const char* name, const StageTimes& times) {
+    os << "      \"" << name << "\": {"
+       << "\"p50_us\": " << times.percentile(0.50) / 1000.0 << ", "
+       << "\"p99_us\": " << times.percentile(0.99) / 1000.0 << ", "
+       << "\"mean_us\": " << (times.ns.empty() ? 0.0 : times.total() / static_cast<double>(times.ns.size())) / 1000.0 << "}";
+}
+}
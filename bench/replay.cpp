@@ -0,0 +1,129 @@
+// Headless replay of a recorded session, see ActionLog.hpp. Loads the world
+// the recording started from, feeds the logged actions back at the ticks
+// they arrived and runs update() as fast as the CPU allows. Prints the
+// timings of each update() stage and a hash of the final world as JSON, so
+// two builds can be compared on exactly the same input and checked to end in
+// the same world. The seed, boundary mode and physics threads are the
+// recording's, --threads overrides the last.
+//
+// usage: replay --log path [--world path] [--threads T] [--extra-ticks N]
+
+#include <cstdint>
+#include <cstdlib>
+#include <filesystem>
+#include <iostream>
+#include <string>
+#include "cellsim_core.hpp"
+#include "ActionLog.hpp"
+#include "benchTiming.hpp"
+
+namespace {
+
+using namespace bench_timing;
+
+struct ReplayOptions {
+    std::string log;
+    std::string world; // defaults to log + ".world"
+    int threads = -1;  // -1 matches the recording
+    uint64_t extraTicks = 0;
+};
+
+ReplayOptions parseArgs(int argc, char** argv) {
+    ReplayOptions options;
+    for (int i = 1; i + 1 < argc; i += 2) {
+        std::string key = argv[i];
+        std::string value = argv[i + 1];
+        if (key == "--log") { options.log = value; }
+        else if (key == "--world") { options.world = value; }
+        else if (key == "--threads") { options.threads = std::atoi(value.c_str()); }
+        else if (key == "--extra-ticks") { options.extraTicks = std::strtoull(value.c_str(), nullptr, 10); }
+        else { std::cerr << "unknown option " << key << "\n"; std::exit(1); }
+    }
+    if (options.log.empty()) {
+        std::cerr << "usage: replay --log path [--world path] [--threads T] [--extra-ticks N]\n";
+        std::exit(1);
+    }
+    if (options.world.empty()) {
+        options.world = options.log + ".world";
+    }
+    return options;
+}
+
+// FNV-1a over the material and properties planes
+uint64_t worldHash(const PixelGrid& grid) {
+    world_file::WorldSnapshot world = grid.snapshotWorld();
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for (size_t i = 0; i < world.material.size(); i++) {
+        hash = (hash ^ world.material[i]) * 0x100000001b3ULL;
+        hash = (hash ^ world.properties[i]) * 0x100000001b3ULL;
+    }
+    return hash;
+}
+}
+
+int main(int argc, char** argv) {
+    ReplayOptions options = parseArgs(argc, argv);
+
+    action_log::ActionLog log(options.log);
+    const action_log::Header& header = log.header();
+
+    PixelGrid grid(static_cast<int>(header.width), static_cast<int>(header.height));
+    if (std::filesystem::exists(options.world)) {
+        grid.loadWorld(options.world);
+    } else if (header.startTick != 0) {
+        std::cerr << "the recording started at tick " << header.startTick << " and " << options.world
+                  << " is missing, replaying on an empty world\n";
+    }
+    grid.setRandomSeed(header.randomSeed);
+    if (header.boundaryMode > static_cast<uint8_t>(PixelGrid::BoundaryMode::voidEdge)) {
+        std::cerr << options.log << " was recorded with an unknown boundary mode " << int{header.boundaryMode} << "\n";
+        return 1;
+    }
+    grid.setBoundaryMode(static_cast<PixelGrid::BoundaryMode>(header.boundaryMode));
+
+    int threads = options.threads >= 0 ? options.threads : (header.parallelPhysics ? 2 : 1);
+    if ((threads > 1) != (header.parallelPhysics != 0)) {
+        std::cerr << "the recording ran " << (header.parallelPhysics ? "on a physics pool" : "single threaded")
+                  << ", the final world will differ\n";
+    }
+    grid.setPhysicsThreads(threads);
+
+    StageTimes physics, actions, drawBuffer;
+    auto step = [&] {
+        physics.ns.push_back(timeNs([&] { grid.stepPhysics(); }));
+        actions.ns.push_back(timeNs([&] { grid.stepActions(); }));
+        drawBuffer.ns.push_back(timeNs([&] { grid.stepDrawBuffer(); }));
+    };
+
+    auto start = clock_type::now();
+    for (const action_log::ActionLog::Entry& entry : log.entries()) {
+        while (grid.getTickCount() < entry.tick) { step(); }
+        grid.userAction(entry.action);
+    }
+    // actions queued at the last tick run in the update after it
+    uint64_t lastTick = log.endTick() + 1 + options.extraTicks;
+    while (grid.getTickCount() < lastTick) { step(); }
+    double seconds = std::chrono::duration<double>(clock_type::now() - start).count();
+
+    std::ostream& os = std::cout;
+    os << "{\n";
+    os << "  \"layout\": \"" << layoutName() << "\",\n";
+    os << "  \"dispatch\": \"" << dispatchName() << "\",\n";
+    os << "  \"colorize\": \"" << colorize::implementationName() << "\",\n";
+    os << "  \"width\": " << header.width << ",\n";
+    os << "  \"height\": " << header.height << ",\n";
+    os << "  \"threads\": " << threads << ",\n";
+    os << "  \"actions\": " << log.entries().size() << ",\n";
+    os << "  \"ticks\": " << physics.ns.size() << ",\n";
+    os << "  \"ticks_per_second\": " << static_cast<double>(physics.ns.size()) / seconds << ",\n";
+    os << "  \"world_hash\": \"" << std::hex << worldHash(grid) << std::dec << "\",\n";
+    os << "  \"stages\": {\n";
+    printStage(os, "doPhysics", physics);
+    os << ",\n";
+    printStage(os, "executeActions", actions);
+    os << ",\n";
+    printStage(os, "updateDrawBuffer", drawBuffer);
+    os << "\n  }\n";
+    os << "}\n";
+    return 0;
+}
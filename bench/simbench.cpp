@@ -0,0 +1,124 @@
+// Headless simulation benchmark, builds a PixelGrid with no window, runs
+// every canned scene for a fixed number of ticks and prints the timings of
+// each update() stage as JSON.
+//
+// usage: simbench [--ticks N] [--width W] [--height H] [--threads T]
+//                 [--seed S] [--scene name] [--rules branching|table]
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "cellsim_core.hpp"
+#include "benchScenes.hpp"
+#include "benchTiming.hpp"
+
+namespace {
+
+struct BenchOptions {
+    int ticks = 500;
+    int width = 1600;
+    int height = 900;
+    int threads = 1;
+    uint64_t seed = 1;
+    std::string scene;
+    std::string rules = "branching";
+};
+
+using namespace bench_timing;
+
+BenchOptions parseArgs(int argc, char** argv) {
+    BenchOptions options;
+    for (int i = 1; i + 1 < argc; i += 2) {
+        std::string key = argv[i];
+        std::string value = argv[i + 1];
+        if (key == "--ticks") { options.ticks = std::atoi(value.c_str()); }
+        else if (key == "--width") { options.width = std::atoi(value.c_str()); }
+        else if (key == "--height") { options.height = std::atoi(value.c_str()); }
+        else if (key == "--threads") { options.threads = std::atoi(value.c_str()); }
+        else if (key == "--seed") { options.seed = std::strtoull(value.c_str(), nullptr, 10); }
+        else if (key == "--scene") { options.scene = value; }
+        else if (key == "--rules") { options.rules = value; }
+        else { std::cerr << "unknown option " << key << "\n"; std::exit(1); }
+    }
+    if (options.rules != "branching" && options.rules != "table") {
+        std::cerr << "unknown rules " << options.rules << ", use branching or table\n";
+        std::exit(1);
+    }
+    return options;
+}
+
+void runScene(const bench_scenes::Scene& scene, const BenchOptions& options, bool last) {
+    PixelGrid grid(options.width, options.height);
+    grid.setRandomSeed(options.seed);
+    grid.setPhysicsThreads(options.threads);
+    if (options.rules == "table") {
+        grid.setMovementRules(PixelGrid::MovementRules::neighbourhoodTable);
+    }
+
+    scene.setup(grid);
+    grid.stepActions();
+
+    StageTimes physics, actions, drawBuffer;
+    double activeChunkSum = 0.0;
+    for (int tick = 0; tick < options.ticks; tick++) {
+        if (scene.input) {
+            scene.input(grid, tick);
+        }
+        physics.ns.push_back(timeNs([&] { grid.stepPhysics(); }));
+        actions.ns.push_back(timeNs([&] { grid.stepActions(); }));
+        drawBuffer.ns.push_back(timeNs([&] { grid.stepDrawBuffer(); }));
+        activeChunkSum += grid.getActiveChunkCount();
+    }
+
+    double cellTicks = static_cast<double>(options.width) * options.height * options.ticks;
+
+    std::ostream& os = std::cout;
+    os << "    {\n";
+    os << "      \"name\": \"" << scene.name << "\",\n";
+    os << "      \"ns_per_cell_tick\": " << physics.total() / cellTicks << ",\n";
+    os << "      \"mean_active_chunks\": " << activeChunkSum / options.ticks << ",\n";
+    printStage(os, "doPhysics", physics);
+    os << ",\n";
+    printStage(os, "executeActions", actions);
+    os << ",\n";
+    printStage(os, "updateDrawBuffer", drawBuffer);
+    os << "\n    }" << (last ? "" : ",") << "\n";
+}
+}
+
+int main(int argc, char** argv) {
+    BenchOptions options = parseArgs(argc, argv);
+
+    std::vector<bench_scenes::Scene> scenes;
+    for (const bench_scenes::Scene& scene : bench_scenes::allScenes()) {
+        if (options.scene.empty() || options.scene == scene.name) {
+            scenes.push_back(scene);
+        }
+    }
+    if (scenes.empty()) {
+        std::cerr << "no scene named " << options.scene << "\n";
+        return 1;
+    }
+
+    std::cout << "{\n";
+    std::cout << "  \"layout\": \"" << layoutName() << "\",\n";
+    std::cout << "  \"dispatch\": \"" << dispatchName() << "\",\n";
+    std::cout << "  \"sweep\": \"" << sweepName() << "\",\n";
+    std::cout << "  \"rules\": \"" << options.rules << "\",\n";
+    std::cout << "  \"colorize\": \"" << colorize::implementationName() << "\",\n";
+    std::cout << "  \"width\": " << options.width << ",\n";
+    std::cout << "  \"height\": " << options.height << ",\n";
+    std::cout << "  \"ticks\": " << options.ticks << ",\n";
+    std::cout << "  \"threads\": " << options.threads << ",\n";
+    std::cout << "  \"seed\": " << options.seed << ",\n";
+    std::cout << "  \"scenes\": [\n";
+    for (size_t i = 0; i < scenes.size(); i++) {
+        runScene(scenes[i], options, i + 1 == scenes.size());
+    }
+    std::cout << "  ]\n";
+    std::cout << "}\n";
+    return 0;
+}
@@ -0,0 +1,199 @@
+#include "ActionLog.hpp"
+#include <algorithm>
+#include <bit>
+#include <cstring>
+#include <iterator>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include <variant>
+
+static_assert(std::endian::native == std::endian::little,
+    "action logs are little endian and written straight from memory");
+
+namespace action_log {
+
+ActionRecorder::ActionRecorder(const std::string& path, const Header& header)
+  : m_file(path, std::ios::binary | std::ios::trunc)
+  , m_lastTick(header.startTick)
+{
+    if (!m_file.is_open()) {
+        throw std::runtime_error("action_log: cannot open " + path);
+    }
+    m_file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+}
+
+void ActionRecorder::writeRecord(uint64_t tick, uint8_t tag, const void* payload, size_t size) {
+    // ticks only grow, the delta is LEB128 coded and nearly always one byte
+    uint64_t delta = tick - m_lastTick;
+    m_lastTick = tick;
+    char bytes[10];
+    size_t length = 0;
+    do {
+        uint8_t low = delta & 0x7f;
+        delta >>= 7;
+        bytes[length++] = static_cast<char>(delta ? (low | 0x80) : low);
+    } while (delta);
+
+    m_file.write(bytes, static_cast<std::streamsize>(length));
+    m_file.put(static_cast<char>(tag));
+    m_file.write(static_cast<const char*>(payload), static_cast<std::streamsize>(size));
+}
+
+void ActionRecorder::record(uint64_t tick, const Action& action) {
+    std::visit([&](const auto& command) {
+        using T = std::decay_t<decltype(command)>;
+        static_assert(std::is_trivially_copyable_v<T>, "actions are logged byte for byte");
+        writeRecord(tick, static_cast<uint8_t>(action.index()), &command, sizeof(T));
+    }, action);
+    m_recordCount ++;
+}
+
+void ActionRecorder::record(uint64_t tick, const ActionIncludingPair& action) {
+    if (const ActionPair* pair = std::get_if<ActionPair>(&action)) {
+        record(tick, pair->this_action.first);
+        record(tick, pair->this_action.second);
+    } else {
+        record(tick, std::get<Action>(action));
+    }
+}
+
+void ActionRecorder::finish(uint64_t tick) {
+    writeRecord(tick, endTag, nullptr, 0);
+    m_file.flush();
+}
+
+namespace {
+static_assert(std::variant_size_v<Action> < endTag, "action tags are one byte");
+
+// A record only decodes to an action the grid can apply: materials that
+// exist, cells of the grid the log was recorded on, brushes no larger than
+// that grid. Strokes may run past its edges, as a drag does, but not
+// further than the grid is wide or high. Brush pixels carry whatever the
+// UI had in their properties, setPixel replaces them, so only the pixels
+// written as they are have their properties checked.
+constexpr uint8_t knownProperties = pixel_properties::OnFire | pixel_properties::AlwaysOnFire;
+
+bool inGrid(Vec2i pos, const Header& header) {
+    return pos.x >= 0 && pos.y >= 0 && static_cast<uint32_t>(pos.x) < header.width
+        && static_cast<uint32_t>(pos.y) < header.height;
+}
+
+bool nearGrid(Vec2i pos, const Header& header) {
+    const int64_t width = header.width;
+    const int64_t height = header.height;
+    return pos.x >= -width && pos.x < 2 * width && pos.y >= -height && pos.y < 2 * height;
+}
+
+bool isBrushSize(int size, const Header& header) {
+    return size >= 0 && static_cast<uint32_t>(size) <= std::max(header.width, header.height);
+}
+
+bool isMaterial(uint8_t material) {
+    return material < materials::NumMaterials;
+}
+
+bool isValid(const SetPixelAction& a, const Header& h) {
+    return inGrid(a.pos, h) && isMaterial(a.pixel_type.material);
+}
+
+bool isValid(const DrawCircle& a, const Header& h) {
+    return nearGrid(a.pos, h) && isBrushSize(a.radius, h) && isMaterial(a.pixel_type.material);
+}
+
+bool isValid(const DrawLineAction& a, const Header& h) {
+    return nearGrid(a.start, h) && nearGrid(a.end, h) && isBrushSize(a.width, h) && isMaterial(a.pixel_type.material);
+}
+
+bool isValid(const DrawParallelogramAction& a, const Header& h) {
+    return nearGrid(a.cornerTL, h) && nearGrid(a.cornerTR, h) && nearGrid(a.cornerBL, h)
+        && nearGrid(a.cornerBL - a.cornerTR + a.cornerTL, h) && isMaterial(a.pixel_type.material);
+}
+
+// clicks off the grid are queued and then ignored, see tryIgnitePixel
+bool isValid(const IgnitionAction& a, const Header& h) {
+    return nearGrid(a.pos, h);
+}
+
+bool isValid(const IncinerationAction& a, const Header& h) {
+    return inGrid(a.pos, h) && isMaterial(a.pixel.material);
+}
+
+bool isValid(const m_IgniteAction& a, const Header& h) {
+    return inGrid(a.pos, h);
+}
+
+bool isValid(const SetPixelMaterialAndProperties& a, const Header& h) {
+    return inGrid(a.pos, h) && isMaterial(a.material) && (a.properties & ~knownProperties) == 0;
+}
+
+template<size_t... I>
+bool decodeAction(uint8_t tag, const uint8_t*& cursor, const uint8_t* end, const Header& header, Action& out,
+                  std::index_sequence<I...>) {
+    auto decodeAs = [&]<size_t Index>() {
+        using T = std::variant_alternative_t<Index, Action>;
+        if (static_cast<size_t>(end - cursor) < sizeof(T)) { return false; }
+        T command;
+        std::memcpy(&command, cursor, sizeof(T));
+        cursor += sizeof(T);
+        if (!isValid(command, header)) { return false; }
+        out = command;
+        return true;
+    };
+    bool decoded = false;
+    ((tag == I ? (decoded = decodeAs.template operator()<I>(), true) : false) || ...);
+    return decoded;
+}
+}
+
+ActionLog::ActionLog(const std::string& path) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file.is_open()) {
+        throw std::runtime_error("action_log: cannot open " + path);
+    }
+    std::vector<uint8_t> bytes{std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>()};
+
+    if (bytes.size() < sizeof(Header)) {
+        throw std::runtime_error("action_log: " + path + " is too short to be a log");
+    }
+    std::memcpy(&m_header, bytes.data(), sizeof(Header));
+    if (std::memcmp(m_header.magic, magic, sizeof(magic)) != 0) {
+        throw std::runtime_error("action_log: " + path + " is not an action log");
+    }
+    if (m_header.version != version) {
+        throw std::runtime_error("action_log: " + path + " has an unsupported version");
+    }
+
+    const uint8_t* cursor = bytes.data() + sizeof(Header);
+    const uint8_t* end = bytes.data() + bytes.size();
+    uint64_t tick = m_header.startTick;
+    m_endTick = tick;
+    while (cursor < end) {
+        uint64_t delta = 0;
+        int shift = 0;
+        while (true) {
+            if (cursor == end || shift > 63) {
+                throw std::runtime_error("action_log: " + path + " has a truncated record");
+            }
+            uint8_t byte = *cursor++;
+            delta |= static_cast<uint64_t>(byte & 0x7f) << shift;
+            shift += 7;
+            if (!(byte & 0x80)) { break; }
+        }
+        if (cursor == end) {
+            throw std::runtime_error("action_log: " + path + " has a truncated record");
+        }
+        tick += delta;
+        m_endTick = tick;
+
+        uint8_t tag = *cursor++;
+        if (tag == endTag) { break; }
+
+        Action action;
+        if (!decodeAction(tag, cursor, end, m_header, action, std::make_index_sequence<std::variant_size_v<Action>>{})) {
+            throw std::runtime_error("action_log: " + path + " has a record that does not decode");
+        }
+        m_entries.push_back(Entry{tick, action});
+    }
+}
+}
@@ -0,0 +1,94 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+#include "action_types.h"
+
+// Recording of the user actions a PixelGrid received. A log is
+//   Header
+//   records, each: tick delta (LEB128), tag (byte), payload
+// where the tag is the action's index in the Action variant and the payload
+// its bytes, so the log costs a few bytes more than the actions themselves.
+// The tick of a record is the PixelGrid tick count when the action was
+// queued, a replay runs update() until it reaches that tick and then queues
+// the action, which makes it run in the same update as it did live. The
+// endTag record marks the tick recording stopped at.
+//
+// Physics randomness depends only on the seed, the cell and the tick, so a
+// log replayed on the world it was recorded on (see startRecording), with the
+// boundary mode of the header, ends in the same world, as long as the physics
+// runs on a pool (2 or more threads) in both or single threaded in both.
+
+namespace action_log {
+
+constexpr char     magic[8] = {'C', 'S', 'A', 'C', 'T', 'L', 'O', 'G'};
+constexpr uint32_t version  = 1;
+constexpr uint8_t  endTag   = 0xff;
+
+struct Header {
+    char     magic[8];
+    uint32_t version;
+    uint32_t width;
+    uint32_t height;
+    uint8_t  parallelPhysics; // 1 when recorded with a physics pool
+    uint8_t  boundaryMode;    // PixelGrid::BoundaryMode, 0 a wall
+    uint8_t  reserved[2];
+    uint64_t randomSeed;
+    uint64_t startTick;
+};
+static_assert(sizeof(Header) == 40, "the header is written byte for byte");
+
+// Appends actions to a log file as they arrive. Throws std::runtime_error
+// when the file cannot be created.
+class ActionRecorder
+{
+    std::ofstream m_file;
+    uint64_t m_lastTick = 0;
+    uint64_t m_recordCount = 0;
+
+    void writeRecord(uint64_t tick, uint8_t tag, const void* payload, size_t size);
+
+  public:
+    ActionRecorder(const std::string& path, const Header& header);
+
+    // writes the end record, a recorder that is destroyed without finish()
+    // leaves a log that replays up to its last action
+    void finish(uint64_t tick);
+
+    void record(uint64_t tick, const Action& action);
+
+    // the halves of a pair are queued one after the other, so they are recorded that way
+    void record(uint64_t tick, const ActionIncludingPair& action);
+
+    uint64_t recordCount() const { return m_recordCount; }
+};
+
+// A log read back into memory. Throws std::runtime_error when the file is
+// missing, foreign or has a record that does not decode, which includes
+// actions a grid of the header's size could not apply.
+class ActionLog
+{
+  public:
+    struct Entry {
+        uint64_t tick;
+        Action   action;
+    };
+
+  private:
+    Header m_header{};
+    std::vector<Entry> m_entries;
+    uint64_t m_endTick = 0;
+
+  public:
+    explicit ActionLog(const std::string& path);
+
+    const Header& header() const { return m_header; }
+    const std::vector<Entry>& entries() const { return m_entries; }
+
+    // the tick recording stopped at, or the tick of the last action if it never did
+    uint64_t endTick() const { return m_endTick; }
+};
+}
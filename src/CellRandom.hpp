@@ -0,0 +1,62 @@
+#pragma once
+
+#include <cstdint>
+#include "Vec2.hpp"
+
+// Counter based random numbers for the physics step. Every draw is a hash of
+// (seed, x, y, tick) so a cell's decisions do not depend on the order cells are
+// visited in or on which thread visits them, and a run is reproducible from
+// its seed.
+
+namespace cell_random {
+
+// splitmix64 finaliser
+constexpr uint64_t mix(uint64_t z) {
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+}
+
+constexpr uint64_t hash(uint64_t seed, int x, int y, uint64_t tick) {
+    uint64_t position = (static_cast<uint64_t>(static_cast<uint32_t>(x)) << 32) | static_cast<uint32_t>(y);
+    return mix(seed ^ mix(position ^ mix(tick + 0x9e3779b97f4a7c15ULL)));
+}
+}
+
+// The random source handed to the physics of one cell for one tick.
+// A hash gives 64 bits which are sliced off one per yes / no decision,
+// a fresh hash is only computed when they run out.
+class CellRandom
+{
+    uint64_t m_state;
+    uint64_t m_bits;
+    int      m_bitsLeft = 64;
+
+    uint64_t nextWord() {
+        m_state = cell_random::mix(m_state + 0x9e3779b97f4a7c15ULL);
+        return m_state;
+    }
+
+  public:
+    CellRandom(uint64_t seed, Vec2i pos, uint64_t tick)
+      : m_state(cell_random::hash(seed, pos.x, pos.y, tick))
+      , m_bits(m_state)
+    {}
+
+    bool bit() {
+        if (m_bitsLeft == 0) {
+            m_bits = nextWord();
+            m_bitsLeft = 64;
+        }
+        bool result = m_bits & 1;
+        m_bits >>= 1;
+        m_bitsLeft --;
+        return result;
+    }
+
+    // uniform in [0, bound)
+    uint32_t below(uint32_t bound) {
+        uint64_t word = nextWord() >> 32;
+        return static_cast<uint32_t>((word * bound) >> 32);
+    }
+};
@@ -0,0 +1,206 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <climits>
+#include <cstddef>
+#include <vector>
+#include "Vec2.hpp"
+
+// The pixel grid is split into fixed size chunks, every chunk keeps a dirty
+// rectangle (in grid coordinates) of the cells that may change on the next
+// physics step. Anything that changes a pixel widens the rectangle of the
+// chunk it lives in, doPhysics then only sweeps the rectangles of awake chunks
+// so settled stone and air cost nothing.
+
+struct DirtyRect
+{
+    // inclusive bounds, an empty rect has max < min
+    int minX = 0;
+    int minY = 0;
+    int maxX = -1;
+    int maxY = -1;
+
+    bool empty() const {
+        return maxX < minX || maxY < minY;
+    }
+
+    void include(int x0, int y0, int x1, int y1) {
+        if (empty()) {
+            minX = x0; minY = y0;
+            maxX = x1; maxY = y1;
+            return;
+        }
+        minX = std::min(minX, x0);
+        minY = std::min(minY, y0);
+        maxX = std::max(maxX, x1);
+        maxY = std::max(maxY, y1);
+    }
+
+    void clear() {
+        *this = DirtyRect{};
+    }
+};
+
+// the rect that collects changes during a step, with the parallel sweep
+// workers on neighbouring chunks can widen the same rect so every bound is
+// an atomic that only ever grows
+class AtomicDirtyRect
+{
+    std::atomic<int> m_minX {INT_MAX};
+    std::atomic<int> m_minY {INT_MAX};
+    std::atomic<int> m_maxX {INT_MIN};
+    std::atomic<int> m_maxY {INT_MIN};
+
+    static void atomicMin(std::atomic<int>& bound, int value) {
+        int current = bound.load(std::memory_order_relaxed);
+        while (value < current && !bound.compare_exchange_weak(current, value, std::memory_order_relaxed)) {}
+    }
+
+    static void atomicMax(std::atomic<int>& bound, int value) {
+        int current = bound.load(std::memory_order_relaxed);
+        while (value > current && !bound.compare_exchange_weak(current, value, std::memory_order_relaxed)) {}
+    }
+
+  public:
+    void include(int x0, int y0, int x1, int y1) {
+        atomicMin(m_minX, x0);
+        atomicMin(m_minY, y0);
+        atomicMax(m_maxX, x1);
+        atomicMax(m_maxY, y1);
+    }
+
+    // only call between steps, when no worker is writing
+    DirtyRect load() const {
+        if (m_maxX.load(std::memory_order_relaxed) == INT_MIN) {
+            return DirtyRect{};
+        }
+        return DirtyRect{
+            m_minX.load(std::memory_order_relaxed), m_minY.load(std::memory_order_relaxed),
+            m_maxX.load(std::memory_order_relaxed), m_maxY.load(std::memory_order_relaxed)};
+    }
+
+    void clear() {
+        m_minX.store(INT_MAX, std::memory_order_relaxed);
+        m_minY.store(INT_MAX, std::memory_order_relaxed);
+        m_maxX.store(INT_MIN, std::memory_order_relaxed);
+        m_maxY.store(INT_MIN, std::memory_order_relaxed);
+    }
+};
+
+struct Chunk
+{
+    DirtyRect       current; // swept during this step
+    AtomicDirtyRect next;    // collects changes made during this step
+};
+
+class ChunkGrid
+{
+    int m_gridWidth  = 0;
+    int m_gridHeight = 0;
+    int m_chunkSize  = 0;
+    int m_chunksX    = 0;
+    int m_chunksY    = 0;
+    int m_activeChunks = 0;
+
+    std::vector<Chunk> m_chunks;
+
+  public:
+    static constexpr int defaultChunkSize = 64;
+
+    // the furthest a pixel can reach in a single step (liquids and gasses
+    // move two cells sideways), a change wakes every cell this close to it
+    static constexpr int wakeMargin = 2;
+
+    ChunkGrid() = default;
+
+    ChunkGrid(int gridWidth, int gridHeight, int chunkSize = defaultChunkSize)
+      : m_gridWidth(gridWidth)
+      , m_gridHeight(gridHeight)
+      , m_chunkSize(chunkSize)
+      , m_chunksX((gridWidth + chunkSize - 1) / chunkSize)
+      , m_chunksY((gridHeight + chunkSize - 1) / chunkSize)
+    {
+        m_chunks = std::vector<Chunk>(static_cast<size_t>(m_chunksX * m_chunksY));
+    }
+
+    // wake everything within wakeMargin of pos on the next step
+    void markDirty(Vec2i pos) {
+        markRectDirty(pos.x - wakeMargin, pos.y - wakeMargin, pos.x + wakeMargin, pos.y + wakeMargin);
+    }
+
+    // wake an inclusive rectangle of cells on the next step, the rectangle is
+    // clipped to the grid and split over every chunk it overlaps
+    void markRectDirty(int x0, int y0, int x1, int y1) {
+        x0 = std::max(x0, 0);
+        y0 = std::max(y0, 0);
+        x1 = std::min(x1, m_gridWidth - 1);
+        y1 = std::min(y1, m_gridHeight - 1);
+        if (x1 < x0 || y1 < y0) { return; }
+
+        for (int cy = y0 / m_chunkSize; cy <= y1 / m_chunkSize; cy++) {
+            for (int cx = x0 / m_chunkSize; cx <= x1 / m_chunkSize; cx++) {
+                int chunkX0 = cx * m_chunkSize;
+                int chunkY0 = cy * m_chunkSize;
+                chunkAt(cx, cy).next.include(
+                    std::max(x0, chunkX0), std::max(y0, chunkY0),
+                    std::min(x1, chunkX0 + m_chunkSize - 1), std::min(y1, chunkY0 + m_chunkSize - 1));
+            }
+        }
+    }
+
+    void markAllDirty() {
+        markRectDirty(0, 0, m_gridWidth - 1, m_gridHeight - 1);
+    }
+
+    // promote the changes collected during the last step to the rects swept
+    // by this step
+    void beginStep() {
+        m_activeChunks = 0;
+        for (Chunk& chunk : m_chunks) {
+            chunk.current = chunk.next.load();
+            chunk.next.clear();
+            if (!chunk.current.empty()) {
+                m_activeChunks ++;
+            }
+        }
+    }
+
+    // widens bands[cy] by every change collected in chunk row cy since the
+    // last beginStep, bands must hold chunksY() rects. Every pixel write
+    // marks its cells dirty, so after a step these cover all changed cells.
+    // Changes are clipped to clip and given relative to its top left corner.
+    void includeChangedBands(std::vector<DirtyRect>& bands, const DirtyRect& clip) const {
+        for (int cy = 0; cy < m_chunksY; cy++) {
+            for (int cx = 0; cx < m_chunksX; cx++) {
+                DirtyRect changed = chunkAt(cx, cy).next.load();
+                int x0 = std::max(changed.minX, clip.minX);
+                int y0 = std::max(changed.minY, clip.minY);
+                int x1 = std::min(changed.maxX, clip.maxX);
+                int y1 = std::min(changed.maxY, clip.maxY);
+                if (!changed.empty() && x0 <= x1 && y0 <= y1) {
+                    bands[static_cast<size_t>(cy)].include(x0 - clip.minX, y0 - clip.minY, x1 - clip.minX, y1 - clip.minY);
+                }
+            }
+        }
+    }
+
+    // index of the chunk holding cell (x, y), chunks are numbered row by row
+    int chunkIndex(int x, int y) const {
+        return (y / m_chunkSize) * m_chunksX + x / m_chunkSize;
+    }
+
+    Chunk& chunkAt(int cx, int cy) {
+        return m_chunks[static_cast<size_t>(cy * m_chunksX + cx)];
+    }
+
+    const Chunk& chunkAt(int cx, int cy) const {
+        return m_chunks[static_cast<size_t>(cy * m_chunksX + cx)];
+    }
+
+    int chunksX() const { return m_chunksX; }
+    int chunksY() const { return m_chunksY; }
+    int chunkSize() const { return m_chunkSize; }
+    int chunkCount() const { return m_chunksX * m_chunksY; }
+    int activeChunkCount() const { return m_activeChunks; }
+};
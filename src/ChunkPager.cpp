@@ -0,0 +1,345 @@
+#include "ChunkPager.hpp"
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <fcntl.h>
+#include <iostream>
+#include <stdexcept>
+#include <unistd.h>
+
+namespace {
+
+// what a page starts with, the payload and fire entries follow
+struct PageHeader {
+    uint32_t payloadSize;
+    uint32_t fireCount;
+    world_file::ChunkEncoding encoding;
+    uint8_t  material;
+    uint8_t  properties;
+    uint8_t  reserved;
+};
+static_assert(sizeof(PageHeader) == 12, "pages are written byte for byte");
+
+uint64_t nanosecondsSince(std::chrono::steady_clock::time_point start) {
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now() - start).count());
+}
+}
+
+bool PagedChunk::isAir() const {
+    return encoding == world_file::ChunkEncoding::uniform && material == materials::air
+        && properties == pixel_properties::None && fire.empty();
+}
+
+size_t PagedChunk::memoryBytes() const {
+    return sizeof(PagedChunk) + payload.size() + fire.size() * sizeof(world_file::FireEntry);
+}
+
+ChunkPager::ChunkPager(const std::string & pageFile, size_t memoryBudget)
+  : m_path(pageFile)
+  , m_memoryBudget(memoryBudget)
+{
+    m_fd = ::open(pageFile.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (m_fd < 0) {
+        throw std::runtime_error("chunk_pager: cannot open " + pageFile + ": " + std::strerror(errno));
+    }
+    m_thread = std::thread([this] { run(); });
+}
+
+ChunkPager::~ChunkPager() {
+    {
+        std::lock_guard lock(m_mutex);
+        m_stopping = true;
+    }
+    m_work.notify_one();
+    m_thread.join();
+    ::close(m_fd);
+    ::unlink(m_path.c_str());
+}
+
+void ChunkPager::store(ChunkCoord coord, PagedChunk chunk) {
+    std::lock_guard lock(m_mutex);
+    uint64_t k = key(coord);
+    auto found = m_entries.find(k);
+    if (found != m_entries.end()) {
+        // a chunk is either in the grid or here, a second store replaces the first
+        Entry & old = found->second;
+        if (old.state == State::inMemory) {
+            m_lru.erase(old.lru);
+            m_memoryBytes -= old.chunk.memoryBytes();
+        } else if (old.state == State::onDisk || old.state == State::reading) {
+            // a read in flight is dropped, and the I/O thread writes nothing
+            // into the extent before that read is done
+            freeExtent(old.offset, old.size);
+        }
+        // writes and reads in flight see the entry gone and drop their result
+        m_entries.erase(found);
+    }
+    if (chunk.isAir()) {
+        return;
+    }
+
+    m_memoryBytes += chunk.memoryBytes();
+    m_lru.push_front(k);
+    Entry & entry = m_entries[k];
+    entry.chunk = std::move(chunk);
+    entry.lru = m_lru.begin();
+    entry.serial = m_nextSerial++;
+    evict();
+}
+
+std::optional<PagedChunk> ChunkPager::take(ChunkCoord coord) {
+    std::unique_lock lock(m_mutex);
+    uint64_t k = key(coord);
+    auto found = m_entries.find(k);
+    if (found == m_entries.end()) {
+        return std::nullopt;
+    }
+
+    if (found->second.state == State::reading) {
+        // asked for too late, the read is already on its way
+        auto start = std::chrono::steady_clock::now();
+        m_readDone.wait(lock, [&] {
+            found = m_entries.find(k);
+            return found == m_entries.end() || found->second.state != State::reading;
+        });
+        m_stallNs.fetch_add(nanosecondsSince(start), std::memory_order_relaxed);
+        if (found == m_entries.end()) {
+            return std::nullopt;
+        }
+    }
+
+    Entry & entry = found->second;
+    PagedChunk chunk;
+    switch (entry.state) {
+    case State::inMemory:
+        m_lru.erase(entry.lru);
+        m_memoryBytes -= entry.chunk.memoryBytes();
+        chunk = std::move(entry.chunk);
+        break;
+    case State::writing:
+        // the I/O thread finds the entry gone and frees the extent it wrote
+        chunk = std::move(entry.chunk);
+        break;
+    case State::onDisk: {
+        // nobody prefetched it, read it here and make the grid wait
+        auto start = std::chrono::steady_clock::now();
+        chunk = readExtent(entry.offset, entry.size);
+        freeExtent(entry.offset, entry.size);
+        m_pageIns.fetch_add(1, std::memory_order_relaxed);
+        m_stallNs.fetch_add(nanosecondsSince(start), std::memory_order_relaxed);
+        break;
+    }
+    case State::reading:
+        break;
+    }
+    m_entries.erase(found);
+    return chunk;
+}
+
+void ChunkPager::prefetch(ChunkCoord coord) {
+    {
+        std::lock_guard lock(m_mutex);
+        auto found = m_entries.find(key(coord));
+        if (found == m_entries.end() || found->second.state != State::onDisk) {
+            return;
+        }
+        found->second.state = State::reading;
+        m_reads.push_back(found->first);
+    }
+    m_work.notify_one();
+}
+
+void ChunkPager::evict() {
+    bool queued = false;
+    while (m_memoryBytes > m_memoryBudget && !m_lru.empty()) {
+        uint64_t k = m_lru.back();
+        m_lru.pop_back();
+        Entry & entry = m_entries.at(k);
+        entry.state = State::writing;
+        m_memoryBytes -= entry.chunk.memoryBytes();
+        m_writes.push_back(k);
+        queued = true;
+    }
+    if (queued) {
+        m_work.notify_one();
+    }
+}
+
+void ChunkPager::run() {
+    std::unique_lock lock(m_mutex);
+    while (true) {
+        m_work.wait(lock, [this] { return m_stopping || !m_reads.empty() || !m_writes.empty(); });
+        if (m_stopping) {
+            return;
+        }
+
+        // reads first, the grid is waiting for those
+        if (!m_reads.empty()) {
+            uint64_t k = m_reads.front();
+            m_reads.pop_front();
+            auto found = m_entries.find(k);
+            if (found == m_entries.end() || found->second.state != State::reading) { continue; }
+            uint64_t offset = found->second.offset;
+            uint32_t size = found->second.size;
+            uint64_t serial = found->second.serial;
+
+            lock.unlock();
+            std::optional<PagedChunk> chunk;
+            try {
+                chunk = readExtent(offset, size);
+            } catch (const std::exception & e) {
+                std::cerr << e.what() << "\n";
+            }
+            lock.lock();
+
+            found = m_entries.find(k);
+            if (found == m_entries.end() || found->second.serial != serial) {
+                m_readDone.notify_all();
+                continue;
+            }
+            Entry & entry = found->second;
+            if (chunk) {
+                freeExtent(offset, size);
+                entry.chunk = std::move(*chunk);
+                entry.state = State::inMemory;
+                m_memoryBytes += entry.chunk.memoryBytes();
+                m_lru.push_front(k);
+                entry.lru = m_lru.begin();
+                m_pageIns.fetch_add(1, std::memory_order_relaxed);
+                evict();
+            } else {
+                // take() reads it again and reports the error
+                entry.state = State::onDisk;
+            }
+            m_readDone.notify_all();
+            continue;
+        }
+
+        uint64_t k = m_writes.front();
+        m_writes.pop_front();
+        auto found = m_entries.find(k);
+        if (found == m_entries.end() || found->second.state != State::writing) { continue; }
+        std::vector<uint8_t> bytes = serialize(found->second.chunk);
+        uint32_t size = static_cast<uint32_t>(bytes.size());
+        uint64_t offset = allocateExtent(size);
+        uint64_t serial = found->second.serial;
+
+        lock.unlock();
+        bool ok = true;
+        try {
+            writeExtent(offset, bytes);
+        } catch (const std::exception & e) {
+            std::cerr << e.what() << "\n";
+            ok = false;
+        }
+        lock.lock();
+
+        found = m_entries.find(k);
+        bool current = found != m_entries.end() && found->second.state == State::writing
+            && found->second.serial == serial;
+        if (!current || !ok) {
+            freeExtent(offset, size);
+        }
+        if (!current) { continue; }
+
+        Entry & entry = found->second;
+        if (ok) {
+            entry.state = State::onDisk;
+            entry.offset = offset;
+            entry.size = size;
+            entry.chunk = PagedChunk{};
+            m_pageOuts.fetch_add(1, std::memory_order_relaxed);
+        } else {
+            // keep it in memory, over budget beats losing cells
+            entry.state = State::inMemory;
+            m_memoryBytes += entry.chunk.memoryBytes();
+            m_lru.push_front(k);
+            entry.lru = m_lru.begin();
+        }
+    }
+}
+
+uint64_t ChunkPager::allocateExtent(uint32_t size) {
+    auto fit = m_freeExtents.lower_bound(size);
+    if (fit == m_freeExtents.end()) {
+        uint64_t offset = m_fileEnd;
+        m_fileEnd += size;
+        return offset;
+    }
+    // the rest of a larger extent goes back on the list
+    uint32_t extentSize = fit->first;
+    uint64_t offset = fit->second;
+    m_freeExtents.erase(fit);
+    if (extentSize > size) {
+        m_freeExtents.emplace(extentSize - size, offset + size);
+    }
+    return offset;
+}
+
+void ChunkPager::freeExtent(uint64_t offset, uint32_t size) {
+    if (offset + size == m_fileEnd) {
+        m_fileEnd = offset;
+        return;
+    }
+    m_freeExtents.emplace(size, offset);
+}
+
+std::vector<uint8_t> ChunkPager::serialize(const PagedChunk & chunk) {
+    PageHeader header{
+        static_cast<uint32_t>(chunk.payload.size()), static_cast<uint32_t>(chunk.fire.size()),
+        chunk.encoding, chunk.material, chunk.properties, 0};
+    size_t fireBytes = chunk.fire.size() * sizeof(world_file::FireEntry);
+    std::vector<uint8_t> bytes(sizeof(PageHeader) + chunk.payload.size() + fireBytes);
+    std::memcpy(bytes.data(), &header, sizeof(header));
+    if (!chunk.payload.empty()) {
+        std::memcpy(bytes.data() + sizeof(header), chunk.payload.data(), chunk.payload.size());
+    }
+    if (fireBytes) {
+        std::memcpy(bytes.data() + sizeof(header) + chunk.payload.size(), chunk.fire.data(), fireBytes);
+    }
+    return bytes;
+}
+
+PagedChunk ChunkPager::readExtent(uint64_t offset, uint32_t size) const {
+    std::vector<uint8_t> bytes(size);
+    size_t done = 0;
+    while (done < bytes.size()) {
+        ssize_t n = ::pread(m_fd, bytes.data() + done, bytes.size() - done, static_cast<off_t>(offset + done));
+        if (n < 0 && errno == EINTR) { continue; }
+        if (n <= 0) {
+            throw std::runtime_error("chunk_pager: cannot read " + m_path + ": " + std::strerror(errno));
+        }
+        done += static_cast<size_t>(n);
+    }
+
+    PageHeader header;
+    std::memcpy(&header, bytes.data(), sizeof(header));
+    size_t fireBytes = static_cast<size_t>(header.fireCount) * sizeof(world_file::FireEntry);
+    if (sizeof(PageHeader) + header.payloadSize + fireBytes != bytes.size()) {
+        throw std::runtime_error("chunk_pager: " + m_path + " holds a corrupt page");
+    }
+    PagedChunk chunk;
+    chunk.encoding = header.encoding;
+    chunk.material = header.material;
+    chunk.properties = header.properties;
+    const uint8_t* payload = bytes.data() + sizeof(header);
+    chunk.payload.assign(payload, payload + header.payloadSize);
+    chunk.fire.resize(header.fireCount);
+    if (fireBytes) {
+        std::memcpy(chunk.fire.data(), payload + header.payloadSize, fireBytes);
+    }
+    return chunk;
+}
+
+void ChunkPager::writeExtent(uint64_t offset, const std::vector<uint8_t> & bytes) const {
+    size_t done = 0;
+    while (done < bytes.size()) {
+        ssize_t n = ::pwrite(m_fd, bytes.data() + done, bytes.size() - done, static_cast<off_t>(offset + done));
+        if (n < 0 && errno == EINTR) { continue; }
+        if (n <= 0) {
+            throw std::runtime_error("chunk_pager: cannot write " + m_path + ": " + std::strerror(errno));
+        }
+        done += static_cast<size_t>(n);
+    }
+}
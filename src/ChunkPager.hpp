@@ -0,0 +1,157 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <list>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include "WorldFile.hpp"
+
+// Keeps the chunks of an unbounded world that lie outside the resident
+// PixelGrid. A chunk that leaves the grid is coded the way world files code
+// them and stored here by its world chunk coordinate. Coded chunks stay in
+// memory until they pass the memory budget, then the least recently used
+// are written to a page file by a background I/O thread. prefetch() asks
+// that thread to read chunks back before the grid needs them, take() hands
+// a chunk back and waits for the disk only when nobody asked in time.
+//
+// Chunks that were never stored are air. The page file is scratch space,
+// it is truncated when the pager starts and removed when it is destroyed.
+
+struct ChunkCoord {
+    int32_t x = 0;
+    int32_t y = 0;
+};
+
+// one chunkSize square of cells, coded like a world file chunk
+struct PagedChunk {
+    world_file::ChunkEncoding encoding = world_file::ChunkEncoding::uniform;
+    uint8_t material = 0;
+    uint8_t properties = 0;
+    // packBits material then properties, empty for uniform chunks
+    std::vector<uint8_t> payload;
+    // FireEntry::cell counts chunk local cells, y * chunkSize + x
+    std::vector<world_file::FireEntry> fire;
+
+    bool isAir() const;
+
+    // what the chunk costs in memory while it is not paged out
+    size_t memoryBytes() const;
+};
+
+class ChunkPager
+{
+    enum class State : uint8_t {
+        inMemory,  // chunk holds the data
+        writing,   // queued for or being written, chunk still holds the data
+        onDisk,    // only the page file holds it
+        reading,   // queued for or being read back
+    };
+
+    struct Entry {
+        State state = State::inMemory;
+        PagedChunk chunk;
+        uint64_t offset = 0; // the extent in the page file while onDisk
+        uint32_t size = 0;
+        std::list<uint64_t>::iterator lru; // only while inMemory
+        // a take() and a new store() of the same coordinate while the I/O
+        // thread works on it make a new entry, this tells them apart
+        uint64_t serial = 0;
+    };
+
+    int m_fd = -1;
+    std::string m_path;
+    size_t m_memoryBudget;
+
+    mutable std::mutex m_mutex;
+    std::condition_variable m_work;
+    std::condition_variable m_readDone;
+    std::unordered_map<uint64_t, Entry> m_entries;
+    // most recently stored or read first, only inMemory chunks
+    std::list<uint64_t> m_lru;
+    size_t m_memoryBytes = 0;
+    std::deque<uint64_t> m_writes;
+    std::deque<uint64_t> m_reads;
+    bool m_stopping = false;
+    uint64_t m_nextSerial = 0;
+
+    // page file extents that no chunk uses any more, by size
+    std::multimap<uint32_t, uint64_t> m_freeExtents;
+    uint64_t m_fileEnd = 0;
+
+    std::atomic<uint64_t> m_pageIns {0};
+    std::atomic<uint64_t> m_pageOuts {0};
+    std::atomic<uint64_t> m_stallNs {0};
+
+    std::thread m_thread;
+
+    static uint64_t key(ChunkCoord coord) {
+        return (static_cast<uint64_t>(static_cast<uint32_t>(coord.y)) << 32) | static_cast<uint32_t>(coord.x);
+    }
+
+    void run();
+
+    // queues least recently used chunks for writing until the rest fit the budget, m_mutex held
+    void evict();
+
+    uint64_t allocateExtent(uint32_t size);
+
+    void freeExtent(uint64_t offset, uint32_t size);
+
+    static std::vector<uint8_t> serialize(const PagedChunk & chunk);
+
+    // throws std::runtime_error when the page file does not hold a chunk
+    PagedChunk readExtent(uint64_t offset, uint32_t size) const;
+
+    void writeExtent(uint64_t offset, const std::vector<uint8_t> & bytes) const;
+
+  public:
+    struct Stats {
+        uint64_t pageIns = 0;
+        uint64_t pageOuts = 0;
+        // time take() spent waiting for the disk
+        uint64_t stallNs = 0;
+    };
+
+    // memoryBudget is the most bytes of coded chunks kept in memory.
+    // Throws std::runtime_error when the page file cannot be created.
+    ChunkPager(const std::string & pageFile, size_t memoryBudget);
+
+    // stops the I/O thread and removes the page file
+    ~ChunkPager();
+
+    ChunkPager(const ChunkPager&) = delete;
+    ChunkPager& operator=(const ChunkPager&) = delete;
+
+    // the chunk at coord left the grid, air chunks are not kept
+    void store(ChunkCoord coord, PagedChunk chunk);
+
+    // takes the chunk at coord out of the pager, empty when it was never
+    // stored (so it is air). Throws std::runtime_error when its page cannot
+    // be read back.
+    std::optional<PagedChunk> take(ChunkCoord coord);
+
+    // the grid is about to need coord, starts reading it if it is paged out
+    void prefetch(ChunkCoord coord);
+
+    Stats stats() const {
+        return Stats{
+            m_pageIns.load(std::memory_order_relaxed),
+            m_pageOuts.load(std::memory_order_relaxed),
+            m_stallNs.load(std::memory_order_relaxed)};
+    }
+
+    // coded bytes held in memory right now
+    size_t memoryBytes() const {
+        std::lock_guard lock(m_mutex);
+        return m_memoryBytes;
+    }
+};
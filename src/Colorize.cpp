@@ -0,0 +1,94 @@
+#include "Colorize.hpp"
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define CELLSIM_HAVE_AVX2_KERNEL
+#endif
+
+namespace colorize {
+
+Palette buildPalette(const uint8_t fireColor[4]) {
+    Palette palette{};
+    for (size_t material = 0; material < static_cast<size_t>(materials::NumMaterials); material++) {
+        uint32_t colour;
+        std::memcpy(&colour, &materials::m_materialToColor_c[4 * material], sizeof(colour));
+        palette[material] = colour;
+
+        uint32_t fire;
+        std::memcpy(&fire, fireColor, sizeof(fire));
+        palette[material + fireOffset] = (material == materials::lava) ? colour : fire;
+    }
+    return palette;
+}
+
+namespace {
+
+void colorizeScalar(const uint8_t* material, const uint8_t* properties, uint8_t* rgba,
+                    size_t count, const Palette& palette) {
+    for (size_t i = 0; i < count; i++) {
+        uint32_t colour = palette[paletteIndex(material[i], properties[i])];
+        std::memcpy(rgba + 4 * i, &colour, sizeof(colour));
+    }
+}
+
+#ifdef CELLSIM_HAVE_AVX2_KERNEL
+__attribute__((target("avx2")))
+void colorizeAvx2(const uint8_t* material, const uint8_t* properties, uint8_t* rgba,
+                  size_t count, const Palette& palette) {
+    const __m256i fireBit = _mm256_set1_epi32(pixel_properties::OnFire);
+    const int* table = reinterpret_cast<const int*>(palette.data());
+
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m256i m = _mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(material + i)));
+        __m256i p = _mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(properties + i)));
+        // paletteIndex() for eight cells, fireOffset is 1 << 8
+        __m256i index = _mm256_or_si256(m, _mm256_slli_epi32(_mm256_and_si256(p, fireBit), 8));
+        __m256i colour = _mm256_i32gather_epi32(table, index, 4);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(rgba + 4 * i), colour);
+    }
+    colorizeScalar(material + i, properties + i, rgba + 4 * i, count - i, palette);
+}
+static_assert(fireOffset == 1 << 8, "the AVX2 kernel shifts the fire bit into place");
+#endif
+
+using Kernel = void (*)(const uint8_t*, const uint8_t*, uint8_t*, size_t, const Palette&);
+
+struct Dispatch {
+    Kernel      kernel;
+    const char* name;
+};
+
+Dispatch pickKernel() {
+#ifdef CELLSIM_HAVE_AVX2_KERNEL
+    if (__builtin_cpu_supports("avx2")) {
+        return {colorizeAvx2, "avx2"};
+    }
+#endif
+    return {colorizeScalar, "scalar"};
+}
+
+const Dispatch& dispatch() {
+    static const Dispatch chosen = pickKernel();
+    return chosen;
+}
+}
+
+void colorizeSpan(const uint8_t* material, const uint8_t* properties, uint8_t* rgba,
+                  size_t count, const Palette& palette) {
+    dispatch().kernel(material, properties, rgba, count, palette);
+}
+
+const char* implementationName() {
+    return dispatch().name;
+}
+
+void cellCodeSpan(const uint8_t* material, const uint8_t* properties, uint8_t* code, size_t count) {
+    // branch free so the compiler vectorises it
+    for (size_t i = 0; i < count; i++) {
+        code[i] = static_cast<uint8_t>(material[i] | ((properties[i] & pixel_properties::OnFire) << 7));
+    }
+}
+static_assert(pixel_properties::OnFire == 1, "cellCodeSpan shifts the fire bit into place");
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include "Materials.h"
+
+// Turns the material and properties planes into the RGBA draw buffer.
+// Every cell costs one 32 bit palette fetch: the palette index is the
+// material, plus fireOffset when the cell is burning, so fire is just a
+// second half of the palette instead of a branch. On x86 CPUs with AVX2 the
+// fetches are done eight at a time with a gather, everywhere else a scalar
+// loop does the same thing.
+
+namespace colorize {
+
+constexpr size_t fireOffset = 256;
+
+// one RGBA colour per palette index, stored so its bytes are R, G, B, A in memory
+using Palette = std::array<uint32_t, 2 * fireOffset>;
+
+// materials take their colour from materials::m_materialToColor_c, burning
+// ones are drawn as fireColor apart from lava which always looks like lava
+Palette buildPalette(const uint8_t fireColor[4]);
+
+constexpr size_t paletteIndex(uint8_t material, uint8_t properties) {
+    return material + (properties & pixel_properties::OnFire) * fireOffset;
+}
+
+// colours count cells, rgba must have room for 4 * count bytes
+void colorizeSpan(const uint8_t* material, const uint8_t* properties, uint8_t* rgba,
+                  size_t count, const Palette& palette);
+
+// "avx2" or "scalar", whichever colorizeSpan picked for this CPU
+const char* implementationName();
+
+// What the draw buffer holds. rgba is coloured on the CPU. cellCodes is one
+// byte per cell for renderers that colour on the GPU: the material, with
+// cellCodeFireBit set when the cell burns, so palette row code >> 7 and
+// column code & 0x7f give the same colour as paletteIndex().
+enum class DrawFormat : uint8_t {
+    rgba,
+    cellCodes,
+};
+
+constexpr size_t bytesPerCell(DrawFormat format) {
+    return format == DrawFormat::rgba ? 4 : 1;
+}
+
+constexpr uint8_t cellCodeFireBit = 0x80;
+static_assert(materials::NumMaterials <= cellCodeFireBit, "materials leave the top bit of a cell code free");
+
+constexpr uint8_t cellCode(uint8_t material, uint8_t properties) {
+    return static_cast<uint8_t>(material | ((properties & pixel_properties::OnFire) ? cellCodeFireBit : 0));
+}
+
+// cell codes of count cells, code must have room for count bytes
+void cellCodeSpan(const uint8_t* material, const uint8_t* properties, uint8_t* code, size_t count);
+}
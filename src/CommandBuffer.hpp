@@ -0,0 +1,119 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+#include <utility>
+#include <variant>
+#include <vector>
+#include "action_types.h"
+
+// Per frame queue of user actions. Commands are copied into one growing
+// arena as (tag, payload) records while input is handled, read back in a
+// single pass in the order they were pushed and dropped all at once with
+// reset(), which keeps the arena's memory for the next frame.
+
+namespace command_buffer {
+
+// position of T in the Action variant, used as the record tag
+template<typename T, typename Variant>
+struct alternativeIndex;
+
+template<typename T, typename... Ts>
+struct alternativeIndex<T, std::variant<Ts...>> {
+    static constexpr size_t value = [] {
+        constexpr bool matches[] = {std::is_same_v<T, Ts>...};
+        for (size_t i = 0; i < sizeof...(Ts); i++) {
+            if (matches[i]) { return i; }
+        }
+        return sizeof...(Ts);
+    }();
+    static_assert(value < sizeof...(Ts), "not an Action alternative");
+};
+
+struct RecordHeader {
+    uint32_t tag;
+    uint32_t size; // of the whole record, header included
+};
+
+constexpr size_t recordAlignment = alignof(std::max_align_t);
+
+constexpr size_t alignUp(size_t n) {
+    return (n + recordAlignment - 1) & ~(recordAlignment - 1);
+}
+}
+
+class CommandBuffer
+{
+    std::vector<std::byte> m_arena;
+    size_t m_used = 0;
+    size_t m_count = 0;
+
+    template<size_t... I, typename F>
+    static void visitRecord(uint32_t tag, const std::byte* payload, F& f, std::index_sequence<I...>) {
+        auto visitAs = [&]<size_t Index>() {
+            using T = std::variant_alternative_t<Index, Action>;
+            T command;
+            std::memcpy(&command, payload, sizeof(T));
+            f(static_cast<const T&>(command));
+        };
+        ((tag == I ? (visitAs.template operator()<I>(), true) : false) || ...);
+    }
+
+  public:
+    template<typename T>
+    void push(const T& command) {
+        static_assert(std::is_trivially_copyable_v<T>, "commands are copied into the arena byte for byte");
+        constexpr uint32_t tag = static_cast<uint32_t>(command_buffer::alternativeIndex<T, Action>::value);
+        constexpr size_t headerSize = command_buffer::alignUp(sizeof(command_buffer::RecordHeader));
+        constexpr size_t recordSize = headerSize + command_buffer::alignUp(sizeof(T));
+
+        if (m_used + recordSize > m_arena.size()) {
+            m_arena.resize(std::max(m_arena.size() * 2, m_used + recordSize));
+        }
+        command_buffer::RecordHeader header{tag, static_cast<uint32_t>(recordSize)};
+        std::memcpy(m_arena.data() + m_used, &header, sizeof(header));
+        std::memcpy(m_arena.data() + m_used + headerSize, &command, sizeof(T));
+        m_used += recordSize;
+        m_count ++;
+    }
+
+    void push(const Action& action) {
+        std::visit([this](const auto& command) { push(command); }, action);
+    }
+
+    // the two halves of a pair run one after the other, so they are queued that way
+    void push(const ActionPair& pair) {
+        push(pair.this_action.first);
+        push(pair.this_action.second);
+    }
+
+    void push(const ActionIncludingPair& action) {
+        std::visit([this](const auto& command) { push(command); }, action);
+    }
+
+    // calls f with every command, as its concrete type, in the order pushed
+    template<typename F>
+    void forEach(F&& f) const {
+        constexpr size_t headerSize = command_buffer::alignUp(sizeof(command_buffer::RecordHeader));
+        size_t offset = 0;
+        while (offset < m_used) {
+            command_buffer::RecordHeader header;
+            std::memcpy(&header, m_arena.data() + offset, sizeof(header));
+            visitRecord(header.tag, m_arena.data() + offset + headerSize, f,
+                        std::make_index_sequence<std::variant_size_v<Action>>{});
+            offset += header.size;
+        }
+    }
+
+    void reset() {
+        m_used = 0;
+        m_count = 0;
+    }
+
+    size_t size() const { return m_count; }
+    bool empty() const { return m_count == 0; }
+    size_t bytesUsed() const { return m_used; }
+};
@@ -0,0 +1,123 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+#include "action_types.h"
+
+// Burn state of the cells that are on fire, keyed by cell index
+// (y * width + x). Only a small part of the world burns at any time, so
+// this open addressing table with linear probing replaces a FirePixel for
+// every cell. A cell is in the map exactly when its pixel has the OnFire
+// property.
+
+class FireMap
+{
+    struct Slot {
+        uint32_t  cell;
+        FirePixel fire;
+    };
+
+    static constexpr uint32_t emptyCell = UINT32_MAX;
+    static constexpr size_t   minimumCapacity = 64;
+
+    std::vector<Slot> m_slots;
+    size_t m_count = 0;
+
+    size_t mask() const { return m_slots.size() - 1; }
+
+    // fibonacci hashing, consecutive cells spread over the table
+    size_t home(uint32_t cell) const {
+        return static_cast<size_t>((cell * 0x9e3779b97f4a7c15ULL) >> 32) & mask();
+    }
+
+    size_t findSlot(uint32_t cell) const {
+        if (m_slots.empty()) { return SIZE_MAX; }
+        for (size_t i = home(cell);; i = (i + 1) & mask()) {
+            if (m_slots[i].cell == cell) { return i; }
+            if (m_slots[i].cell == emptyCell) { return SIZE_MAX; }
+        }
+    }
+
+    void grow() {
+        std::vector<Slot> old = std::move(m_slots);
+        m_slots.assign(old.empty() ? minimumCapacity : old.size() * 2, Slot{emptyCell, {}});
+        m_count = 0;
+        for (const Slot& slot : old) {
+            if (slot.cell != emptyCell) { insertOrAssign(slot.cell, slot.fire); }
+        }
+    }
+
+  public:
+    FirePixel* find(uint32_t cell) {
+        size_t i = findSlot(cell);
+        return i == SIZE_MAX ? nullptr : &m_slots[i].fire;
+    }
+
+    const FirePixel* find(uint32_t cell) const {
+        size_t i = findSlot(cell);
+        return i == SIZE_MAX ? nullptr : &m_slots[i].fire;
+    }
+
+    void insertOrAssign(uint32_t cell, FirePixel fire) {
+        // keep the load factor at or below a half so probe runs stay short
+        if ((m_count + 1) * 2 > m_slots.size()) { grow(); }
+        size_t i = home(cell);
+        while (m_slots[i].cell != emptyCell && m_slots[i].cell != cell) {
+            i = (i + 1) & mask();
+        }
+        if (m_slots[i].cell == emptyCell) { m_count ++; }
+        m_slots[i] = Slot{cell, fire};
+    }
+
+    // backward shift deletion, no tombstones are left behind
+    bool erase(uint32_t cell) {
+        size_t hole = findSlot(cell);
+        if (hole == SIZE_MAX) { return false; }
+
+        for (size_t i = (hole + 1) & mask(); m_slots[i].cell != emptyCell; i = (i + 1) & mask()) {
+            size_t want = home(m_slots[i].cell);
+            // move the entry back if the hole lies on its probe path
+            if (((i - want) & mask()) >= ((i - hole) & mask())) {
+                m_slots[hole] = m_slots[i];
+                hole = i;
+            }
+        }
+        m_slots[hole].cell = emptyCell;
+        m_count --;
+        return true;
+    }
+
+    // exchanges the burn state of two cells, either may be missing
+    void swap(uint32_t a, uint32_t b) {
+        FirePixel* fireA = find(a);
+        FirePixel* fireB = find(b);
+        if (fireA && fireB) {
+            std::swap(*fireA, *fireB);
+        } else if (fireA) {
+            FirePixel fire = *fireA;
+            erase(a);
+            insertOrAssign(b, fire);
+        } else if (fireB) {
+            FirePixel fire = *fireB;
+            erase(b);
+            insertOrAssign(a, fire);
+        }
+    }
+
+    // appends the key of every burning cell, in table order
+    void appendCells(std::vector<uint32_t>& cells) const {
+        for (const Slot& slot : m_slots) {
+            if (slot.cell != emptyCell) { cells.push_back(slot.cell); }
+        }
+    }
+
+    void clear() {
+        m_slots.clear();
+        m_count = 0;
+    }
+
+    size_t size() const { return m_count; }
+    bool empty() const { return m_count == 0; }
+};
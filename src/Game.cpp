@@ -1,17 +1,21 @@
 #include <SFML/Graphics/Texture.hpp>
 #include <iostream>
 #include <string>
+#include <string_view>
 #include <sstream>
 #include <sys/types.h>
 #include "Game.h"
 #include "Materials.h"
 #include "UserInputOptions.h"
 #include "Vec2.hpp"
+#include "Vec2Sfml.hpp"
 #include <fstream>
 #include "imgui-SFML.h"
 #include <algorithm>
+#include <cstring>
 #include <cctype>
 #include "imgui.h"
+#include "Profiler.hpp"
 #include <map>
 #include <variant>
 #include <format>
@@ -35,9 +39,20 @@ LoadedConfig Game::load_config(std::string filePath) {
         {"gridWidth", make_setter(&LoadedConfig::pGrid_width)},
         {"gridHeight", make_setter(&LoadedConfig::pGrid_height)},
         {"fps", make_setter(&LoadedConfig::fps)},
+        {"tickRate", make_setter(&LoadedConfig::tick_rate)},
         {"scale", make_setter(&LoadedConfig::scale)},
         {"windowWidth", make_setter(&LoadedConfig::window_width)},
         {"windowHeight", make_setter(&LoadedConfig::window_height)},
+        {"physicsThreads", make_setter(&LoadedConfig::physics_threads)},
+        {"randomSeed", make_setter(&LoadedConfig::random_seed)},
+        {"boundaryMode", make_setter(&LoadedConfig::boundary_mode)},
+        {"movementRules", make_setter(&LoadedConfig::movement_rules)},
+        {"worldFile", make_setter(&LoadedConfig::world_file)},
+        {"actionLog", make_setter(&LoadedConfig::action_log)},
+        {"pageFile", make_setter(&LoadedConfig::page_file)},
+        {"pageMemoryMB", make_setter(&LoadedConfig::page_memory_mb)},
+        {"traceFile", make_setter(&LoadedConfig::trace_file)},
+        {"traceFrames", make_setter(&LoadedConfig::trace_frames)},
     };
 
     std::ifstream configFile {filePath} ;
@@ -77,16 +92,24 @@ Game::initializeSFML2(LoadedConfig & l_config) {
     SFML2State & sstate = state.sfml2_state;
     LoadedConfig & pstate = state.persistent_state;
 
-    sstate.window_height = pstate.scale * pstate.pGrid_height;
-    sstate.window_width  = pstate.scale * pstate.pGrid_width;
+    // the window shows a viewport into the world, which may be far bigger
+    sstate.window_height = pstate.window_height;
+    sstate.window_width  = pstate.window_width;
 
     sstate.draw_texture_height = sstate.window_height / pstate.scale;
     sstate.draw_texture_width = sstate.window_width / pstate.scale;
     
+    // the OpenGL renderer needs GLSL 3.30, SFML's own drawing keeps working
+    // because a 3.3 context still has the compatibility profile
+    sf::ContextSettings contextSettings;
+    if (pstate.rendering_engine == "OpenGL") {
+        contextSettings.majorVersion = 3;
+        contextSettings.minorVersion = 3;
+    }
     sstate.window.create(
         sf::VideoMode(static_cast<u_int>(state.sfml2_state.window_width), 
                       static_cast<uint>(state.sfml2_state.window_height)),
-        "Falling sand sim");
+        "Falling sand sim", sf::Style::Default, contextSettings);
 
     state.sfml2_state.window.setFramerateLimit(state.persistent_state.fps);
 
@@ -102,15 +125,78 @@ Game::initializeSFML2(LoadedConfig & l_config) {
     sstate.sprite.setScale(static_cast<float>(pstate.scale), static_cast<float>(pstate.scale));
 }
 
+void
+Game::initializeOpenGL() {
+    try {
+        state.sfml2_state.window.setActive(true);
+        auto renderer = std::make_unique<GlRenderer>([](const char* name) {
+            return reinterpret_cast<GlRenderer::GlProc>(sf::Context::getFunction(name));
+        });
+        // the fire colour is fixed, the palette only has to be sent once
+        renderer->setPalette(colorize::buildPalette(state.pixel_grid.m_fireColor.data()));
+        state.opengl_state.renderer = std::move(renderer);
+        // the simulation thread is not running yet
+        state.pixel_grid.setDrawFormat(colorize::DrawFormat::cellCodes);
+    } catch (const std::exception & e) {
+        std::cerr << e.what() << ", drawing with SFML2 instead\n";
+    }
+}
+
 void
 Game::init(LoadedConfig l_config)
 {
     state.persistent_state = l_config;
+    profiler::setThreadName("main");
     state.draw_pixel_type = {materials::sand, 0, material_properties::IsPowder};
+    if (!l_config.page_file.empty()) {
+        // a paged grid scrolls by whole chunks
+        size_t chunkSize = static_cast<size_t>(ChunkGrid::defaultChunkSize);
+        l_config.pGrid_width = (l_config.pGrid_width + chunkSize - 1) / chunkSize * chunkSize;
+        l_config.pGrid_height = (l_config.pGrid_height + chunkSize - 1) / chunkSize * chunkSize;
+        state.persistent_state.pGrid_width = l_config.pGrid_width;
+        state.persistent_state.pGrid_height = l_config.pGrid_height;
+    }
     state.pixel_grid = PixelGrid(l_config.pGrid_width, l_config.pGrid_height);
+    state.pixel_grid.setPhysicsThreads(l_config.physics_threads);
+    if (l_config.random_seed != 0) {
+        state.pixel_grid.setRandomSeed(l_config.random_seed);
+    }
+    if (l_config.boundary_mode == "void") {
+        state.pixel_grid.setBoundaryMode(PixelGrid::BoundaryMode::voidEdge);
+    } else if (l_config.boundary_mode != "wall") {
+        std::cerr << std::format("unknown boundaryMode {}, using wall\n", l_config.boundary_mode);
+    }
+    if (l_config.movement_rules == "table") {
+        state.pixel_grid.setMovementRules(PixelGrid::MovementRules::neighbourhoodTable);
+    } else if (l_config.movement_rules != "branching") {
+        std::cerr << std::format("unknown movementRules {}, using branching\n", l_config.movement_rules);
+    }
+    if (!l_config.world_file.empty()) {
+        try {
+            state.pixel_grid.loadWorld(l_config.world_file);
+            // the window is sized for the loaded world
+            state.persistent_state.pGrid_width = static_cast<size_t>(state.pixel_grid.getWidth());
+            state.persistent_state.pGrid_height = static_cast<size_t>(state.pixel_grid.getHeight());
+        } catch (const std::exception & e) {
+            std::cerr << e.what() << "\n";
+        }
+    }
+    if (!l_config.page_file.empty()) {
+        try {
+            state.pixel_grid.enablePaging(l_config.page_file, l_config.page_memory_mb * 1024 * 1024);
+        } catch (const std::exception & e) {
+            std::cerr << e.what() << "\n";
+        }
+    }
     state.parallelogramState = ParallelogramState();
 
     initializeSFML2(l_config);
+    if (l_config.rendering_engine == "OpenGL") {
+        initializeOpenGL();
+    }
+
+    // from here on the grid is only reached through the simulation thread
+    state.simulation = std::make_unique<SimulationThread>(state.pixel_grid, l_config.tick_rate);
 
     previousTime = clock::now();
 }
@@ -120,23 +206,22 @@ Game::run()
 {
     while (state.running) 
     {
+        CELLSIM_PROFILE_FRAME();
         state.frame_count +=1 ;
         auto currentTime = clock::now();
 
         seconds elapsed = currentTime - previousTime;
         if (elapsed.count() > 1.0) {
-            std::cout << "FPS: " << (state.frame_count) / elapsed.count() << std::endl; 
+            state.render_rate = state.frame_count / elapsed.count();
             state.frame_count = 0;
             previousTime = currentTime;
         }
-        /*std::cout << "Running program\n";*/
-        state.pixel_grid.update();       
-        /*std::cout << "updated\n";*/
         ImGui::SFML::Update(state.sfml2_state.window, state.sfml2_state.delta_clock.restart());
 
         sUserInput();
         heldButtons();
         sGui();
+        syncViewport();
         sRender();
     }
 }
@@ -144,30 +229,143 @@ Game::run()
 void
 Game::sRender()
 {
+    CELLSIM_PROFILE_SCOPE("sRender");
     state.sfml2_state.window.clear();
     /*std::cout << "in rendering function\n";*/
 
-    state.sfml2_state.texture.update(state.pixel_grid.getPixels().data());
+    state.uploaded_bytes = 0;
+    if (state.simulation->acquireFrame()) {
+        uploadFrame(state.simulation->latestFrame());
+    }
 
     /*m_sprite.setTexture(m_texture);*/
     /*m_sprite.setScale(static_cast<float>(m_scale), static_cast<float>(m_scale)); // Scale up*/
-    state.sfml2_state.window.draw(state.sfml2_state.sprite);
+    if (GlRenderer * renderer = state.opengl_state.renderer.get()) {
+        // where the sprite would be, GL counts window rows from the bottom
+        int scale = state.persistent_state.scale;
+        int width = renderer->getWidth() * scale;
+        int height = renderer->getHeight() * scale;
+        int windowHeight = static_cast<int>(state.sfml2_state.window.getSize().y);
+        renderer->draw(0, windowHeight - height, width, height);
+        // SFML caches GL state, ImGui draws through it next
+        state.sfml2_state.window.resetGLStates();
+    } else {
+        state.sfml2_state.window.draw(state.sfml2_state.sprite);
+    }
     ImGui::SFML::Render(state.sfml2_state.window);
 
     state.sfml2_state.window.display();
 }
 
 
+Vec2i
+Game::toSimulationPosition(Vec2i windowPixel)
+{
+    return windowPixel / static_cast<int>(state.persistent_state.scale) + state.window_position;
+}
+
+void
+Game::syncViewport()
+{
+    LoadedConfig & pstate = state.persistent_state;
+    pstate.scale = std::max(pstate.scale, 1);
+
+    // as many cells as fit the window, kept inside the world the same way
+    // PixelGrid::setViewport does so mouse positions map to the cells shown.
+    // A paged world has no edges, the grid follows the camera instead.
+    int worldWidth = static_cast<int>(pstate.pGrid_width);
+    int worldHeight = static_cast<int>(pstate.pGrid_height);
+    Vec2i size(
+        std::min(static_cast<int>(state.sfml2_state.window_width) / pstate.scale, worldWidth),
+        std::min(static_cast<int>(state.sfml2_state.window_height) / pstate.scale, worldHeight));
+    if (pstate.page_file.empty()) {
+        state.window_position.x = std::clamp(state.window_position.x, 0, worldWidth - size.x);
+        state.window_position.y = std::clamp(state.window_position.y, 0, worldHeight - size.y);
+    }
+
+    Vec2i corner = state.window_position;
+    if (corner.x == state.view_corner.x && corner.y == state.view_corner.y
+        && size.x == state.view_size.x && size.y == state.view_size.y) {
+        return;
+    }
+    state.view_corner = corner;
+    state.view_size = size;
+    state.sfml2_state.sprite.setScale(static_cast<float>(pstate.scale), static_cast<float>(pstate.scale));
+    state.simulation->call([corner, size](PixelGrid & grid) { grid.setViewport(corner, size); });
+}
+
+void
+Game::uploadFrame(const SimulationFrame & frame)
+{
+    CELLSIM_PROFILE_SCOPE("uploadFrame");
+    if (frame.format == colorize::DrawFormat::cellCodes) {
+        if (state.opengl_state.renderer) {
+            state.uploaded_bytes = state.opengl_state.renderer->upload(
+                frame.pixels, frame.width, frame.height, frame.changed, frame.full);
+        }
+        return;
+    }
+
+    sf::Texture & texture = state.sfml2_state.texture;
+    // the texture follows the viewport size, a new texture is filled whole
+    sf::Vector2u textureSize = texture.getSize();
+    if (static_cast<u_int>(frame.width) != textureSize.x || static_cast<u_int>(frame.height) != textureSize.y) {
+        texture.create(static_cast<u_int>(frame.width), static_cast<u_int>(frame.height));
+        state.sfml2_state.sprite.setTexture(texture, true);
+        texture.update(frame.pixels.data());
+        state.uploaded_bytes = frame.pixels.size();
+        return;
+    }
+
+    size_t rowBytes = static_cast<size_t>(frame.width) * 4;
+    size_t changedBytes = 0;
+    for (const DirtyRect & band : frame.changed) {
+        if (!band.empty()) {
+            changedBytes += static_cast<size_t>(band.maxX - band.minX + 1) * static_cast<size_t>(band.maxY - band.minY + 1) * 4;
+        }
+    }
+
+    // past this one big upload beats many small ones
+    constexpr double fullUploadFraction = 0.5;
+    if (frame.full || static_cast<double>(changedBytes) > fullUploadFraction * static_cast<double>(frame.pixels.size())) {
+        texture.update(frame.pixels.data());
+        state.uploaded_bytes = frame.pixels.size();
+        return;
+    }
+
+    for (const DirtyRect & band : frame.changed) {
+        if (band.empty()) { continue; }
+        u_int width = static_cast<u_int>(band.maxX - band.minX + 1);
+        u_int height = static_cast<u_int>(band.maxY - band.minY + 1);
+        const uint8_t * first = frame.pixels.data() + static_cast<size_t>(band.minY) * rowBytes;
+
+        if (static_cast<int>(width) == frame.width) {
+            // whole rows are already contiguous in the frame
+            texture.update(first, width, height, 0, static_cast<u_int>(band.minY));
+        } else {
+            size_t bandRowBytes = static_cast<size_t>(width) * 4;
+            state.upload_staging.resize(bandRowBytes * height);
+            for (u_int row = 0; row < height; row++) {
+                std::memcpy(state.upload_staging.data() + row * bandRowBytes,
+                            first + row * rowBytes + static_cast<size_t>(band.minX) * 4, bandRowBytes);
+            }
+            texture.update(state.upload_staging.data(), width, height,
+                           static_cast<u_int>(band.minX), static_cast<u_int>(band.minY));
+        }
+        state.uploaded_bytes += static_cast<size_t>(width) * height * 4;
+    }
+}
+
 void
 Game::paintBrush()
 {
     if (state.left_button_pressed) {
         sf::Vector2i pixelPos = sf::Mouse::getPosition(state.sfml2_state.window);
-        Vec2i simulationPos = Vec2i{pixelPos / static_cast<int>(state.persistent_state.scale)};
-        Vec2i previousSimulationPos = state.previous_mouse_position/ state.persistent_state.scale;
+        Vec2i simulationPos = toSimulationPosition(toVec2(pixelPos));
+        Vec2i previousSimulationPos = toSimulationPosition(state.previous_mouse_position);
         ActionIncludingPair userAction = 
         DrawLineAction{previousSimulationPos, simulationPos, state.paint_brush_width-1, state.draw_pixel_type};
-        state.pixel_grid.userAction(userAction);
+        state.simulation->userAction(userAction);
     }
 }
 
@@ -176,21 +374,21 @@ Game::tryIgnite()
 {
     if (state.left_button_pressed) {
         sf::Vector2i pixelPos = sf::Mouse::getPosition(state.sfml2_state.window);
-        Vec2i simulationPos = Vec2i{pixelPos / static_cast<int>(state.persistent_state.scale)};
+        Vec2i simulationPos = toSimulationPosition(toVec2(pixelPos));
         ActionIncludingPair userAction = IgnitionAction{simulationPos};
-        state.pixel_grid.userAction(userAction);
+        state.simulation->userAction(userAction);
     }
 }
 void Game::holdAndDragLine()
 {
     sf::Vector2i pixelPos = sf::Mouse::getPosition(state.sfml2_state.window);
-    Vec2i simulationPos = Vec2i{pixelPos / static_cast<int>(state.persistent_state.scale)};
+    Vec2i simulationPos = toSimulationPosition(toVec2(pixelPos));
     if (hasUserLeftClicked()) {
         state.drag_line_start_simulation_pos = simulationPos; 
     } else if (hasUserLeftReleased()) {
         ActionIncludingPair userAction = 
         DrawLineAction{state.drag_line_start_simulation_pos, simulationPos, state.draw_line_width, state.draw_pixel_type};
-        state.pixel_grid.userAction(userAction);
+        state.simulation->userAction(userAction);
     }
 }
 
@@ -212,11 +410,11 @@ Game::drawCircle()
     if (hasUserLeftClicked()) 
     {
         sf::Vector2i pixelPos = sf::Mouse::getPosition(state.sfml2_state.window);
-        Vec2i simulationPos = Vec2i{pixelPos / static_cast<int>(state.persistent_state.scale)};
+        Vec2i simulationPos = toSimulationPosition(toVec2(pixelPos));
         ActionIncludingPair userAction = 
         DrawCircle{simulationPos, state.draw_circle_radius, state.draw_pixel_type};
 
-        state.pixel_grid.userAction(userAction);
+        state.simulation->userAction(userAction);
     }
 }
 
@@ -224,7 +422,7 @@ void
 Game::drawParallelogram()
 {
     sf::Vector2i pixelPos = sf::Mouse::getPosition(state.sfml2_state.window);
-    Vec2i simulationPos = Vec2i{pixelPos / static_cast<int>(state.persistent_state.scale)};
+    Vec2i simulationPos = toSimulationPosition(toVec2(pixelPos));
 
     ParallelogramState & astate = state.parallelogramState;
 
@@ -244,7 +442,7 @@ Game::drawParallelogram()
             DrawParallelogramAction{astate.first_parallelogram_point, astate.second_parallelogram_point, 
                 astate.third_parallelogram_point, state.draw_pixel_type};
 
-            state.pixel_grid.userAction(action);
+            state.simulation->userAction(action);
         }
     } 
     else if (hasUserLeftReleased()) {
@@ -286,6 +484,7 @@ Game::heldButtons() {
 
 void 
 Game::sUserInput() {
+    CELLSIM_PROFILE_SCOPE("sUserInput");
     sf::Event event;
     if (!ImGui::IsWindowHovered(ImGuiHoveredFlags_AnyWindow)) {
         while (state.sfml2_state.window.pollEvent(event)) {
@@ -295,6 +494,10 @@ Game::sUserInput() {
                 state.running= false;
             }
 
+            if (event.type == sf::Event::KeyPressed && event.key.code == sf::Keyboard::F9) {
+                dumpTrace();
+            }
+
             if (event.type == sf::Event::MouseButtonPressed) {
                 switch (event.mouseButton.button) {
                     case sf::Mouse::Left:
@@ -327,6 +530,7 @@ Game::sUserInput() {
 void
 Game::sGui() 
 {
+    CELLSIM_PROFILE_SCOPE("sGui");
     ImGui::Begin("Pixel Simulator");
 
     if (ImGui::TreeNode("Material selection")) {
@@ -437,5 +641,196 @@ Game::sGui()
         ImGui::Text("%d", state.persistent_state.scale);
         ImGui::TreePop();
     }
+
+    if (ImGui::TreeNode("World file")) {
+        const std::string & path = state.persistent_state.world_file;
+        ImGui::Text("%s", path.empty() ? "set worldFile in the config to save" : path.c_str());
+
+        bool saving = state.world_save.valid()
+            && state.world_save.wait_for(std::chrono::seconds(0)) != std::future_status::ready;
+        if (saving) {
+            ImGui::Text("Saving...");
+        } else if (!path.empty()) {
+            if (state.world_save.valid()) {
+                try {
+                    state.world_save.get();
+                } catch (const std::exception & e) {
+                    std::cerr << e.what() << "\n";
+                }
+            }
+            if (ImGui::Button("Save world")) {
+                // the snapshot is taken between two ticks, encoding and writing it happens here
+                std::future<world_file::WorldSnapshot> snapshot =
+                    state.simulation->call([](PixelGrid & grid) { return grid.snapshotWorld(); });
+                state.world_save = std::async(std::launch::async, [snapshot = std::move(snapshot), path]() mutable {
+                    world_file::write(snapshot.get(), path);
+                });
+            }
+            ImGui::SameLine();
+            // the window keeps its size, so only worlds of the current size are loaded
+            if (ImGui::Button("Load world")) {
+                try {
+                    world_file::MappedWorld world(path);
+                    if (world.header().width == static_cast<uint32_t>(state.persistent_state.pGrid_width)
+                        && world.header().height == static_cast<uint32_t>(state.persistent_state.pGrid_height)) {
+                        state.simulation->call([path](PixelGrid & grid) {
+                            try {
+                                grid.loadWorld(path);
+                            } catch (const std::exception & e) {
+                                std::cerr << e.what() << "\n";
+                            }
+                        });
+                    } else {
+                        std::cerr << path << " is not the size of the current world\n";
+                    }
+                } catch (const std::exception & e) {
+                    std::cerr << e.what() << "\n";
+                }
+            }
+        }
+        ImGui::TreePop();
+    }
+
+    if (ImGui::TreeNode("Recording")) {
+        SimulationThread & simulation = *state.simulation;
+        const std::string & path = state.persistent_state.action_log;
+        ImGui::Text("%s", path.c_str());
+        if (!simulation.isRecording() && ImGui::Button("Record actions")) {
+            simulation.call([path](PixelGrid & grid) {
+                try {
+                    grid.startRecording(path);
+                } catch (const std::exception & e) {
+                    std::cerr << e.what() << "\n";
+                }
+            });
+        } else if (simulation.isRecording() && ImGui::Button("Stop recording")) {
+            simulation.call([](PixelGrid & grid) { grid.stopRecording(); });
+        }
+        ImGui::TreePop();
+    }
+
+    ImGui::Text("Render: %.1f fps", state.render_rate);
+    ImGui::Text("Simulation: %.1f ticks/s", state.simulation->ticksPerSecond());
+    ImGui::Text("Texture upload: %.1f KB/frame", static_cast<double>(state.uploaded_bytes) / 1024.0);
+    ImGui::Text("Active chunks: %d / %d", state.simulation->activeChunkCount(), state.simulation->chunkCount());
+    if (!state.persistent_state.page_file.empty()) {
+        ChunkPager::Stats paging = state.simulation->pagingStats();
+        ImGui::Text("Paging: %llu in, %llu out, %.1f ms stalled",
+            static_cast<unsigned long long>(paging.pageIns), static_cast<unsigned long long>(paging.pageOuts),
+            static_cast<double>(paging.stallNs) / 1e6);
+    }
+
+    if (ImGui::TreeNode("Profiler")) {
+        drawProfiler();
+        ImGui::TreePop();
+    }
     ImGui::End();
 }
+
+void
+Game::dumpTrace()
+{
+    const LoadedConfig & config = state.persistent_state;
+    try {
+        profiler::writeChromeTrace(config.trace_file, config.trace_frames);
+        std::cout << "wrote the last " << config.trace_frames << " frames to " << config.trace_file << "\n";
+    } catch (const std::exception & e) {
+        std::cerr << e.what() << "\n";
+    }
+}
+
+void
+Game::drawProfiler()
+{
+    if (!profiler::compiledIn) {
+        ImGui::Text("Built without ENABLE_PROFILING");
+        return;
+    }
+    if (ImGui::Button("Write trace (F9)")) {
+        dumpTrace();
+    }
+
+    // the last start is the frame in progress, everything else is complete
+    constexpr size_t historyFrames = 120;
+    std::vector<uint64_t> starts = profiler::frameStarts(historyFrames + 1);
+    if (starts.size() < 3) {
+        return;
+    }
+    std::vector<float> frameMs;
+    for (size_t i = 1; i < starts.size(); i++) {
+        frameMs.push_back(static_cast<float>(starts[i] - starts[i - 1]) / 1e6f);
+    }
+    float worstMs = *std::max_element(frameMs.begin(), frameMs.end());
+    float budgetMs = 1000.0f / static_cast<float>(std::max(state.persistent_state.fps, 1));
+    std::string overlay = std::format("worst {:.1f} ms", worstMs);
+    ImGui::PlotHistogram("##frame times", frameMs.data(), static_cast<int>(frameMs.size()), 0, overlay.c_str(),
+        0.0f, std::max(worstMs, budgetMs), ImVec2(0.0f, 60.0f));
+
+    uint64_t historyBegin = starts.front();
+    uint64_t historyEnd = starts.back();
+    std::vector<profiler::ThreadEvents> threads = profiler::collect(historyBegin);
+
+    // time per frame of every scope over the history, and its longest run
+    struct Totals {
+        uint64_t totalNs = 0;
+        uint64_t maxNs = 0;
+    };
+    for (const profiler::ThreadEvents & thread : threads) {
+        std::map<std::string_view, Totals> scopes;
+        for (const profiler::Event & event : thread.events) {
+            if (event.startNs < historyBegin || event.startNs >= historyEnd) { continue; }
+            Totals & totals = scopes[event.name];
+            totals.totalNs += event.durationNs;
+            totals.maxNs = std::max(totals.maxNs, event.durationNs);
+        }
+        for (const auto & [name, totals] : scopes) {
+            ImGui::Text("%-10s %-16.*s %6.2f ms/frame  max %6.2f ms", thread.name.c_str(),
+                static_cast<int>(name.size()), name.data(),
+                static_cast<double>(totals.totalNs) / 1e6 / static_cast<double>(frameMs.size()),
+                static_cast<double>(totals.maxNs) / 1e6);
+        }
+    }
+
+    // flame chart of the last complete frame, a lane per thread, nested
+    // scopes below their parent
+    uint64_t frameBegin = starts[starts.size() - 2];
+    uint64_t frameEnd = starts.back();
+    double frameNs = static_cast<double>(frameEnd - frameBegin);
+    ImDrawList * drawList = ImGui::GetWindowDrawList();
+    ImVec2 origin = ImGui::GetCursorScreenPos();
+    float width = std::max(ImGui::GetContentRegionAvail().x, 100.0f);
+    constexpr float rowHeight = 18.0f;
+    float y = origin.y;
+    for (const profiler::ThreadEvents & thread : threads) {
+        bool labelled = false;
+        uint32_t deepest = 0;
+        for (const profiler::Event & event : thread.events) {
+            uint64_t eventEnd = event.startNs + event.durationNs;
+            if (eventEnd <= frameBegin || event.startNs >= frameEnd) { continue; }
+            if (!labelled) {
+                drawList->AddText(ImVec2(origin.x, y), IM_COL32(255, 255, 255, 255), thread.name.c_str());
+                y += rowHeight;
+                labelled = true;
+            }
+            deepest = std::max(deepest, event.depth);
+            auto toX = [&](uint64_t ns) {
+                uint64_t clamped = std::clamp(ns, frameBegin, frameEnd);
+                return origin.x + width * static_cast<float>(static_cast<double>(clamped - frameBegin) / frameNs);
+            };
+            ImVec2 min(toX(event.startNs), y + static_cast<float>(event.depth) * rowHeight);
+            ImVec2 max(std::max(toX(eventEnd), min.x + 1.0f), min.y + rowHeight - 1.0f);
+            size_t hash = std::hash<std::string_view>{}(event.name);
+            drawList->AddRectFilled(min, max, IM_COL32(80 + hash % 128, 80 + (hash >> 8) % 128, 80 + (hash >> 16) % 128, 255));
+            if (max.x - min.x > ImGui::CalcTextSize(event.name).x + 4.0f) {
+                drawList->AddText(ImVec2(min.x + 2.0f, min.y), IM_COL32(0, 0, 0, 255), event.name);
+            }
+            if (ImGui::IsMouseHoveringRect(min, max)) {
+                ImGui::SetTooltip("%s %.3f ms", event.name, static_cast<double>(event.durationNs) / 1e6);
+            }
+        }
+        if (labelled) {
+            y += static_cast<float>(deepest + 1) * rowHeight;
+        }
+    }
+    ImGui::Dummy(ImVec2(width, y - origin.y));
+}
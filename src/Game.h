@@ -1,3 +1,4 @@
+#include <SFML/Graphics.hpp>
 #include <SFML/Graphics/Font.hpp>
 #include <map>
 #include <variant>
@@ -88,6 +89,15 @@ class Game
     void init(LoadedConfig l_config);
     void sUserInput();
     void sRender();
+    // uploads the parts of frame that changed since the last frame uploaded
+    void uploadFrame(const SimulationFrame & frame);
+    // moves the grid's viewport to window_position and the current scale
+    void syncViewport();
+    // writes the last trace_frames frames of profiler timings to trace_file
+    void dumpTrace();
+    // frame time history, time per scope and a flame chart of the last frame
+    void drawProfiler();
+    Vec2i toSimulationPosition(Vec2i windowPixel);
     void update();
 
     void heldButtons();
@@ -103,6 +113,8 @@ class Game
 
     void tryIgnite();
     void initializeSFML2(LoadedConfig & l_config);
+    // switches to GlRenderer, keeps the SFML sprite when the context cannot run it
+    void initializeOpenGL();
 
     LoadedConfig load_config(std::string filePath);
 
@@ -0,0 +1,351 @@
+#include "GlRenderer.hpp"
+#include <GL/glcorearb.h>
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include <vector>
+
+// the entry points the renderer uses, loaded by name through the ProcLoader
+#define CELLSIM_GL_FUNCTIONS(X) \
+    X(PFNGLGETSTRINGPROC,               GetString)               \
+    X(PFNGLGETINTEGERVPROC,             GetIntegerv)             \
+    X(PFNGLGETSTRINGIPROC,              GetStringi)              \
+    X(PFNGLGENTEXTURESPROC,             GenTextures)             \
+    X(PFNGLDELETETEXTURESPROC,          DeleteTextures)          \
+    X(PFNGLBINDTEXTUREPROC,             BindTexture)             \
+    X(PFNGLACTIVETEXTUREPROC,           ActiveTexture)           \
+    X(PFNGLTEXPARAMETERIPROC,           TexParameteri)           \
+    X(PFNGLTEXIMAGE2DPROC,              TexImage2D)              \
+    X(PFNGLTEXSUBIMAGE2DPROC,           TexSubImage2D)           \
+    X(PFNGLPIXELSTOREIPROC,             PixelStorei)             \
+    X(PFNGLGENBUFFERSPROC,              GenBuffers)              \
+    X(PFNGLDELETEBUFFERSPROC,           DeleteBuffers)           \
+    X(PFNGLBINDBUFFERPROC,              BindBuffer)              \
+    X(PFNGLBUFFERDATAPROC,              BufferData)              \
+    X(PFNGLMAPBUFFERRANGEPROC,          MapBufferRange)          \
+    X(PFNGLUNMAPBUFFERPROC,             UnmapBuffer)             \
+    X(PFNGLFENCESYNCPROC,               FenceSync)               \
+    X(PFNGLCLIENTWAITSYNCPROC,          ClientWaitSync)          \
+    X(PFNGLDELETESYNCPROC,              DeleteSync)              \
+    X(PFNGLCREATESHADERPROC,            CreateShader)            \
+    X(PFNGLSHADERSOURCEPROC,            ShaderSource)            \
+    X(PFNGLCOMPILESHADERPROC,           CompileShader)           \
+    X(PFNGLGETSHADERIVPROC,             GetShaderiv)             \
+    X(PFNGLGETSHADERINFOLOGPROC,        GetShaderInfoLog)        \
+    X(PFNGLDELETESHADERPROC,            DeleteShader)            \
+    X(PFNGLCREATEPROGRAMPROC,           CreateProgram)           \
+    X(PFNGLATTACHSHADERPROC,            AttachShader)            \
+    X(PFNGLLINKPROGRAMPROC,             LinkProgram)             \
+    X(PFNGLGETPROGRAMIVPROC,            GetProgramiv)            \
+    X(PFNGLGETPROGRAMINFOLOGPROC,       GetProgramInfoLog)       \
+    X(PFNGLDELETEPROGRAMPROC,           DeleteProgram)           \
+    X(PFNGLUSEPROGRAMPROC,              UseProgram)              \
+    X(PFNGLGETUNIFORMLOCATIONPROC,      GetUniformLocation)      \
+    X(PFNGLUNIFORM1IPROC,               Uniform1i)               \
+    X(PFNGLUNIFORM2IPROC,               Uniform2i)               \
+    X(PFNGLGENVERTEXARRAYSPROC,         GenVertexArrays)         \
+    X(PFNGLDELETEVERTEXARRAYSPROC,      DeleteVertexArrays)      \
+    X(PFNGLBINDVERTEXARRAYPROC,         BindVertexArray)         \
+    X(PFNGLDRAWARRAYSPROC,              DrawArrays)              \
+    X(PFNGLVIEWPORTPROC,                Viewport)                \
+    X(PFNGLDISABLEPROC,                 Disable)
+
+struct GlRenderer::Functions {
+#define CELLSIM_GL_MEMBER(type, name) type name = nullptr;
+    CELLSIM_GL_FUNCTIONS(CELLSIM_GL_MEMBER)
+#undef CELLSIM_GL_MEMBER
+    // GL 4.4 or ARB_buffer_storage, null without either
+    PFNGLBUFFERSTORAGEPROC BufferStorage = nullptr;
+};
+
+namespace {
+
+const char* vertexShaderSource = R"glsl(
+#version 330 core
+
+uniform ivec2 size;
+out vec2 cellPosition;
+
+// one triangle that covers the viewport, no vertex buffer needed
+void main() {
+    vec2 corner = vec2(float((gl_VertexID << 1) & 2), float(gl_VertexID & 2));
+    gl_Position = vec4(corner * 2.0 - 1.0, 0.0, 1.0);
+    // row 0 of the frame is the top of the view, GL counts from the bottom
+    cellPosition = vec2(corner.x, 1.0 - corner.y) * vec2(size);
+}
+)glsl";
+
+const char* fragmentShaderSource = R"glsl(
+#version 330 core
+
+uniform usampler2D cells;
+// 128 x 2 RGBA, the second row holds the colours of burning cells
+uniform sampler2D palette;
+uniform ivec2 size;
+in vec2 cellPosition;
+out vec4 colour;
+
+void main() {
+    ivec2 cell = clamp(ivec2(cellPosition), ivec2(0), size - 1);
+    uint code = texelFetch(cells, cell, 0).r;
+    vec4 c = texelFetch(palette, ivec2(int(code & 127u), int(code >> 7)), 0);
+    // what SFML draws for the RGBA frame, blended over the black clear colour
+    colour = vec4(c.rgb * c.a, 1.0);
+}
+)glsl";
+
+GLuint compileShader(const auto & gl, GLenum type, const char* source) {
+    GLuint shader = gl.CreateShader(type);
+    gl.ShaderSource(shader, 1, &source, nullptr);
+    gl.CompileShader(shader);
+    GLint ok = 0;
+    gl.GetShaderiv(shader, GL_COMPILE_STATUS, &ok);
+    if (!ok) {
+        char log[1024] = {};
+        gl.GetShaderInfoLog(shader, sizeof(log), nullptr, log);
+        gl.DeleteShader(shader);
+        throw std::runtime_error(std::string("GlRenderer: shader does not compile: ") + log);
+    }
+    return shader;
+}
+}
+
+GlRenderer::GlRenderer(const ProcLoader & load)
+  : m_gl(std::make_unique<Functions>())
+{
+    Functions & gl = *m_gl;
+#define CELLSIM_GL_LOAD(type, name) \
+    gl.name = reinterpret_cast<type>(load("gl" #name)); \
+    if (!gl.name) { throw std::runtime_error("GlRenderer: the context lacks gl" #name); }
+    CELLSIM_GL_FUNCTIONS(CELLSIM_GL_LOAD)
+#undef CELLSIM_GL_LOAD
+
+    GLint major = 0;
+    GLint minor = 0;
+    gl.GetIntegerv(GL_MAJOR_VERSION, &major);
+    gl.GetIntegerv(GL_MINOR_VERSION, &minor);
+    if (major < 3 || (major == 3 && minor < 3)) {
+        throw std::runtime_error("GlRenderer: needs OpenGL 3.3");
+    }
+    bool bufferStorage = major > 4 || (major == 4 && minor >= 4);
+    GLint extensionCount = 0;
+    gl.GetIntegerv(GL_NUM_EXTENSIONS, &extensionCount);
+    for (GLint i = 0; i < extensionCount && !bufferStorage; i++) {
+        const char* name = reinterpret_cast<const char*>(gl.GetStringi(GL_EXTENSIONS, static_cast<GLuint>(i)));
+        bufferStorage = name && std::strcmp(name, "GL_ARB_buffer_storage") == 0;
+    }
+    if (bufferStorage) {
+        gl.BufferStorage = reinterpret_cast<PFNGLBUFFERSTORAGEPROC>(load("glBufferStorage"));
+    }
+    m_persistent = gl.BufferStorage != nullptr;
+
+    GLuint vertexShader = compileShader(gl, GL_VERTEX_SHADER, vertexShaderSource);
+    GLuint fragmentShader = compileShader(gl, GL_FRAGMENT_SHADER, fragmentShaderSource);
+    m_program = gl.CreateProgram();
+    gl.AttachShader(m_program, vertexShader);
+    gl.AttachShader(m_program, fragmentShader);
+    gl.LinkProgram(m_program);
+    gl.DeleteShader(vertexShader);
+    gl.DeleteShader(fragmentShader);
+    GLint linked = 0;
+    gl.GetProgramiv(m_program, GL_LINK_STATUS, &linked);
+    if (!linked) {
+        char log[1024] = {};
+        gl.GetProgramInfoLog(m_program, sizeof(log), nullptr, log);
+        gl.DeleteProgram(m_program);
+        throw std::runtime_error(std::string("GlRenderer: shaders do not link: ") + log);
+    }
+    m_cellsLocation = gl.GetUniformLocation(m_program, "cells");
+    m_paletteLocation = gl.GetUniformLocation(m_program, "palette");
+    m_sizeLocation = gl.GetUniformLocation(m_program, "size");
+
+    gl.GenVertexArrays(1, &m_vertexArray);
+
+    // integer and palette textures are read with texelFetch, never filtered
+    auto makeTexture = [&](GLuint & texture) {
+        gl.GenTextures(1, &texture);
+        gl.BindTexture(GL_TEXTURE_2D, texture);
+        gl.TexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        gl.TexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        gl.TexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        gl.TexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    };
+    makeTexture(m_cellTexture);
+    makeTexture(m_paletteTexture);
+    gl.BindTexture(GL_TEXTURE_2D, 0);
+}
+
+GlRenderer::~GlRenderer() {
+    Functions & gl = *m_gl;
+    releaseUploadBuffers();
+    gl.DeleteTextures(1, &m_cellTexture);
+    gl.DeleteTextures(1, &m_paletteTexture);
+    gl.DeleteVertexArrays(1, &m_vertexArray);
+    gl.DeleteProgram(m_program);
+}
+
+void GlRenderer::setPalette(const colorize::Palette & palette) {
+    Functions & gl = *m_gl;
+    // cell codes reach 127, the two halves of the palette become two rows
+    std::array<uint32_t, 2 * colorize::cellCodeFireBit> rows{};
+    std::copy_n(palette.begin(), colorize::cellCodeFireBit, rows.begin());
+    std::copy_n(palette.begin() + colorize::fireOffset, colorize::cellCodeFireBit, rows.begin() + colorize::cellCodeFireBit);
+
+    gl.BindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    gl.PixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    gl.PixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+    gl.BindTexture(GL_TEXTURE_2D, m_paletteTexture);
+    gl.TexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, colorize::cellCodeFireBit, 2, 0, GL_RGBA, GL_UNSIGNED_BYTE, rows.data());
+    gl.BindTexture(GL_TEXTURE_2D, 0);
+}
+
+void GlRenderer::releaseUploadBuffers() {
+    Functions & gl = *m_gl;
+    for (UploadBuffer & upload : m_uploads) {
+        if (upload.fence) {
+            gl.DeleteSync(static_cast<GLsync>(upload.fence));
+        }
+        if (upload.mapped) {
+            gl.BindBuffer(GL_PIXEL_UNPACK_BUFFER, upload.buffer);
+            gl.UnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+        }
+        if (upload.buffer) {
+            gl.DeleteBuffers(1, &upload.buffer);
+        }
+        upload = UploadBuffer{};
+    }
+    gl.BindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    m_uploadCapacity = 0;
+}
+
+void GlRenderer::resize(int width, int height) {
+    Functions & gl = *m_gl;
+    m_width = width;
+    m_height = height;
+
+    gl.BindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    gl.BindTexture(GL_TEXTURE_2D, m_cellTexture);
+    gl.TexImage2D(GL_TEXTURE_2D, 0, GL_R8UI, width, height, 0, GL_RED_INTEGER, GL_UNSIGNED_BYTE, nullptr);
+    gl.BindTexture(GL_TEXTURE_2D, 0);
+
+    releaseUploadBuffers();
+    m_uploadCapacity = static_cast<size_t>(width) * static_cast<size_t>(height);
+    for (UploadBuffer & upload : m_uploads) {
+        gl.GenBuffers(1, &upload.buffer);
+        gl.BindBuffer(GL_PIXEL_UNPACK_BUFFER, upload.buffer);
+        if (m_persistent) {
+            GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+            gl.BufferStorage(GL_PIXEL_UNPACK_BUFFER, static_cast<GLsizeiptr>(m_uploadCapacity), nullptr, flags);
+            upload.mapped = static_cast<uint8_t*>(
+                gl.MapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, static_cast<GLsizeiptr>(m_uploadCapacity), flags));
+            if (!upload.mapped) {
+                throw std::runtime_error("GlRenderer: cannot map an upload buffer");
+            }
+        } else {
+            gl.BufferData(GL_PIXEL_UNPACK_BUFFER, static_cast<GLsizeiptr>(m_uploadCapacity), nullptr, GL_STREAM_DRAW);
+        }
+    }
+    gl.BindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+}
+
+void GlRenderer::waitFor(UploadBuffer & upload) {
+    if (!upload.fence) { return; }
+    Functions & gl = *m_gl;
+    GLsync fence = static_cast<GLsync>(upload.fence);
+    // the other buffer was filled in between, so this is nearly always done
+    while (gl.ClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1'000'000'000) == GL_TIMEOUT_EXPIRED) {}
+    gl.DeleteSync(fence);
+    upload.fence = nullptr;
+}
+
+size_t GlRenderer::upload(std::span<const uint8_t> cells, int width, int height,
+                          std::span<const DirtyRect> changed, bool full) {
+    Functions & gl = *m_gl;
+    if (width <= 0 || height <= 0 || cells.size() < static_cast<size_t>(width) * static_cast<size_t>(height)) {
+        return 0;
+    }
+    if (width != m_width || height != m_height) {
+        resize(width, height);
+        full = true;
+    }
+
+    // the rects to send, the whole frame as one rect when full
+    std::vector<DirtyRect> rects;
+    if (full) {
+        rects.push_back(DirtyRect{0, 0, width - 1, height - 1});
+    } else {
+        for (const DirtyRect & band : changed) {
+            if (!band.empty()) { rects.push_back(band); }
+        }
+    }
+    if (rects.empty()) { return 0; }
+
+    UploadBuffer & upload = m_uploads[m_nextUpload];
+    m_nextUpload = (m_nextUpload + 1) % m_uploads.size();
+    waitFor(upload);
+
+    gl.BindBuffer(GL_PIXEL_UNPACK_BUFFER, upload.buffer);
+    uint8_t* staging = upload.mapped;
+    if (!m_persistent) {
+        // orphaning lets the driver hand out fresh memory instead of waiting
+        staging = static_cast<uint8_t*>(gl.MapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, static_cast<GLsizeiptr>(m_uploadCapacity),
+            GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT | GL_MAP_UNSYNCHRONIZED_BIT));
+        if (!staging) {
+            gl.BindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+            return 0;
+        }
+    }
+
+    // rects are packed one after another, each tightly
+    size_t offset = 0;
+    for (const DirtyRect & rect : rects) {
+        size_t rectWidth = static_cast<size_t>(rect.maxX - rect.minX + 1);
+        for (int y = rect.minY; y <= rect.maxY; y++) {
+            std::memcpy(staging + offset, cells.data() + static_cast<size_t>(y) * static_cast<size_t>(width) + static_cast<size_t>(rect.minX), rectWidth);
+            offset += rectWidth;
+        }
+    }
+    if (!m_persistent) {
+        gl.UnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+    }
+
+    gl.PixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    gl.PixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+    gl.BindTexture(GL_TEXTURE_2D, m_cellTexture);
+    offset = 0;
+    for (const DirtyRect & rect : rects) {
+        GLsizei rectWidth = rect.maxX - rect.minX + 1;
+        GLsizei rectHeight = rect.maxY - rect.minY + 1;
+        gl.TexSubImage2D(GL_TEXTURE_2D, 0, rect.minX, rect.minY, rectWidth, rectHeight, GL_RED_INTEGER, GL_UNSIGNED_BYTE,
+            reinterpret_cast<const void*>(offset));
+        offset += static_cast<size_t>(rectWidth) * static_cast<size_t>(rectHeight);
+    }
+    gl.BindTexture(GL_TEXTURE_2D, 0);
+    gl.BindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    upload.fence = gl.FenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    return offset;
+}
+
+void GlRenderer::draw(int x, int y, int width, int height) {
+    if (m_width == 0) { return; }
+    Functions & gl = *m_gl;
+    gl.Viewport(x, y, width, height);
+    gl.Disable(GL_BLEND);
+    gl.Disable(GL_DEPTH_TEST);
+    gl.Disable(GL_SCISSOR_TEST);
+    gl.UseProgram(m_program);
+    gl.ActiveTexture(GL_TEXTURE0);
+    gl.BindTexture(GL_TEXTURE_2D, m_cellTexture);
+    gl.ActiveTexture(GL_TEXTURE1);
+    gl.BindTexture(GL_TEXTURE_2D, m_paletteTexture);
+    gl.Uniform1i(m_cellsLocation, 0);
+    gl.Uniform1i(m_paletteLocation, 1);
+    gl.Uniform2i(m_sizeLocation, m_width, m_height);
+    gl.BindVertexArray(m_vertexArray);
+    gl.DrawArrays(GL_TRIANGLES, 0, 3);
+    gl.BindVertexArray(0);
+    gl.BindTexture(GL_TEXTURE_2D, 0);
+    gl.ActiveTexture(GL_TEXTURE0);
+    gl.BindTexture(GL_TEXTURE_2D, 0);
+    gl.UseProgram(0);
+}
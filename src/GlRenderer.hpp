@@ -0,0 +1,105 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <span>
+#include <string>
+#include "ChunkGrid.hpp"
+#include "Colorize.hpp"
+
+// OpenGL backend for Game. The simulation hands over one cell code per
+// cell (see colorize::DrawFormat::cellCodes), which is uploaded as an R8UI
+// texture and coloured by the fragment shader from the palette, held in a
+// second texture. The CPU never touches a colour and a frame is a quarter
+// of the bytes of an RGBA one.
+//
+// Uploads go through two persistently mapped pixel buffers used in turn,
+// the frame is copied into one while the GPU may still read from the other
+// and a fence keeps us from writing a buffer it has not finished with.
+// Contexts without GL 4.4 or ARB_buffer_storage map and unmap the buffers
+// every frame instead.
+//
+// GL functions are looked up through the loader given to the constructor,
+// so it works with any context: SFML's window or a surfaceless EGL context
+// in tests/gl_renderer_test.cpp. Everything needs that context current.
+
+class GlRenderer
+{
+  public:
+    using GlProc = void (*)();
+    using ProcLoader = std::function<GlProc(const char*)>;
+
+  private:
+    struct Functions;
+    std::unique_ptr<Functions> m_gl;
+
+    unsigned m_program = 0;
+    unsigned m_vertexArray = 0;
+    unsigned m_cellTexture = 0;
+    unsigned m_paletteTexture = 0;
+    int m_cellsLocation = -1;
+    int m_paletteLocation = -1;
+    int m_sizeLocation = -1;
+
+    int m_width = 0;
+    int m_height = 0;
+
+    struct UploadBuffer {
+        unsigned buffer = 0;
+        uint8_t* mapped = nullptr; // persistent mapping, null without buffer storage
+        void* fence = nullptr;     // GLsync of the last upload from this buffer
+    };
+    std::array<UploadBuffer, 2> m_uploads{};
+    size_t m_nextUpload = 0;
+    size_t m_uploadCapacity = 0;
+    bool m_persistent = false;
+
+    // texture and upload buffers for a width x height frame
+    void resize(int width, int height);
+
+    void releaseUploadBuffers();
+
+    // waits until the GPU has finished reading buffer
+    void waitFor(UploadBuffer & buffer);
+
+  public:
+    // compiles the shaders, throws std::runtime_error when the context is
+    // older than GL 3.3 or a shader does not build
+    explicit GlRenderer(const ProcLoader & load);
+
+    ~GlRenderer();
+
+    GlRenderer(const GlRenderer&) = delete;
+    GlRenderer& operator=(const GlRenderer&) = delete;
+
+    void setPalette(const colorize::Palette & palette);
+
+    // Sends a width x height frame of cell codes, row major. Only the rects
+    // in changed are sent (one per band of rows, as SimulationFrame has
+    // them) unless full is set or the size differs from the last frame.
+    // Returns the bytes that went to the GPU.
+    size_t upload(std::span<const uint8_t> cells, int width, int height,
+                  std::span<const DirtyRect> changed, bool full);
+
+    // Draws the last frame stretched over (x, y, width, height) of the
+    // bound framebuffer, y counts from the bottom as in glViewport. Colours
+    // are those SFML shows for the RGBA frame: the palette colour blended
+    // over black by its alpha.
+    void draw(int x, int y, int width, int height);
+
+    // size of the last frame uploaded
+    int getWidth() const {
+        return m_width;
+    }
+
+    int getHeight() const {
+        return m_height;
+    }
+
+    bool usesPersistentMapping() const {
+        return m_persistent;
+    }
+};
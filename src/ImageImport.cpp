@@ -0,0 +1,169 @@
+#include "ImageImport.hpp"
+#include "Materials.h"
+#include <algorithm>
+#include <cctype>
+#include <fstream>
+#include <iterator>
+#include <limits>
+#include <stdexcept>
+
+#ifdef CELLSIM_PNG_IMPORT
+#include <png.h>
+#endif
+
+namespace image_import {
+
+namespace {
+
+// the next whitespace separated header field, comments run to the end of the line
+int readPpmField(std::istream & in, const std::string & path) {
+    while (true) {
+        int c = in.peek();
+        if (c == '#') {
+            in.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
+        } else if (std::isspace(c)) {
+            in.get();
+        } else {
+            break;
+        }
+    }
+    int value = -1;
+    if (!(in >> value) || value < 0) {
+        throw std::runtime_error("image_import: " + path + ": bad PPM header");
+    }
+    return value;
+}
+}
+
+Image readPpm(const std::string & path) {
+    std::ifstream in(path, std::ios::binary);
+    if (!in) {
+        throw std::runtime_error("image_import: cannot open " + path);
+    }
+    char magic[2] = {};
+    in.read(magic, 2);
+    if (magic[0] != 'P' || (magic[1] != '3' && magic[1] != '6')) {
+        throw std::runtime_error("image_import: " + path + " is not a P3 or P6 PPM");
+    }
+    bool binary = magic[1] == '6';
+
+    Image image;
+    image.width = readPpmField(in, path);
+    image.height = readPpmField(in, path);
+    int maxValue = readPpmField(in, path);
+    if (image.width == 0 || image.height == 0 || maxValue == 0 || maxValue > 255) {
+        throw std::runtime_error("image_import: " + path + ": only 8 bit PPMs of at least one pixel are read");
+    }
+    size_t pixelCount = static_cast<size_t>(image.width) * static_cast<size_t>(image.height);
+    image.rgba.resize(pixelCount * 4);
+
+    auto scale = [maxValue](int value) {
+        return static_cast<uint8_t>(std::min(value, maxValue) * 255 / maxValue);
+    };
+    if (binary) {
+        // a single whitespace byte ends the header
+        in.get();
+        std::vector<uint8_t> rgb(pixelCount * 3);
+        if (!in.read(reinterpret_cast<char *>(rgb.data()), static_cast<std::streamsize>(rgb.size()))) {
+            throw std::runtime_error("image_import: " + path + " is cut short");
+        }
+        for (size_t i = 0; i < pixelCount; i++) {
+            image.rgba[4 * i + 0] = scale(rgb[3 * i + 0]);
+            image.rgba[4 * i + 1] = scale(rgb[3 * i + 1]);
+            image.rgba[4 * i + 2] = scale(rgb[3 * i + 2]);
+            image.rgba[4 * i + 3] = 255;
+        }
+    } else {
+        for (size_t i = 0; i < pixelCount; i++) {
+            for (size_t channel = 0; channel < 3; channel++) {
+                image.rgba[4 * i + channel] = scale(readPpmField(in, path));
+            }
+            image.rgba[4 * i + 3] = 255;
+        }
+    }
+    return image;
+}
+
+bool hasPng() {
+#ifdef CELLSIM_PNG_IMPORT
+    return true;
+#else
+    return false;
+#endif
+}
+
+Image readPng(const std::string & path) {
+#ifdef CELLSIM_PNG_IMPORT
+    png_image png{};
+    png.version = PNG_IMAGE_VERSION;
+    if (!png_image_begin_read_from_file(&png, path.c_str())) {
+        throw std::runtime_error("image_import: " + path + ": " + png.message);
+    }
+    png.format = PNG_FORMAT_RGBA;
+
+    Image image;
+    image.width = static_cast<int>(png.width);
+    image.height = static_cast<int>(png.height);
+    image.rgba.resize(PNG_IMAGE_SIZE(png));
+    if (!png_image_finish_read(&png, nullptr, image.rgba.data(), 0, nullptr)) {
+        std::string message = png.message;
+        png_image_free(&png);
+        throw std::runtime_error("image_import: " + path + ": " + message);
+    }
+    return image;
+#else
+    throw std::runtime_error("image_import: " + path + ": built without libpng, cannot read PNG");
+#endif
+}
+
+Image read(const std::string & path) {
+    std::ifstream in(path, std::ios::binary);
+    if (!in) {
+        throw std::runtime_error("image_import: cannot open " + path);
+    }
+    unsigned char start[8] = {};
+    in.read(reinterpret_cast<char *>(start), sizeof(start));
+    const unsigned char pngSignature[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n'};
+    if (std::equal(std::begin(pngSignature), std::end(pngSignature), start)) {
+        return readPng(path);
+    }
+    return readPpm(path);
+}
+
+uint8_t nearestMaterial(uint8_t r, uint8_t g, uint8_t b, uint8_t a) {
+    if (a < 128) { return materials::air; }
+    uint8_t nearest = materials::air;
+    int nearestDistance = std::numeric_limits<int>::max();
+    for (int material = 0; material < materials::NumMaterials; material++) {
+        const uint8_t * colour = &materials::m_materialToColor_c[material * 4];
+        int dr = r - colour[0];
+        int dg = g - colour[1];
+        int db = b - colour[2];
+        int distance = dr * dr + dg * dg + db * db;
+        if (distance < nearestDistance) {
+            nearest = static_cast<uint8_t>(material);
+            nearestDistance = distance;
+        }
+    }
+    return nearest;
+}
+
+Prefab toPrefab(const Image & image) {
+    Prefab prefab(image.width, image.height);
+    // images are mostly runs of one colour, only a new colour is looked up
+    uint32_t lastColour = 0;
+    uint8_t lastMaterial = nearestMaterial(0, 0, 0, 0);
+    for (size_t i = 0; i < prefab.material.size(); i++) {
+        const uint8_t * pixel = &image.rgba[4 * i];
+        uint32_t colour = static_cast<uint32_t>(pixel[0]) | static_cast<uint32_t>(pixel[1]) << 8
+                        | static_cast<uint32_t>(pixel[2]) << 16 | static_cast<uint32_t>(pixel[3]) << 24;
+        if (colour != lastColour) {
+            lastColour = colour;
+            lastMaterial = nearestMaterial(pixel[0], pixel[1], pixel[2], pixel[3]);
+        }
+        prefab.material[i] = lastMaterial;
+        prefab.properties[i] = pixel_properties::DefaultMaterialProperties[lastMaterial];
+    }
+    return prefab;
+}
+}
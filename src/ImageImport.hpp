@@ -0,0 +1,35 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "Prefab.hpp"
+
+// Images turned into worlds. Every pixel becomes the material whose colour
+// in materials::m_materialToColor_c is nearest, pixels less than half
+// opaque become air. PPM (P3 and P6, 8 bit) is always read, PNG only when
+// the core was built with libpng (CELLSIM_PNG_IMPORT, see CMakeLists.txt).
+
+namespace image_import {
+
+struct Image {
+    int width = 0;
+    int height = 0;
+    std::vector<uint8_t> rgba; // row major, 4 bytes a pixel
+};
+
+// the file's format is told by its first bytes, throws std::runtime_error
+// when the file is missing, corrupt or a PNG without libpng
+Image read(const std::string & path);
+
+Image readPpm(const std::string & path);
+
+Image readPng(const std::string & path);
+
+bool hasPng();
+
+uint8_t nearestMaterial(uint8_t r, uint8_t g, uint8_t b, uint8_t a = 255);
+
+// every cell gets the default properties of its material
+Prefab toPrefab(const Image & image);
+}
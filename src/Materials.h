@@ -1,6 +1,6 @@
 #pragma once
+#include <cstddef>
 #include <cstdint>
-#include <map>
 #include <sys/types.h>
 #include <utility>
 
@@ -190,6 +190,38 @@ constexpr MaterialProperties materialLookup[materials::NumMaterials] = {
     // obsidian 
     { static_cast<PixelFlags>( IsSolid | CanMelt ), 2400, 1470, nullBurnProperties }
 };
+
+// How a material moves during the physics step. The physics kernels are
+// specialised on this, see PixelGrid::physicsKernel
+enum class MaterialClass : uint8_t {
+    none,   // air, never simulated
+    liquid,
+    powder,
+    solid,
+    gas,
+};
+
+// the flag tests are made in the order doPhysicsOnPixel used to make them,
+// a falling liquid wins over anything else it might also be
+constexpr MaterialClass materialClass(uint8_t material) {
+    uint32_t flags = materialLookup[material].flags;
+    auto has = [flags](uint32_t mask) { return (flags & mask) == mask; };
+
+    if (material == materials::air)  { return MaterialClass::none; }
+    if (has(fallingLiquid))          { return MaterialClass::liquid; }
+    if (has(fallingPowder))          { return MaterialClass::powder; }
+    if (has(IsSolid))                { return MaterialClass::solid; }
+    if (has(IsGas))                  { return MaterialClass::gas; }
+    return MaterialClass::none;
+}
+
+constexpr bool everyMaterialHasClass() {
+    for (int material = 1; material < materials::NumMaterials; material++) {
+        if (materialClass(static_cast<uint8_t>(material)) == MaterialClass::none) { return false; }
+    }
+    return true;
+}
+static_assert(everyMaterialHasClass(), "every material except air needs a physics class");
 }
 
 namespace material_reactions {
@@ -197,24 +229,78 @@ struct material_property_pair {
     uint8_t material;
     uint8_t properties;
 };
-// material 1 is on fire and is adjacent to material 2
-inline std::map<std::pair<uint8_t, uint8_t>, std::pair<material_property_pair, material_property_pair>> on_fire_reactions {
-        {   
-            {materials::oil, materials::water}, 
-            {{materials::air, pixel_properties::None}, {materials::steam, pixel_properties::None}}
-        },
-
-        {   
-            {materials::wood, materials::water}, 
-            {{materials::ash, pixel_properties::None}, {materials::steam, pixel_properties::None}}
-        },
-        {   
-            {materials::coal, materials::water}, 
-            {{materials::coal, pixel_properties::None}, {materials::steam, pixel_properties::None}}
-        },
-        {
-            {materials::lava, materials::water},
-            {{materials::obsidian, pixel_properties::None}, {materials::steam, pixel_properties::None}}
+
+// What has to be true of a pixel before its reactions with its neighbours
+// are looked for. onFire reactions are tried by every burning pixel, a new
+// trigger (acid that always reacts, water that freezes next to ice, ...) is
+// a new entry here plus the place in the physics that tries it.
+enum class Trigger : uint8_t {
+    onFire,
+    count,
+};
+
+// `material` next to `neighbour` turns into `becomes`, the neighbour into `neighbourBecomes`
+struct Reaction {
+    Trigger                trigger;
+    uint8_t                material;
+    uint8_t                neighbour;
+    material_property_pair becomes;
+    material_property_pair neighbourBecomes;
+};
+
+// every reaction in the game, declared once
+constexpr Reaction reactions[] = {
+    {Trigger::onFire, materials::oil,  materials::water, {materials::air,      pixel_properties::None}, {materials::steam, pixel_properties::None}},
+    {Trigger::onFire, materials::wood, materials::water, {materials::ash,      pixel_properties::None}, {materials::steam, pixel_properties::None}},
+    {Trigger::onFire, materials::coal, materials::water, {materials::coal,     pixel_properties::None}, {materials::steam, pixel_properties::None}},
+    {Trigger::onFire, materials::lava, materials::water, {materials::obsidian, pixel_properties::None}, {materials::steam, pixel_properties::None}},
+};
+
+constexpr size_t reactionCount = sizeof(reactions) / sizeof(reactions[0]);
+constexpr uint8_t noReaction = 0xff;
+static_assert(reactionCount < noReaction, "reaction ids are stored in a byte");
+
+constexpr size_t triggerCount = static_cast<size_t>(Trigger::count);
+
+// reactions compiled into dense per trigger tables, built at compile time
+struct ReactionTable {
+    // index into reactions, or noReaction
+    uint8_t id[triggerCount][materials::NumMaterials][materials::NumMaterials];
+    // bit t set when the material has any reaction for trigger t, so
+    // materials that never react skip reading their neighbours
+    uint8_t triggers[materials::NumMaterials];
+
+    constexpr bool reacts(Trigger trigger, uint8_t material) const {
+        return (triggers[material] >> static_cast<int>(trigger)) & 1;
+    }
+
+    constexpr uint8_t lookup(Trigger trigger, uint8_t material, uint8_t neighbour) const {
+        return id[static_cast<size_t>(trigger)][material][neighbour];
+    }
+};
+static_assert(triggerCount <= 8, "ReactionTable::triggers holds one bit per trigger");
+
+constexpr ReactionTable compileReactions() {
+    ReactionTable table{};
+    for (auto& perTrigger : table.id) {
+        for (auto& row : perTrigger) {
+            for (uint8_t& entry : row) { entry = noReaction; }
+        }
+    }
+    for (size_t i = 0; i < reactionCount; i++) {
+        const Reaction& r = reactions[i];
+        uint8_t& entry = table.id[static_cast<size_t>(r.trigger)][r.material][r.neighbour];
+        // the first declaration of a pair wins, as it would in a lookup by list order
+        if (entry == noReaction) {
+            entry = static_cast<uint8_t>(i);
         }
-    };
+        table.triggers[r.material] |= static_cast<uint8_t>(1 << static_cast<int>(r.trigger));
+    }
+    return table;
+}
+
+constexpr ReactionTable reactionTable = compileReactions();
+
+static_assert(reactionTable.lookup(Trigger::onFire, materials::lava, materials::water) == 3);
+static_assert(!reactionTable.reacts(Trigger::onFire, materials::sand));
 }
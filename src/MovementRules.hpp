@@ -0,0 +1,145 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include "Materials.h"
+#include "Vec2.hpp"
+
+// The movement rules of powders and liquids written once, as functions of
+// which neighbours are open. PixelGrid's branching rules call them with
+// probes of the grid, and the neighbourhood tables below are built from them
+// at compile time, so the two cannot drift apart.
+//
+// Every neighbour a rule looks at only matters as one bit. For the powder
+// rule that is whether the mover may swap into it (gas, or a liquid it is
+// denser than), for the sideways flow of a liquid whether it is gas. Those
+// bits and the liquid's random bit make the signature of a neighbourhood,
+// and the tables map every signature to the move it makes.
+
+namespace movement_rules {
+
+enum Move : uint8_t {
+    stay,
+    down,
+    downRight,
+    downLeft,
+    right,
+    left,
+    right2,
+    left2,
+    moveCount,
+};
+
+constexpr std::array<Vec2i, moveCount> moveDelta = {
+    Vec2i(0,0),
+    Vec2i(0,1), Vec2i(1,1), Vec2i(-1,1),
+    Vec2i(1,0), Vec2i(-1,0),
+    Vec2i(2,0), Vec2i(-2,0)
+};
+
+// straight down, else down a side that is open beside and below
+template<typename Open>
+constexpr Move powder(Open open) {
+    if (open(down)) { return down; }
+    if (open(right) && open(downRight)) { return downRight; }
+    if (open(left) && open(downLeft)) { return downLeft; }
+    return stay;
+}
+
+// sideways into gas, two cells where the way is clear for both, and the
+// preferred side when both sides are as clear as each other
+template<typename Gas>
+constexpr Move flow(Gas gas, bool preferLeft) {
+    bool rightClear = gas(right);
+    bool leftClear = gas(left);
+    bool right2Clear = gas(right2);
+    bool left2Clear = gas(left2);
+
+    if (rightClear && leftClear) {
+        if (right2Clear != left2Clear) {
+            return right2Clear ? right2 : left2;
+        }
+        return preferLeft ? left : right;
+    } else if (rightClear) {
+        return right2Clear ? right2 : right;
+    } else if (leftClear) {
+        return left2Clear ? left2 : left;
+    }
+    return stay;
+}
+
+// a liquid flows only when it cannot fall or slide
+template<typename Open, typename Gas>
+constexpr Move liquid(Open open, Gas gas, bool preferLeft) {
+    Move move = powder(open);
+    return move != stay ? move : flow(gas, preferLeft);
+}
+
+constexpr bool isGas(uint8_t material) {
+    return (material_properties::materialLookup[material].flags & material_properties::IsGas) != 0;
+}
+
+// whether a mover may swap into the target cell, PixelGrid::safeShouldSwapGasses
+constexpr bool isOpenTo(uint8_t mover, uint8_t target) {
+    const auto & lookup = material_properties::materialLookup;
+    if (lookup[target].flags & material_properties::IsLiquid) {
+        return lookup[mover].density > lookup[target].density;
+    }
+    return isGas(target);
+}
+
+// the bits of a signature, the open bits of the powder rule come first
+constexpr Move openNeighbours[] = {down, downRight, downLeft, right, left};
+constexpr Move gasNeighbours[] = {right, left, right2, left2};
+
+constexpr int openBit(Move move) { return move - down; }
+constexpr int gasBit(Move move) { return move - right + 5; }
+constexpr int preferLeftBit = 9;
+
+constexpr int powderSignatureBits = 5;
+constexpr int liquidSignatureBits = 10;
+
+// openTo[mover][neighbour] and gasCell[neighbour], one bit each, so the
+// gather is a load per neighbour with no tests
+constexpr auto openTo = [] {
+    std::array<std::array<uint8_t, materials::NumMaterials>, materials::NumMaterials> table{};
+    for (int mover = 0; mover < materials::NumMaterials; mover++) {
+        for (int target = 0; target < materials::NumMaterials; target++) {
+            table[mover][target] = isOpenTo(static_cast<uint8_t>(mover), static_cast<uint8_t>(target));
+        }
+    }
+    return table;
+}();
+
+constexpr auto gasCell = [] {
+    std::array<uint8_t, materials::NumMaterials> table{};
+    for (int material = 0; material < materials::NumMaterials; material++) {
+        table[material] = isGas(static_cast<uint8_t>(material));
+    }
+    return table;
+}();
+
+constexpr auto powderMoves = [] {
+    std::array<Move, 1 << powderSignatureBits> table{};
+    for (uint32_t signature = 0; signature < table.size(); signature++) {
+        auto open = [signature](Move move) { return ((signature >> openBit(move)) & 1) != 0; };
+        table[signature] = powder(open);
+    }
+    return table;
+}();
+
+constexpr auto liquidMoves = [] {
+    std::array<Move, 1 << liquidSignatureBits> table{};
+    for (uint32_t signature = 0; signature < table.size(); signature++) {
+        auto open = [signature](Move move) { return ((signature >> openBit(move)) & 1) != 0; };
+        auto gas = [signature](Move move) { return ((signature >> gasBit(move)) & 1) != 0; };
+        table[signature] = liquid(open, gas, ((signature >> preferLeftBit) & 1) != 0);
+    }
+    return table;
+}();
+
+static_assert(powderMoves[0] == stay && powderMoves[1 << openBit(down)] == down,
+    "a powder with nothing open stays and falls into an open cell below");
+static_assert(liquidMoves[1 << gasBit(left) | 1 << gasBit(right) | 1 << preferLeftBit] == left,
+    "a liquid boxed in below flows to its preferred side");
+}
@@ -0,0 +1,276 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "Materials.h"
+
+// One bit per cell for every kind of cell the movement rules ask about, 64
+// cells of a row to a word. "Is the cell below a gas" is then answered for
+// 64 cells at once with a load and a shift instead of 64 material lookups,
+// see PixelGrid::settledCells. The planes follow every material write, a
+// swap only flips the planes its two materials differ in.
+//
+// Sweep workers on chunks two apart write cells of the same word, never the
+// same cell, so words are only read and written through atomic_ref and
+// changed with atomic read-modify-writes once setShared(true) is called.
+
+class OccupancyPlanes
+{
+  public:
+    static constexpr int cellsPerWord = 64;
+
+    enum Plane : int {
+        gas,         // IsGas, air included, what falling and flowing cells move into
+        powder,      // falling powders
+        drifting,    // gases other than air, they move every tick
+        falling,     // cells that fell freely last tick, set by PixelGrid rather than by material, kept apart
+        firstLiquid, // one plane per liquid from here on, so a liquid tells its own kind from others
+    };
+
+    static constexpr int liquidCount = [] {
+        int count = 0;
+        for (int material = 0; material < materials::NumMaterials; material++) {
+            if (material_properties::materialClass(static_cast<uint8_t>(material)) == material_properties::MaterialClass::liquid) {
+                count ++;
+            }
+        }
+        return count;
+    }();
+
+    static constexpr int planeCount = firstLiquid + liquidCount;
+
+  private:
+    // the planes each material sets, one bit per plane
+    static constexpr std::array<uint32_t, materials::NumMaterials> s_materialPlanes = [] {
+        using namespace material_properties;
+        std::array<uint32_t, materials::NumMaterials> planes{};
+        int liquid = firstLiquid;
+        for (int material = 0; material < materials::NumMaterials; material++) {
+            MaterialClass materialClass = material_properties::materialClass(static_cast<uint8_t>(material));
+            uint32_t flags = materialLookup[material].flags;
+            if (flags & IsGas)                          { planes[material] |= 1u << gas; }
+            if (materialClass == MaterialClass::gas)    { planes[material] |= 1u << drifting; }
+            if (materialClass == MaterialClass::powder) { planes[material] |= 1u << powder; }
+            if (materialClass == MaterialClass::liquid) { planes[material] |= 1u << liquid++; }
+        }
+        return planes;
+    }();
+
+    static_assert([] {
+        using namespace material_properties;
+        for (int material = 0; material < materials::NumMaterials; material++) {
+            bool flagged = (materialLookup[material].flags & IsLiquid) != 0;
+            bool classed = materialClass(static_cast<uint8_t>(material)) == MaterialClass::liquid;
+            if (flagged != classed) { return false; }
+        }
+        return true;
+    }(), "the liquid planes stand in for IsLiquid checks");
+
+    int m_width = 0;
+    int m_height = 0;
+    int m_wordsPerRow = 0;
+    bool m_shared = false;
+
+    // the cells past the grid's edges count as gas, see the constructor
+    bool m_outsideGas = false;
+
+    // the planes of a word sit next to each other, word (wordX, y) of plane p
+    // is m_words[(y * m_wordsPerRow + wordX) * planeCount + p]. The falling
+    // plane is counted through every tick and has a vector of its own.
+    std::vector<uint64_t> m_words;
+    std::vector<uint64_t> m_falling;
+
+    // the falling cells in the words before each word, see countFalling
+    std::vector<uint32_t> m_fallingBefore;
+
+    size_t rowWord(int wordX, int y) const {
+        return static_cast<size_t>(y) * static_cast<size_t>(m_wordsPerRow) + static_cast<size_t>(wordX);
+    }
+
+    uint64_t & storedWord(int plane, int wordX, int y) {
+        if (plane == falling) { return m_falling[rowWord(wordX, y)]; }
+        return m_words[rowWord(wordX, y) * planeCount + static_cast<size_t>(plane)];
+    }
+
+    uint64_t loadWord(int plane, int wordX, int y) const {
+        // a load never writes, atomic_ref only takes a const word from C++26
+        uint64_t & word = const_cast<OccupancyPlanes *>(this)->storedWord(plane, wordX, y);
+        return std::atomic_ref<uint64_t>(word).load(std::memory_order_relaxed);
+    }
+
+    void flip(int plane, int x, int y) {
+        std::atomic_ref<uint64_t> word(storedWord(plane, x / cellsPerWord, y));
+        uint64_t bit = uint64_t{1} << (x % cellsPerWord);
+        if (m_shared) {
+            word.fetch_xor(bit, std::memory_order_relaxed);
+        } else {
+            word.store(word.load(std::memory_order_relaxed) ^ bit, std::memory_order_relaxed);
+        }
+    }
+
+    bool test(int plane, int x, int y) const {
+        return (loadWord(plane, x / cellsPerWord, y) >> (x % cellsPerWord)) & 1;
+    }
+
+    // returns the bits that were set
+    uint64_t clearBits(int plane, int wordX, int y, uint64_t bits) {
+        std::atomic_ref<uint64_t> word(storedWord(plane, wordX, y));
+        uint64_t old = word.load(std::memory_order_relaxed);
+        if ((old & bits) == 0) { return 0; }
+        if (m_shared) {
+            word.fetch_and(~bits, std::memory_order_relaxed);
+        } else {
+            word.store(old & ~bits, std::memory_order_relaxed);
+        }
+        return old & bits;
+    }
+
+    void setBits(int plane, int wordX, int y, uint64_t bits) {
+        std::atomic_ref<uint64_t> word(storedWord(plane, wordX, y));
+        uint64_t old = word.load(std::memory_order_relaxed);
+        if ((old | bits) == old) { return; }
+        if (m_shared) {
+            word.fetch_or(bits, std::memory_order_relaxed);
+        } else {
+            word.store(old | bits, std::memory_order_relaxed);
+        }
+    }
+
+  public:
+    OccupancyPlanes() = default;
+
+    // The planes of grid's cells, no cell is falling. Past the edges is
+    // solid unless outsideGas, then it is gas, as a void border is, and the
+    // word() of those cells says so.
+    template<typename Grid>
+    explicit OccupancyPlanes(const Grid & grid, bool outsideGas = false)
+      : m_width(static_cast<int>(grid.width()))
+      , m_height(static_cast<int>(grid.height()))
+      , m_wordsPerRow((m_width + cellsPerWord - 1) / cellsPerWord)
+      , m_outsideGas(outsideGas)
+    {
+        m_words.assign(static_cast<size_t>(m_wordsPerRow) * static_cast<size_t>(m_height) * planeCount, 0);
+        m_falling.assign(static_cast<size_t>(m_wordsPerRow) * static_cast<size_t>(m_height), 0);
+        m_fallingBefore.assign(m_falling.size(), 0);
+        for (int y = 0; y < m_height; y++) {
+            for (int x = 0; x < m_width; x++) {
+                for (uint32_t planes = s_materialPlanes[grid.material(x, y)]; planes != 0; planes &= planes - 1) {
+                    flip(std::countr_zero(planes), x, y);
+                }
+            }
+            // the bits past the last cell are never written
+            if (outsideGas && m_width % cellsPerWord != 0) {
+                storedWord(gas, m_wordsPerRow - 1, y) |= ~uint64_t{0} << (m_width % cellsPerWord);
+            }
+        }
+    }
+
+    // with more than one thread writing, see the top of the file
+    void setShared(bool shared) {
+        m_shared = shared;
+    }
+
+    // every plane of 64 cells, word wordX of row y holds cells from
+    // wordX * 64, bit 0 first. Words outside the grid are all 0 but for the
+    // gas plane of a grid with gas outside.
+    using Word = std::array<uint64_t, planeCount>;
+
+    Word word(int wordX, int y) const {
+        Word planes{};
+        if (y < 0 || y >= m_height || wordX < 0 || wordX >= m_wordsPerRow) {
+            planes[gas] = m_outsideGas ? ~uint64_t{0} : 0;
+            return planes;
+        }
+        for (int plane = 0; plane < planeCount; plane++) {
+            planes[plane] = loadWord(plane, wordX, y);
+        }
+        return planes;
+    }
+
+    // the cells one to the left and one to the right of a word's cells,
+    // from the word and its neighbour on that side
+    static uint64_t leftOf(uint64_t before, uint64_t here) {
+        return (here << 1) | (before >> (cellsPerWord - 1));
+    }
+
+    static uint64_t rightOf(uint64_t here, uint64_t after) {
+        return (here >> 1) | (after << (cellsPerWord - 1));
+    }
+
+    // the cell at (x, y) now holds material
+    void set(int x, int y, uint8_t material) {
+        uint32_t wanted = s_materialPlanes[material];
+        for (int plane = 0; plane < planeCount; plane++) {
+            if (plane == falling) { continue; }
+            if (test(plane, x, y) != ((wanted >> plane) & 1)) {
+                flip(plane, x, y);
+            }
+        }
+    }
+
+    // the count cells of row y from x all now hold material, a word at a time
+    void setSpan(int x, int y, int count, uint8_t material) {
+        uint32_t wanted = s_materialPlanes[material];
+        for (int wordX = x / cellsPerWord; wordX <= (x + count - 1) / cellsPerWord; wordX++) {
+            int from = std::max(x - wordX * cellsPerWord, 0);
+            int to = std::min(x + count - 1 - wordX * cellsPerWord, cellsPerWord - 1);
+            uint64_t cells = (~uint64_t{0} >> (cellsPerWord - 1 - to)) & (~uint64_t{0} << from);
+            for (int plane = 0; plane < planeCount; plane++) {
+                if (plane == falling) { continue; }
+                if ((wanted >> plane) & 1) {
+                    setBits(plane, wordX, y, cells);
+                } else {
+                    clearBits(plane, wordX, y, cells);
+                }
+            }
+        }
+    }
+
+    // the cells holding material1 and material2 swap places
+    void swap(int x1, int y1, uint8_t material1, int x2, int y2, uint8_t material2) {
+        for (uint32_t differ = s_materialPlanes[material1] ^ s_materialPlanes[material2]; differ != 0; differ &= differ - 1) {
+            int plane = std::countr_zero(differ);
+            flip(plane, x1, y1);
+            flip(plane, x2, y2);
+        }
+    }
+
+    bool isFalling(int x, int y) const {
+        return test(falling, x, y);
+    }
+
+    void setFalling(int x, int y, bool isFalling) {
+        if (test(falling, x, y) != isFalling) {
+            flip(falling, x, y);
+        }
+    }
+
+    void clearFalling() {
+        std::fill(m_falling.begin(), m_falling.end(), 0);
+        std::fill(m_fallingBefore.begin(), m_fallingBefore.end(), 0);
+    }
+
+    // call once the falling cells are set, before fallingRank, returns how
+    // many cells are falling
+    size_t countFalling() {
+        uint32_t count = 0;
+        for (size_t word = 0; word < m_falling.size(); word++) {
+            m_fallingBefore[word] = count;
+            count += static_cast<uint32_t>(std::popcount(m_falling[word]));
+        }
+        return count;
+    }
+
+    // the falling cells before (x, y) in row major order, so where a falling
+    // cell sits in a list of the falling cells sorted by cell index
+    size_t fallingRank(int x, int y) const {
+        int wordX = x / cellsPerWord;
+        uint64_t before = loadWord(falling, wordX, y) & ((uint64_t{1} << (x % cellsPerWord)) - 1);
+        return m_fallingBefore[rowWord(wordX, y)] + static_cast<size_t>(std::popcount(before));
+    }
+};
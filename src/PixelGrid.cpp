@@ -0,0 +1,1585 @@
+#include "PixelGrid.hpp"
+#include "Profiler.hpp"
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <type_traits>
+#include <variant>
+#include <vector>
+
+maybeResult<Vec2i> PixelGrid::generalSandPhysics(Vec2i currentPosition) const {
+    using namespace movement_rules;
+    auto f_checkPos = [&currentPosition, this](Move move) {
+        return (safeShouldSwapGasses(currentPosition, moveDelta[move]));
+    };
+
+    Move move = powder(f_checkPos);
+    if (move == stay) {
+        return maybeResult<Vec2i>();
+    }
+    return maybeResult(currentPosition + moveDelta[move]);
+}
+
+bool PixelGrid::isDenserThanTarget(int density, Vec2i target) const {
+    int targetDensity = material_properties::materialLookup[m_pixelGrid.material(target.x, target.y)].density;
+
+    return (density > targetDensity);
+}
+
+bool PixelGrid::safeShouldSwapGasses(Vec2i currentPosition, Vec2i movement) const {
+    Vec2i target = currentPosition + movement;
+    uint8_t currentMaterial = m_pixelGrid.material(currentPosition.x, currentPosition.y);
+    uint8_t targetMaterial = m_pixelGrid.material(target.x, target.y);
+    if (hasProperty(targetMaterial, material_properties::IsLiquid)) {
+        return (isDenserThanTarget(material_properties::materialLookup[currentMaterial].density, target));
+    } else {
+        return (checkIsGas(currentPosition + movement));
+    }
+}
+
+maybeResult<Vec2i> PixelGrid::generalGasMovementHorizontalDelta(Vec2i currentPosition, CellRandom & random, Pixel pixelToMove) const {
+    const Vec2i right = {1,0};
+    const Vec2i left = {-1,0};
+    const Vec2i right2 = 2 * right;
+    const Vec2i left2 = 2 * left; 
+
+    auto f_checkPos = [&pixelToMove, &currentPosition, this](Vec2i movement) {
+        Vec2i candidate = currentPosition + movement;
+        uint8_t candidateMaterial = m_pixelGrid.material(candidate.x, candidate.y);
+
+        if (pixelToMove.material != candidateMaterial && hasProperty(candidateMaterial, material_properties::IsGas)) {
+            return true;
+        }
+        return false;
+    };
+
+    if (random.bit()) {
+        if (f_checkPos(right)) 
+        {
+            return f_checkPos(right2) ? maybeResult(right2) : maybeResult(right);
+        } 
+        else if (f_checkPos(left))
+        {
+            return f_checkPos(left2) ? maybeResult(left2) : maybeResult(left);
+        }
+    } else 
+    {
+        if (f_checkPos(left))
+        {
+            return f_checkPos(left2) ? maybeResult(left2) : maybeResult(left);
+        }
+        else if (f_checkPos(right)) 
+        {
+            return f_checkPos(right2) ? maybeResult(right2) : maybeResult(right);
+        } 
+    }
+    return maybeResult<Vec2i>();
+}
+
+maybeResult<Vec2i> PixelGrid::generalGasMovementVerticalDelta(Vec2i currentPosition, Pixel pixelToMove) const {
+    const Vec2i up = {0,-1};
+
+
+    auto f_checkPosGas = [&pixelToMove, &currentPosition, this](Vec2i movement) {
+        Vec2i candidate = currentPosition + movement;
+        uint8_t candidateMaterial = m_pixelGrid.material(candidate.x, candidate.y);
+        return (pixelToMove.material != candidateMaterial && hasProperty(candidateMaterial, material_properties::IsGas));
+    };
+
+    auto f_checkPosDensityUnsafe = [&pixelToMove, &currentPosition, this](Vec2i movement) {
+        Vec2i candidate = currentPosition + movement;
+        uint8_t candidateMaterial = m_pixelGrid.material(candidate.x, candidate.y);
+
+        return (material_properties::materialLookup[pixelToMove.material].density < material_properties::materialLookup[candidateMaterial].density);
+    };
+
+    auto f_checkPos = [&f_checkPosGas, &f_checkPosDensityUnsafe](Vec2i movement) {return f_checkPosGas(movement) && f_checkPosDensityUnsafe(movement);};
+
+    return (f_checkPos(up) ? maybeResult(up) : maybeResult<Vec2i>());
+}
+
+maybeResult<Vec2i> PixelGrid::generalWaterPhysics(Vec2i currentPosition, CellRandom & random) const {
+    using namespace movement_rules;
+    auto f_checkPos = [&currentPosition, this](Move move) {
+        return (safeCheckIsGas(currentPosition + moveDelta[move]));
+    };
+
+    bool prefferedDirection = random.bit();
+
+    Move move = flow(f_checkPos, prefferedDirection);
+    if (move == stay) {
+        return maybeResult<Vec2i>();
+    }
+    return maybeResult(currentPosition + moveDelta[move]);
+}
+
+maybeResult<Vec2i> PixelGrid::generalFallingPhysics(Vec2i currentPosition) const {
+    const Vec2i down = Vec2i(0,1);
+
+    auto f_checkPos = [&currentPosition, this](Vec2i movement) {
+        return (safeCheckIsGas(currentPosition + movement));
+    };
+
+    if (f_checkPos(down)) {
+        return maybeResult(currentPosition + down);
+    }
+    else { return maybeResult<Vec2i>(); }
+}
+
+maybeResult<ActionIncludingPair> PixelGrid::generalFireSpreadPhysics(Vec2i pos, CellRandom & random) const {
+    Pixel thisPixel = m_pixelGrid[pos.x][pos.y];
+    if (bitop::flag_has_mask(thisPixel.properties, pixel_properties::OnFire)) {
+
+        FirePixel burnProperties = material_properties::materialLookup[thisPixel.material].burnProperties;
+        const FirePixel* fire = m_fireMap.find(cellIndex(pos));
+        if (fire && fire->burnPercentageChance > random.below(100)) {
+            Vec2i dPos = selectRandomElement(std::span<const Vec2i>(neighbourDeltas), random);
+            const Pixel candidatePixel = getPixelConst(pos + dPos);
+            const uint8_t & candiateMaterial = candidatePixel.material;
+            bool flammable = hasProperty(candiateMaterial, material_properties::Flammable);
+            return (flammable && !bitop::flag_has_mask(candidatePixel.properties, pixel_properties::OnFire)
+            ? maybeResult(m_IgniteAction{burnProperties, pos + dPos}) 
+            : maybeResult<m_IgniteAction>());
+        }
+    }
+    return maybeResult<m_IgniteAction>();
+}
+
+// Fire spread and reactions look at all 8 neighbours with no bounds checks
+// and write the neighbour they pick, so a border ring cell must never be
+// one they would pick.
+constexpr bool turnsBorderCells(uint8_t material) {
+    if (material_properties::materialLookup[material].flags & material_properties::Flammable) { return true; }
+    return std::ranges::any_of(material_reactions::reactions,
+        [material](const material_reactions::Reaction & reaction) { return reaction.neighbour == material; });
+}
+static_assert(!turnsBorderCells(PixelGrid::wallMaterial) && !turnsBorderCells(PixelGrid::voidMaterial),
+    "fire and reactions would write into the border ring");
+
+maybeResult<ActionIncludingPair> PixelGrid::findReaction(Vec2i pos, material_reactions::Trigger trigger) const {
+    using material_reactions::reactionTable;
+
+    uint8_t material = m_pixelGrid.material(pos.x, pos.y);
+    if (!reactionTable.reacts(trigger, material)) {
+        return maybeResult<ActionIncludingPair>();
+    }
+
+    for (Vec2i neighborDelta : neighbourDeltas) {
+        Vec2i targetPos = neighborDelta + pos;
+
+        uint8_t id = reactionTable.lookup(trigger, material, m_pixelGrid.material(targetPos.x, targetPos.y));
+        if (id != material_reactions::noReaction) {
+            const material_reactions::Reaction & reaction = material_reactions::reactions[id];
+            SetPixelMaterialAndProperties a1 = {pos, reaction.becomes.material, reaction.becomes.properties};
+            SetPixelMaterialAndProperties a2 = {targetPos, reaction.neighbourBecomes.material, reaction.neighbourBecomes.properties};
+            return maybeResult(ActionPair({a1, a2}));
+        }
+    }
+    return maybeResult<ActionIncludingPair>();
+}
+
+maybeResult<ActionIncludingPair> PixelGrid::generalFireInteractionPhysics(Vec2i pos) {
+    return findReaction(pos, material_reactions::Trigger::onFire);
+}
+
+bool PixelGrid::safeCheckIsGas(Vec2i pos) const {
+    // the border ring answers for positions just off the grid
+    return checkIsGas(pos);
+}
+
+void PixelGrid::doPhysics() {
+    CELLSIM_PROFILE_SCOPE("doPhysics");
+    m_globalUpdateFrame ++;
+    m_tickCount ++;
+    if (m_globalUpdateFrame % updateFrameRenewal == 0) {
+        m_pixelGrid.fillUpdateFrames(static_cast<uint8_t>(m_globalUpdateFrame - 1));
+    }
+    m_chunkGrid.beginStep();
+
+    // alternate the sweep direction every frame so nothing drifts to one side
+    bool xAscending = bitop::check_nth_bit(m_globalUpdateFrame, 0);
+    bool yAscending = bitop::check_nth_bit(m_globalUpdateFrame, 1);
+
+    if (m_threadPool) {
+        doPhysicsParallel(xAscending, yAscending);
+    } else {
+        int chunksX = m_chunkGrid.chunksX();
+        int chunksY = m_chunkGrid.chunksY();
+        for (int i = 0; i < chunksX; i++) {
+            int cx = xAscending ? i : chunksX - 1 - i;
+            for (int j = 0; j < chunksY; j++) {
+                int cy = yAscending ? j : chunksY - 1 - j;
+                const DirtyRect & rect = m_chunkGrid.chunkAt(cx, cy).current;
+                if (!rect.empty()) {
+                    sweepRect(rect, xAscending, yAscending);
+                }
+            }
+        }
+    }
+    collectFallSpeeds();
+
+    doFirePhysics();
+}
+
+void PixelGrid::doPhysicsParallel(bool xAscending, bool yAscending) {
+    for (int pass = 0; pass < 4; pass++) {
+        int parityX = pass & 1;
+        int parityY = pass >> 1;
+
+        m_passChunks.clear();
+        for (int cy = parityY; cy < m_chunkGrid.chunksY(); cy += 2) {
+            for (int cx = parityX; cx < m_chunkGrid.chunksX(); cx += 2) {
+                if (!m_chunkGrid.chunkAt(cx, cy).current.empty()) {
+                    m_passChunks.push_back({cx, cy});
+                }
+            }
+        }
+
+        m_threadPool->parallelFor(m_passChunks.size(), [&](size_t i, size_t) {
+            auto [cx, cy] = m_passChunks[i];
+            sweepRect(m_chunkGrid.chunkAt(cx, cy).current, xAscending, yAscending);
+        });
+    }
+}
+
+void PixelGrid::sweepRect(const DirtyRect & rect, bool xAscending, bool yAscending) {
+    int width = rect.maxX - rect.minX + 1;
+    int height = rect.maxY - rect.minY + 1;
+    for (int j = 0; j < height; j++) {
+        int yi = yAscending ? rect.minY + j : rect.maxY - j;
+        if constexpr (useOccupancyPlanes) {
+            sweepRow(rect.minX, rect.maxX, yi, xAscending);
+            continue;
+        }
+        for (int i = 0; i < width; i++) {
+            int xi = xAscending ? rect.minX + i : rect.maxX - i;
+            doPhysicsOnPixel(xi, yi);
+        }
+    }
+}
+
+void PixelGrid::sweepRow(int minX, int maxX, int y, bool xAscending) {
+    using Planes = OccupancyPlanes;
+    constexpr int wordCells = Planes::cellsPerWord;
+    const int firstWord = minX / wordCells;
+    const int lastWord = maxX / wordCells;
+
+    for (int i = 0; i <= lastWord - firstWord; i++) {
+        const int wordX = xAscending ? firstWord + i : lastWord - i;
+        const int x0 = wordX * wordCells;
+        const int from = std::max(minX, x0) - x0;
+        const int to = std::min(maxX, x0 + wordCells - 1) - x0;
+        uint64_t todo = (~uint64_t{0} >> (wordCells - 1 - to)) & (~uint64_t{0} << from);
+
+        const Planes::Word here = m_occupancy.word(wordX, y);
+        uint64_t moving = here[Planes::powder] | here[Planes::drifting];
+        for (int liquid = Planes::firstLiquid; liquid < Planes::planeCount; liquid++) {
+            moving |= here[liquid];
+        }
+        // air and solids have nothing to do
+        if ((todo & moving) == 0) { continue; }
+
+        const uint64_t settled = settledCells(wordX, y);
+        // cells near one that moved, whatever they hold now
+        uint64_t touched = 0;
+
+        while (todo != 0) {
+            uint64_t visit = todo & ((moving & ~settled) | touched);
+            int bit = 0;
+            uint64_t passed = todo;
+            if (visit != 0) {
+                bit = xAscending ? std::countr_zero(visit) : wordCells - 1 - std::countl_zero(visit);
+                uint64_t below = (uint64_t{1} << bit) - 1;
+                passed = todo & (xAscending ? below : ~below & ~(uint64_t{1} << bit));
+            }
+            // the settled cells before the next visit had their turn, as
+            // physicsKernel would have marked them
+            for (uint64_t cells = passed & moving & settled; cells != 0; cells &= cells - 1) {
+                m_pixelGrid.ref(x0 + std::countr_zero(cells), y).updateFrame = m_globalUpdateFrame;
+            }
+            todo &= ~passed;
+            if (visit == 0) { break; }
+
+            doPhysicsOnPixel(x0 + bit, y);
+            todo &= ~(uint64_t{1} << bit);
+            touched |= bit >= 3 ? uint64_t{0x7f} << (bit - 3) : uint64_t{0x7f} >> (3 - bit);
+        }
+    }
+}
+
+uint64_t PixelGrid::settledCells(int wordX, int y) const {
+    using Planes = OccupancyPlanes;
+    const Planes::Word before = m_occupancy.word(wordX - 1, y);
+    const Planes::Word here = m_occupancy.word(wordX, y);
+    const Planes::Word after = m_occupancy.word(wordX + 1, y);
+    const Planes::Word beforeBelow = m_occupancy.word(wordX - 1, y + 1);
+    const Planes::Word below = m_occupancy.word(wordX, y + 1);
+    const Planes::Word afterBelow = m_occupancy.word(wordX + 1, y + 1);
+
+    // each cell's neighbours in the plane, lined up with the cell
+    auto left = [&](int plane) { return Planes::leftOf(before[plane], here[plane]); };
+    auto right = [&](int plane) { return Planes::rightOf(here[plane], after[plane]); };
+    auto belowLeft = [&](int plane) { return Planes::leftOf(beforeBelow[plane], below[plane]); };
+    auto belowRight = [&](int plane) { return Planes::rightOf(below[plane], afterBelow[plane]); };
+
+    // liquid neighbours, and those of a liquid's own kind
+    uint64_t liquids = 0;
+    uint64_t liquidBelow = 0, liquidLeft = 0, liquidRight = 0, liquidBelowLeft = 0, liquidBelowRight = 0;
+    uint64_t sameBelow = 0, sameLeft = 0, sameRight = 0, sameBelowLeft = 0, sameBelowRight = 0;
+    for (int plane = Planes::firstLiquid; plane < Planes::planeCount; plane++) {
+        liquids |= here[plane];
+        liquidBelow |= below[plane];
+        liquidLeft |= left(plane);
+        liquidRight |= right(plane);
+        liquidBelowLeft |= belowLeft(plane);
+        liquidBelowRight |= belowRight(plane);
+        sameBelow |= here[plane] & below[plane];
+        sameLeft |= here[plane] & left(plane);
+        sameRight |= here[plane] & right(plane);
+        sameBelowLeft |= here[plane] & belowLeft(plane);
+        sameBelowRight |= here[plane] & belowRight(plane);
+    }
+
+    // what a cell may move into: gas, or a liquid of another kind it might be denser than
+    uint64_t openBelow = below[Planes::gas] | (liquidBelow & ~sameBelow);
+    uint64_t openLeft = left(Planes::gas) | (liquidLeft & ~sameLeft);
+    uint64_t openRight = right(Planes::gas) | (liquidRight & ~sameRight);
+    uint64_t openBelowLeft = belowLeft(Planes::gas) | (liquidBelowLeft & ~sameBelowLeft);
+    uint64_t openBelowRight = belowRight(Planes::gas) | (liquidBelowRight & ~sameBelowRight);
+
+    uint64_t cannotFall = ~openBelow & ~(openRight & openBelowRight) & ~(openLeft & openBelowLeft);
+    // a liquid that cannot fall flows into gas beside it
+    uint64_t cannotFlow = ~(liquids & (left(Planes::gas) | right(Planes::gas)));
+    uint64_t notFollowing = ~below[Planes::falling];
+
+    return (here[Planes::powder] | liquids) & cannotFall & cannotFlow & notFollowing;
+}
+
+void PixelGrid::rebuildOccupancy() {
+    m_occupancy = OccupancyPlanes(m_pixelGrid, m_boundaryMode == BoundaryMode::voidEdge);
+    m_occupancy.setShared(m_threadPool != nullptr);
+}
+
+void PixelGrid::doPhysicsOnPixel(int col, int row) {
+#ifdef CELLSIM_FLAG_CHAIN_DISPATCH
+    doPhysicsOnPixelFlagChain(col, row);
+#else
+    uint8_t material = m_pixelGrid.material(col, row);
+    if (material == materials::air) { return; }
+
+    (this->*s_physicsKernels[material])(col, row);
+#endif
+}
+
+using material_properties::MaterialClass;
+
+template<MaterialClass Class>
+maybeResult<Vec2i> PixelGrid::tableNextPosition(Vec2i pos, CellRandom & random) const {
+    using namespace movement_rules;
+    auto neighbour = [&pos, this](Move move) {
+        Vec2i target = pos + moveDelta[move];
+        return m_pixelGrid.material(target.x, target.y);
+    };
+
+    const auto & open = openTo[m_pixelGrid.material(pos.x, pos.y)];
+    uint32_t signature = 0;
+    for (Move move : openNeighbours) {
+        signature |= static_cast<uint32_t>(open[neighbour(move)]) << openBit(move);
+    }
+
+    Move move;
+    if constexpr (Class == MaterialClass::liquid) {
+        for (Move gasMove : gasNeighbours) {
+            signature |= static_cast<uint32_t>(gasCell[neighbour(gasMove)]) << gasBit(gasMove);
+        }
+        signature |= static_cast<uint32_t>(random.bit()) << preferLeftBit;
+        move = liquidMoves[signature];
+    } else {
+        move = powderMoves[signature];
+    }
+
+    if (move == stay) {
+        return maybeResult<Vec2i>();
+    }
+    return maybeResult(pos + moveDelta[move]);
+}
+
+template<>
+maybeResult<Vec2i> PixelGrid::nextPosition<MaterialClass::liquid>(Vec2i pos, CellRandom & random) const {
+    if (m_movementRules == MovementRules::neighbourhoodTable) {
+        return tableNextPosition<MaterialClass::liquid>(pos, random);
+    }
+    maybeResult<Vec2i> next = generalSandPhysics(pos);
+    if (!next.exists()) {
+        next = generalWaterPhysics(pos, random);
+    }
+    return next;
+}
+
+template<>
+maybeResult<Vec2i> PixelGrid::nextPosition<MaterialClass::powder>(Vec2i pos, CellRandom & random) const {
+    if (m_movementRules == MovementRules::neighbourhoodTable) {
+        return tableNextPosition<MaterialClass::powder>(pos, random);
+    }
+    return generalSandPhysics(pos);
+}
+
+template<>
+maybeResult<Vec2i> PixelGrid::nextPosition<MaterialClass::gas>(Vec2i pos, CellRandom & random) const {
+    Pixel pixel = m_pixelGrid.get(pos.x, pos.y);
+    Vec2i next = pos + generalGasMovementHorizontalDelta(pos, random, pixel).merge(Vec2i(0, 0)).getValue();
+    next = next + generalGasMovementVerticalDelta(next, pixel).merge(Vec2i(0, 0)).getValue();
+    // a gas boxed in where it is does not swap with itself, which would wake its chunk
+    if (next.x == pos.x && next.y == pos.y) {
+        return maybeResult<Vec2i>();
+    }
+    return maybeResult<Vec2i>(next);
+}
+
+Vec2i PixelGrid::fall(Vec2i pos) {
+    // nextPosition found the first cell down free, for gas or a lighter liquid
+    Vec2i target = pos + Vec2i(0, 1);
+    // below the last row only a void is open, the cell is gone there
+    if (!checkIsGas(target) || target.y == m_gridHeight) {
+        return target;
+    }
+
+    uint8_t material = m_pixelGrid.material(pos.x, pos.y);
+    int speed = std::min(fallSpeed(pos, material) + fallAcceleration, maxFallSpeed);
+    // the border ring is not as deep as a fall, the last row stops it
+    const int lastRow = std::min(pos.y + speed, m_gridHeight - 1);
+    while (target.y < lastRow && checkIsGas(target + Vec2i(0, 1))) {
+        target.y ++;
+    }
+    if (target.y - pos.y == speed) {
+        // the list of the chunk being swept, no other worker touches it
+        m_fallingByChunk[static_cast<size_t>(m_chunkGrid.chunkIndex(pos.x, pos.y))].push_back(
+            FallingCell{cellIndex(target), material, static_cast<uint8_t>(speed)});
+    }
+    return target;
+}
+
+bool PixelGrid::followFallingCell(Vec2i pos) {
+    Vec2i below = pos + Vec2i(0, 1);
+    // only powders and liquids fall, which also leaves out the border ring
+    uint8_t belowMaterial = m_pixelGrid.material(below.x, below.y);
+    if (!hasProperty(belowMaterial, material_properties::CanFall)
+        || m_pixelGrid.updateFrame(below.x, below.y) == m_globalUpdateFrame
+        || fallSpeed(below, belowMaterial) == 0) {
+        return false;
+    }
+    uint8_t material = m_pixelGrid.material(pos.x, pos.y);
+    int speed = fallSpeed(pos, material);
+    if (speed > 0) {
+        m_fallingByChunk[static_cast<size_t>(m_chunkGrid.chunkIndex(pos.x, pos.y))].push_back(
+            FallingCell{cellIndex(pos), material, static_cast<uint8_t>(speed)});
+    }
+    // the cell below may turn out to be stuck, look again next tick
+    m_chunkGrid.markDirty(pos);
+    return true;
+}
+
+int PixelGrid::fallSpeed(Vec2i pos, uint8_t material) const {
+    const FallingCell * found = nullptr;
+    if constexpr (useOccupancyPlanes) {
+        // most cells are not falling, and a falling cell's rank among them
+        // is where it is in m_fallSpeeds, no search needed
+        if (!m_occupancy.isFalling(pos.x, pos.y)) { return 0; }
+        found = &m_fallSpeeds[m_occupancy.fallingRank(pos.x, pos.y)];
+    } else {
+        uint32_t cell = cellIndex(pos);
+        auto lower = std::lower_bound(m_fallSpeeds.begin(), m_fallSpeeds.end(), cell,
+            [](const FallingCell & falling, uint32_t key) { return falling.cell < key; });
+        if (lower == m_fallSpeeds.end() || lower->cell != cell) { return 0; }
+        found = &*lower;
+    }
+    return found->material == material ? found->speed : 0;
+}
+
+void PixelGrid::collectFallSpeeds() {
+    // a cell landed on twice keeps the higher speed (then the lower
+    // material), whatever order the sweep workers finished in
+    auto keeps = [](const FallingCell & a, const FallingCell & b) {
+        return a.speed != b.speed ? a.speed > b.speed : a.material < b.material;
+    };
+
+    if constexpr (useOccupancyPlanes) {
+        // the falling plane sorts the cells, every cell goes straight to its rank
+        for (const FallingCell & falling : m_fallSpeeds) {
+            m_occupancy.setFalling(static_cast<int>(falling.cell) % m_gridWidth, static_cast<int>(falling.cell) / m_gridWidth, false);
+        }
+        for (const std::vector<FallingCell> & fallen : m_fallingByChunk) {
+            for (const FallingCell & falling : fallen) {
+                m_occupancy.setFalling(static_cast<int>(falling.cell) % m_gridWidth, static_cast<int>(falling.cell) / m_gridWidth, true);
+            }
+        }
+        m_fallSpeeds.assign(m_occupancy.countFalling(), FallingCell{0, 0, 0});
+        for (std::vector<FallingCell> & fallen : m_fallingByChunk) {
+            for (const FallingCell & falling : fallen) {
+                FallingCell & slot = m_fallSpeeds[m_occupancy.fallingRank(
+                    static_cast<int>(falling.cell) % m_gridWidth, static_cast<int>(falling.cell) / m_gridWidth)];
+                if (slot.speed == 0 || keeps(falling, slot)) {
+                    slot = falling;
+                }
+            }
+            fallen.clear();
+        }
+        return;
+    }
+
+    m_fallSpeeds.clear();
+    for (std::vector<FallingCell> & falling : m_fallingByChunk) {
+        m_fallSpeeds.insert(m_fallSpeeds.end(), falling.begin(), falling.end());
+        falling.clear();
+    }
+    std::sort(m_fallSpeeds.begin(), m_fallSpeeds.end(), [&keeps](const FallingCell & a, const FallingCell & b) {
+        return a.cell != b.cell ? a.cell < b.cell : keeps(a, b);
+    });
+    auto last = std::unique(m_fallSpeeds.begin(), m_fallSpeeds.end(),
+        [](const FallingCell & a, const FallingCell & b) { return a.cell == b.cell; });
+    m_fallSpeeds.erase(last, m_fallSpeeds.end());
+}
+
+void PixelGrid::resetFallSpeeds() {
+    m_fallSpeeds.clear();
+    m_occupancy.clearFalling();
+    m_fallingByChunk.assign(static_cast<size_t>(m_chunkGrid.chunkCount()), {});
+}
+
+// liquids, powders and gases
+template<MaterialClass Class>
+void PixelGrid::physicsKernel(int col, int row) {
+    // pixels moved forward in the sweep have already been updated this frame
+    if (m_pixelGrid.updateFrame(col, row) == m_globalUpdateFrame) { return; }
+
+    Vec2i pos = Vec2i(col, row);
+    if constexpr (Class == MaterialClass::powder || Class == MaterialClass::liquid) {
+        if (followFallingCell(pos)) { return; }
+    }
+    CellRandom random(m_randomSeed, pos, m_tickCount);
+
+    maybeResult<Vec2i> next = nextPosition<Class>(pos, random);
+    if constexpr (Class == MaterialClass::powder || Class == MaterialClass::liquid) {
+        if (next.exists() && next.getValue().x == pos.x && next.getValue().y == pos.y + 1) {
+            next = maybeResult<Vec2i>(fall(pos));
+        }
+    }
+    pos = swapIfExists(pos, next);
+    m_pixelGrid.ref(pos.x, pos.y).updateFrame = m_globalUpdateFrame;
+}
+
+// solids never move and fire has its own pass, so there is nothing to do
+template<>
+void PixelGrid::physicsKernel<MaterialClass::solid>(int, int) {}
+
+// air, doPhysicsOnPixel returns before dispatching it
+template<>
+void PixelGrid::physicsKernel<MaterialClass::none>(int, int) {}
+
+constinit const std::array<PixelGrid::PhysicsKernel, materials::NumMaterials> PixelGrid::s_physicsKernels =
+    PixelGrid::makeKernelTable(std::make_index_sequence<materials::NumMaterials>{});
+
+void PixelGrid::doFirePhysics() {
+    m_burningCells.clear();
+    m_fireMap.appendCells(m_burningCells);
+    std::sort(m_burningCells.begin(), m_burningCells.end());
+
+    for (uint32_t cell : m_burningCells) {
+        // put out or burnt away earlier in this pass
+        if (!m_fireMap.find(cell)) { continue; }
+
+        Vec2i pos = Vec2i(static_cast<int>(cell) % m_gridWidth, static_cast<int>(cell) / m_gridWidth);
+        CellRandom random(m_randomSeed ^ fireRandomSalt, pos, m_tickCount);
+        burnPixel(pos, random);
+    }
+}
+
+void PixelGrid::burnPixel(Vec2i pos, CellRandom & random) {
+    if (!bitop::flag_has_mask8(m_pixelGrid.properties(pos.x, pos.y), pixel_properties::AlwaysOnFire)) {
+        m_fireMap.find(cellIndex(pos))->burnTime -= 1;
+    }
+    // burning pixels change every frame even when they dont move
+    m_chunkGrid.markDirty(pos);
+
+    maybeResult<ActionIncludingPair> fireResult = incinerationCheck(pos);
+    if (!fireResult.exists()) { fireResult = generalFireInteractionPhysics(pos); }
+    if (!fireResult.exists()) { fireResult = generalFireSpreadPhysics(pos, random); }
+    if (fireResult.exists()) {
+        executeAction(fireResult.getValue());
+    }
+}
+
+void PixelGrid::doPhysicsOnPixelFlagChain(int col, int row) {
+    // the pixel must have a path to move through if it moves diagonally
+    // othersie it seemingly phases through containers
+
+    // assumption in all our next position functions, they cant returrn the same position they were given otherwise
+    // that pixel would just be set to air, the maybe type is to represent the case that the function does not find
+    // a new place to put the pixel
+
+    if (m_pixelGrid.material(col, row) == materials::air) { return; }
+
+    Pixel currentPixel = m_pixelGrid.get(col, row);
+
+    if (currentPixel.updateFrame == m_globalUpdateFrame) { return; };
+
+    Vec2i currentPos = Vec2i(col, row);
+    CellRandom random(m_randomSeed, currentPos, m_tickCount);
+    maybeResult<Vec2i> nextPos = maybeResult<Vec2i>();
+    maybeResult<Vec2i> nextNextPos = maybeResult<Vec2i>();
+    
+    auto scopeCapturedSandPhysics = [&currentPos, this](){return this->generalSandPhysics(currentPos);};
+
+    auto scopeCapturedWaterPhysics = [&random, &currentPos, this](){return this->generalWaterPhysics(currentPos, random);};
+
+
+
+
+    // pixel movement doesnt change the type of pixels
+    // straight down may go further than one cell, as in physicsKernel
+    auto scopeCapturedFall = [&currentPos, this](maybeResult<Vec2i> next) {
+        if (next.exists() && next.getValue().x == currentPos.x && next.getValue().y == currentPos.y + 1) {
+            return maybeResult<Vec2i>(fall(currentPos));
+        }
+        return next;
+    };
+
+    bool falls = hasProperty(currentPixel.material, material_properties::fallingLiquid)
+        || hasProperty(currentPixel.material, material_properties::fallingPowder);
+    if (falls && followFallingCell(currentPos)) { return; }
+
+    if (hasProperty(currentPixel.material, material_properties::fallingLiquid))
+    {
+        nextPos = scopeCapturedFall(scopeCapturedSandPhysics().tryWith(scopeCapturedWaterPhysics));
+
+        currentPos = swapIfExists(currentPos, nextPos);
+    }
+    
+    else if(hasProperty(currentPixel.material, material_properties::fallingPowder)) {
+        nextPos = scopeCapturedFall(scopeCapturedSandPhysics());
+
+        currentPos = swapIfExists(currentPos, nextPos);
+    }
+
+    else if (hasProperty(currentPixel.material, material_properties::IsSolid)) {
+        nextPos = maybeResult<Vec2i>(); // essentially a nothing
+        
+        currentPos = swapIfExists(currentPos, nextPos);
+    } 
+
+    else if (hasProperty(currentPixel.material, material_properties::IsGas)) {
+        nextPos = maybeResult<Vec2i>(currentPos) + generalGasMovementHorizontalDelta(currentPos, random, currentPixel);
+
+        nextNextPos = nextPos + generalGasMovementVerticalDelta(nextPos.getValue(), currentPixel);
+
+        currentPos = swapIfExists(currentPos, nextNextPos);
+
+        // currentPos = swapIfExists(nextPos.getValue(), nextNextPos);
+    }
+    else {
+        throw std::runtime_error("UnknownMaterial fix in doPhysics method of pixelgrid class in PixelGridd.hpp");
+    } 
+
+    // fire is handled by doFirePhysics for both dispatches
+
+    m_pixelGrid[currentPos.x][currentPos.y].updateFrame = m_globalUpdateFrame;
+}
+
+Vec2i PixelGrid::swapIfExists(Vec2i currentPos, maybeResult<Vec2i> nextPos) {
+    Vec2i v_nextPos;
+    if (nextPos.exists()) {
+        v_nextPos = nextPos.getValue();
+        swapPixels(currentPos, v_nextPos);
+    } else {
+        v_nextPos = currentPos;
+    }
+    return v_nextPos;
+}
+
+void PixelGrid::m_incineratePixel(IncinerationAction action) {
+    Pixel currentPixel = m_pixelGrid[action.pos.x][action.pos.y];
+    uint8_t newMaterial = materials::incineration_table[currentPixel.material];
+    currentPixel.material = newMaterial;
+    // what is left has had its turn this frame
+    currentPixel.updateFrame = m_globalUpdateFrame;
+
+    setPixel({action.pos, currentPixel}); 
+}
+
+maybeResult<ActionIncludingPair> PixelGrid::incinerationCheck(Vec2i pos) const {
+    const FirePixel* fire = m_fireMap.find(cellIndex(pos));
+    if (fire && fire->burnTime == 0) {
+        return maybeResult<IncinerationAction>({pos, m_pixelGrid[pos.x][pos.y]});
+    }
+    return maybeResult<IncinerationAction>();
+}
+
+void PixelGrid::m_Ignition(m_IgniteAction action) {
+    getPixelRef(action.pos).properties |= pixel_properties::OnFire;     
+
+    m_fireMap.insertOrAssign(cellIndex(action.pos), action.fireProperties);
+    m_chunkGrid.markDirty(action.pos);
+}
+
+void PixelGrid::swapPixels(Vec2i pos1, Vec2i pos2) {
+    // a wall ring is never open, only a void lets cells off the grid
+    if (m_boundaryMode == BoundaryMode::voidEdge && !isInBounds(pos2)) {
+        dropIntoVoid(pos1);
+        return;
+    }
+    if constexpr (useOccupancyPlanes) {
+        m_occupancy.swap(pos1.x, pos1.y, m_pixelGrid.material(pos1.x, pos1.y),
+                         pos2.x, pos2.y, m_pixelGrid.material(pos2.x, pos2.y));
+    }
+    m_pixelGrid.swap(pos1.x, pos1.y, pos2.x, pos2.y);
+    // m_pixelGrid[pos2.x][pos2.y].updateFrame = m_globalUpdateFrame;
+
+    // only burning pixels have fire state to carry along
+    if ((m_pixelGrid.properties(pos1.x, pos1.y) | m_pixelGrid.properties(pos2.x, pos2.y)) & pixel_properties::OnFire) {
+        if (m_threadPool) {
+            std::lock_guard<std::mutex> lock(*m_fireMutex);
+            m_fireMap.swap(cellIndex(pos1), cellIndex(pos2));
+        } else {
+            m_fireMap.swap(cellIndex(pos1), cellIndex(pos2));
+        }
+    }
+
+    m_chunkGrid.markDirty(pos1);
+    m_chunkGrid.markDirty(pos2);
+}
+
+void PixelGrid::dropIntoVoid(Vec2i pos) {
+    bool burning = m_pixelGrid.properties(pos.x, pos.y) & pixel_properties::OnFire;
+    if constexpr (useOccupancyPlanes) {
+        m_occupancy.set(pos.x, pos.y, materials::air);
+    }
+    m_pixelGrid.ref(pos.x, pos.y) = Pixel{materials::air, m_globalUpdateFrame, pixel_properties::None};
+    if (burning) {
+        if (m_threadPool) {
+            std::lock_guard<std::mutex> lock(*m_fireMutex);
+            m_fireMap.erase(cellIndex(pos));
+        } else {
+            m_fireMap.erase(cellIndex(pos));
+        }
+    }
+    m_chunkGrid.markDirty(pos);
+}
+
+void PixelGrid::setBoundaryMode(BoundaryMode mode) {
+    m_boundaryMode = mode;
+    m_pixelGrid.fillBorder(borderPixel());
+    // cells along the edges may be free to move now
+    m_chunkGrid.markAllDirty();
+    rebuildOccupancy();
+    resetFallSpeeds();
+}
+
+void PixelGrid::init() {
+    initRandom();
+    initGrid();
+    initDrawBuffer();
+    initStampMask();
+}
+
+void PixelGrid::initGrid() {
+    // every pixel starts as air, saved worlds are opened with loadWorld
+    m_pixelGrid = makePixelStorage(m_gridWidth, m_gridHeight, Pixel{materials::air, 0, 0});
+    m_fireMap.clear();
+    m_chunkGrid = ChunkGrid(m_gridWidth, m_gridHeight);
+    rebuildOccupancy();
+    resetFallSpeeds();
+}
+
+void PixelGrid::tryIgnitePixel(IgnitionAction action) {
+    // the igniter follows the mouse, which may be off the grid
+    if (!isInBounds(action.pos)) { return; }
+
+    PixelRef pixel = getPixelRef(action.pos);
+    if (hasProperty(pixel.material, material_properties::Flammable) && !bitop::flag_has_mask(pixel.properties, pixel_properties::OnFire)) 
+    {
+        pixel.properties |= pixel_properties::OnFire;   
+        FirePixel burnProperties = material_properties::materialLookup[pixel.material].burnProperties;
+        m_IgniteAction immolate = {burnProperties, action.pos}; 
+        m_Ignition(immolate);
+    };
+}
+
+void PixelGrid::doActionPair(ActionPair actions) {
+    _executeAction(actions.this_action.first);
+
+    _executeAction(actions.this_action.second);
+}
+
+void PixelGrid::executeAction(ActionIncludingPair a) {
+    if (std::holds_alternative<ActionPair>(a)) {
+        doActionPair(std::get<ActionPair>(a));
+    } else {
+        _executeAction(std::get<Action>(a));
+    }
+}
+
+void PixelGrid::_executeAction(Action a) {
+    std::visit([this](const auto & action) { applyAction(action); }, a);
+}
+
+void PixelGrid::executeActions(CommandBuffer & commands) {
+    CELLSIM_PROFILE_SCOPE("executeActions");
+    commands.forEach([this](const auto & queued) {
+        using Command = std::decay_t<decltype(queued)>;
+        // with paging on commands are queued in world cells
+        const Command command = m_pager ? toGridCoordinates(queued) : queued;
+        if constexpr (std::is_same_v<Command, DrawLineAction>) {
+            stampLine(command);
+        } else if constexpr (std::is_same_v<Command, DrawCircle>) {
+            stampCircle(command);
+        } else if constexpr (std::is_same_v<Command, DrawParallelogramAction>) {
+            stampParallelogram(command);
+        } else {
+            flushStamps();
+            applyAction(command);
+        }
+    });
+    flushStamps();
+    commands.reset();
+}
+
+void PixelGrid::stampCircle(DrawCircle action) {
+    bool samePixel = action.pixel_type.material == m_stampPixel.material
+                  && action.pixel_type.updateFrame == m_stampPixel.updateFrame
+                  && action.pixel_type.properties == m_stampPixel.properties;
+    if (!samePixel) {
+        flushStamps();
+        m_stampPixel = action.pixel_type;
+    }
+
+    Vec2i pos = action.pos;
+    int radius = action.radius;
+    int x0 = std::max(pos.x - radius, 0);
+    int x1 = std::min(pos.x + radius, m_gridWidth - 1);
+    int y0 = std::max(pos.y - radius, 0);
+    int y1 = std::min(pos.y + radius, m_gridHeight - 1);
+    for (int y = y0; y <= y1; y++) {
+        int dy = y - pos.y;
+        for (int x = x0; x <= x1; x++) {
+            int dx = x - pos.x;
+            if (dx * dx + dy * dy > radius * radius) { continue; }
+
+            uint32_t cell = static_cast<uint32_t>(y * m_gridWidth + x);
+            if (!m_stampMask[cell]) {
+                m_stampMask[cell] = 1;
+                m_stampedCells.push_back(cell);
+            }
+        }
+    }
+}
+
+void PixelGrid::stampLine(DrawLineAction action) {
+    for (Vec2i pos : getLine(action.start, action.end)) {
+        stampCircle(DrawCircle{.pos=pos, .radius=action.width, .pixel_type=action.pixel_type});
+    }
+}
+
+void PixelGrid::stampParallelogram(DrawParallelogramAction action) {
+    std::vector<Vec2i> topLine = getLine(action.cornerTL, action.cornerTR);
+    Vec2i TLtoBL = action.cornerBL - action.cornerTR;
+    for (Vec2i pixelPos : topLine) {
+        stampLine(DrawLineAction{pixelPos, pixelPos + TLtoBL, 1, action.pixel_type});
+    }
+}
+
+void PixelGrid::flushStamps() {
+    for (uint32_t cell : m_stampedCells) {
+        Vec2i pos = Vec2i(static_cast<int>(cell) % m_gridWidth, static_cast<int>(cell) / m_gridWidth);
+        setPixel(SetPixelAction{pos, m_stampPixel});
+        m_stampMask[cell] = 0;
+    }
+    m_stampedCells.clear();
+}
+
+void PixelGrid::drawParallelogram(DrawParallelogramAction action) {
+    stampParallelogram(action);
+    flushStamps();
+}
+
+void PixelGrid::setPixel(SetPixelAction action) {
+    action.pixel_type.properties = pixel_properties::DefaultMaterialProperties[action.pixel_type.material];
+
+    m_pixelGrid[action.pos.x][action.pos.y] = action.pixel_type;       
+    if constexpr (useOccupancyPlanes) {
+        m_occupancy.set(action.pos.x, action.pos.y, action.pixel_type.material);
+    }
+
+    if (bitop::flag_has_mask8(action.pixel_type.properties, pixel_properties::OnFire)) {
+        m_fireMap.insertOrAssign(cellIndex(action.pos), material_properties::materialLookup[action.pixel_type.material].burnProperties);
+    } else {
+        m_fireMap.erase(cellIndex(action.pos));
+    }
+    m_chunkGrid.markDirty(action.pos);
+}
+
+void PixelGrid::m_SetPixelMaterialAndProperties(SetPixelMaterialAndProperties action) {
+    m_pixelGrid[action.pos.x][action.pos.y].material = action.material;
+    m_pixelGrid[action.pos.x][action.pos.y].properties = action.properties;
+    if constexpr (useOccupancyPlanes) {
+        m_occupancy.set(action.pos.x, action.pos.y, action.material);
+    }
+    if (bitop::flag_has_mask8(action.properties, pixel_properties::OnFire)) {
+        if (!m_fireMap.find(cellIndex(action.pos))) {
+            m_fireMap.insertOrAssign(cellIndex(action.pos), material_properties::materialLookup[action.material].burnProperties);
+        }
+    } else {
+        m_fireMap.erase(cellIndex(action.pos));
+    }
+    m_chunkGrid.markDirty(action.pos);
+}
+
+void PixelGrid::trySetPixel(SetPixelAction action) {
+    if (isInBounds(action.pos)) {
+        setPixel(action);
+    };
+}
+
+void PixelGrid::eraseFireInSpan(int x, int y, int count) {
+    if (m_fireMap.empty()) { return; }
+    for (int i = 0; i < count; i++) {
+        if (m_pixelGrid.properties(x + i, y) & pixel_properties::OnFire) {
+            m_fireMap.erase(cellIndex(Vec2i(x + i, y)));
+        }
+    }
+}
+
+void PixelGrid::fillSpan(int x, int y, int count, uint8_t material) {
+    const uint8_t properties = pixel_properties::DefaultMaterialProperties[material];
+    eraseFireInSpan(x, y, count);
+    m_pixelGrid.fillRow(x, y, static_cast<size_t>(count), Pixel{material, m_globalUpdateFrame, properties});
+    if (properties & pixel_properties::OnFire) {
+        const FirePixel fire = material_properties::materialLookup[material].burnProperties;
+        for (int i = 0; i < count; i++) {
+            m_fireMap.insertOrAssign(cellIndex(Vec2i(x + i, y)), fire);
+        }
+    }
+    if constexpr (useOccupancyPlanes) {
+        m_occupancy.setSpan(x, y, count, material);
+    }
+}
+
+void PixelGrid::writeSpan(int x, int y, std::span<const uint8_t> material, std::span<const uint8_t> properties) {
+    const int count = static_cast<int>(material.size());
+    eraseFireInSpan(x, y, count);
+    m_pixelGrid.writeRow(x, y, material, properties, m_globalUpdateFrame);
+    for (int i = 0; i < count; i++) {
+        if (properties[static_cast<size_t>(i)] & pixel_properties::OnFire) {
+            m_fireMap.insertOrAssign(cellIndex(Vec2i(x + i, y)),
+                material_properties::materialLookup[material[static_cast<size_t>(i)]].burnProperties);
+        }
+    }
+    if constexpr (useOccupancyPlanes) {
+        // one span per run of a material
+        int run = 0;
+        while (run < count) {
+            int end = run + 1;
+            while (end < count && material[static_cast<size_t>(end)] == material[static_cast<size_t>(run)]) { end++; }
+            m_occupancy.setSpan(x + run, y, end - run, material[static_cast<size_t>(run)]);
+            run = end;
+        }
+    }
+}
+
+void PixelGrid::fillRect(Vec2i corner, Vec2i size, uint8_t material) {
+    corner -= m_worldOrigin;
+    const int x0 = std::max(corner.x, 0);
+    const int y0 = std::max(corner.y, 0);
+    const int x1 = std::min(corner.x + size.x, m_gridWidth) - 1;
+    const int y1 = std::min(corner.y + size.y, m_gridHeight) - 1;
+    if (x1 < x0 || y1 < y0) { return; }
+
+    for (int y = y0; y <= y1; y++) {
+        fillSpan(x0, y, x1 - x0 + 1, material);
+    }
+    m_chunkGrid.markRectDirty(x0 - ChunkGrid::wakeMargin, y0 - ChunkGrid::wakeMargin,
+                              x1 + ChunkGrid::wakeMargin, y1 + ChunkGrid::wakeMargin);
+}
+
+void PixelGrid::fillPolygon(std::span<const Vec2i> vertices, uint8_t material) {
+    if (vertices.size() < 3) { return; }
+    int minY = m_gridHeight;
+    int maxY = -1;
+    for (Vec2i vertex : vertices) {
+        minY = std::min(minY, vertex.y - m_worldOrigin.y);
+        maxY = std::max(maxY, vertex.y - m_worldOrigin.y);
+    }
+
+    // vertices are cell corners, a row's cells are those whose centres lie
+    // between a pair of the crossings at the height of the centres
+    DirtyRect filled;
+    std::vector<double> crossings;
+    for (int y = std::max(minY, 0); y <= std::min(maxY, m_gridHeight - 1); y++) {
+        const double centreY = y + 0.5;
+        crossings.clear();
+        for (size_t i = 0; i < vertices.size(); i++) {
+            Vec2i a = vertices[i] - m_worldOrigin;
+            Vec2i b = vertices[(i + 1) % vertices.size()] - m_worldOrigin;
+            if ((a.y <= centreY) != (b.y <= centreY)) {
+                crossings.push_back(a.x + (centreY - a.y) * (b.x - a.x) / (b.y - a.y));
+            }
+        }
+        std::sort(crossings.begin(), crossings.end());
+        for (size_t i = 0; i + 1 < crossings.size(); i += 2) {
+            int from = std::max(static_cast<int>(std::ceil(crossings[i] - 0.5)), 0);
+            int to = std::min(static_cast<int>(std::ceil(crossings[i + 1] - 0.5)) - 1, m_gridWidth - 1);
+            if (to < from) { continue; }
+            fillSpan(from, y, to - from + 1, material);
+            filled.include(from, y, to, y);
+        }
+    }
+    if (!filled.empty()) {
+        m_chunkGrid.markRectDirty(filled.minX - ChunkGrid::wakeMargin, filled.minY - ChunkGrid::wakeMargin,
+                                  filled.maxX + ChunkGrid::wakeMargin, filled.maxY + ChunkGrid::wakeMargin);
+    }
+}
+
+Prefab PixelGrid::copyPrefab(Vec2i corner, Vec2i size) const {
+    Prefab prefab(std::max(size.x, 0), std::max(size.y, 0), materials::air, pixel_properties::None);
+    corner -= m_worldOrigin;
+    const int x0 = std::max(corner.x, 0);
+    const int x1 = std::min(corner.x + size.x, m_gridWidth) - 1;
+    if (x1 < x0) { return prefab; }
+    const size_t length = static_cast<size_t>(x1 - x0 + 1);
+    for (int y = std::max(corner.y, 0); y < std::min(corner.y + size.y, m_gridHeight); y++) {
+        size_t start = prefab.index(x0 - corner.x, y - corner.y);
+        m_pixelGrid.readRow(x0, y, std::span(prefab.material).subspan(start, length),
+                            std::span(prefab.properties).subspan(start, length));
+    }
+    return prefab;
+}
+
+void PixelGrid::stampPrefab(Vec2i corner, const Prefab & prefab) {
+    corner -= m_worldOrigin;
+    const int x0 = std::max(corner.x, 0);
+    const int y0 = std::max(corner.y, 0);
+    const int x1 = std::min(corner.x + prefab.width, m_gridWidth) - 1;
+    const int y1 = std::min(corner.y + prefab.height, m_gridHeight) - 1;
+    if (x1 < x0 || y1 < y0) { return; }
+
+    const size_t skipped = static_cast<size_t>(x0 - corner.x);
+    const size_t length = static_cast<size_t>(x1 - x0 + 1);
+    for (int y = y0; y <= y1; y++) {
+        writeSpan(x0, y, prefab.materialRow(y - corner.y).subspan(skipped, length),
+                  prefab.propertiesRow(y - corner.y).subspan(skipped, length));
+    }
+    m_chunkGrid.markRectDirty(x0 - ChunkGrid::wakeMargin, y0 - ChunkGrid::wakeMargin,
+                              x1 + ChunkGrid::wakeMargin, y1 + ChunkGrid::wakeMargin);
+}
+
+std::vector<Vec2i> PixelGrid::getLine(Vec2i start, Vec2i end) {
+    std::vector<Vec2i> resultingPath = {};
+
+    // Extract start and end points
+    int x0 = start.x;
+    int y0 = start.y;
+    int x1 = end.x;
+    int y1 = end.y;
+
+    // Calculate differences
+    int dx = std::abs(x1 - x0);
+    int dy = std::abs(y1 - y0);
+
+    // Determine the direction of the step
+    int sx = (x0 < x1) ? 1 : -1;
+    int sy = (y0 < y1) ? 1 : -1;
+
+    int err = dx - dy;
+
+    int x = x0;
+    int y = y0;
+
+    while (true) {
+        // Set pixel at the current position
+        resultingPath.push_back(Vec2i{x, y});
+        if (x == x1 && y == y1) break;
+
+        int e2 = 2 * err;
+
+        if (e2 > -dy) {
+            err -= dy;
+            x += sx;
+        }
+
+        if (e2 < dx) {
+            err += dx;
+            y += sy;
+        }
+    }
+    return resultingPath;
+}
+
+void PixelGrid::drawLine(DrawLineAction action) {
+    stampLine(action);
+    flushStamps();
+}
+
+void PixelGrid::drawCircle(DrawCircle action) {
+    stampCircle(action);
+    flushStamps();
+}
+
+void PixelGrid::updateDrawBuffer() {
+    CELLSIM_PROFILE_SCOPE("updateDrawBuffer");
+    const bool codes = m_drawFormat == colorize::DrawFormat::cellCodes;
+    if (!codes) {
+        m_palette = colorize::buildPalette(m_fireColor.data());
+    }
+    auto drawRows = [this, codes](int firstRow, int endRow) {
+        if (codes) {
+            cellCodeRows(firstRow, endRow);
+        } else {
+            colorizeRows(firstRow, endRow);
+        }
+    };
+
+    if (m_threadPool) {
+        size_t bandCount = static_cast<size_t>((m_viewSize.y + drawBandRows - 1) / drawBandRows);
+        m_threadPool->parallelFor(bandCount, [&](size_t band, size_t) {
+            int firstRow = static_cast<int>(band) * drawBandRows;
+            drawRows(firstRow, std::min(firstRow + drawBandRows, m_viewSize.y));
+        });
+        return;
+    }
+    drawRows(0, m_viewSize.y);
+}
+
+void PixelGrid::colorizeRows(int firstRow, int endRow) {
+    const size_t viewWidth = static_cast<size_t>(m_viewSize.x);
+#ifdef CELLSIM_AOS_PIXELS
+    for (int y = firstRow; y < endRow; y++) {
+        uint8_t * out = m_buffer.data() + 4 * static_cast<size_t>(y) * viewWidth;
+        for (int x = 0; x < m_viewSize.x; x++) {
+            Pixel pixel = m_pixelGrid.get(m_viewCorner.x + x, m_viewCorner.y + y);
+            uint32_t colour = m_palette[colorize::paletteIndex(pixel.material, pixel.properties)];
+            std::memcpy(out + 4 * static_cast<size_t>(x), &colour, sizeof(colour));
+        }
+    }
+#else
+    // rows are border ring cells apart in the planes, one span per row
+    for (int y = firstRow; y < endRow; y++) {
+        size_t begin = m_pixelGrid.index(m_viewCorner.x, m_viewCorner.y + y);
+        colorize::colorizeSpan(m_pixelGrid.materialPlane().data() + begin,
+                               m_pixelGrid.propertiesPlane().data() + begin,
+                               m_buffer.data() + 4 * static_cast<size_t>(y) * viewWidth, viewWidth, m_palette);
+    }
+#endif
+}
+
+void PixelGrid::cellCodeRows(int firstRow, int endRow) {
+    const size_t viewWidth = static_cast<size_t>(m_viewSize.x);
+#ifdef CELLSIM_AOS_PIXELS
+    for (int y = firstRow; y < endRow; y++) {
+        uint8_t * out = m_buffer.data() + static_cast<size_t>(y) * viewWidth;
+        for (int x = 0; x < m_viewSize.x; x++) {
+            Pixel pixel = m_pixelGrid.get(m_viewCorner.x + x, m_viewCorner.y + y);
+            out[x] = colorize::cellCode(pixel.material, pixel.properties);
+        }
+    }
+#else
+    for (int y = firstRow; y < endRow; y++) {
+        size_t begin = m_pixelGrid.index(m_viewCorner.x, m_viewCorner.y + y);
+        colorize::cellCodeSpan(m_pixelGrid.materialPlane().data() + begin,
+                               m_pixelGrid.propertiesPlane().data() + begin,
+                               m_buffer.data() + static_cast<size_t>(y) * viewWidth, viewWidth);
+    }
+#endif
+}
+
+void PixelGrid::update() {
+    // loops over all pixels in the current pixel grid
+    // executing any actions that are qued from either user input or any
+    // other sources in the game system
+    // then after this is finished call doPhysics()
+
+    doPhysics();
+    // the window moves before actions run, so they land in the cells the
+    // viewport shows
+    if (m_pager) {
+        followViewport();
+    }
+    executeActions(m_commandBuffer);
+    updateDrawBuffer();
+
+    /*std::cout << "done draw buffer\n";*/
+}
+
+void PixelGrid::setPhysicsThreads(int threadCount) {
+    if (threadCount <= 1) {
+        m_threadPool.reset();
+        m_occupancy.setShared(false);
+        return;
+    }
+
+    m_threadPool = std::make_unique<ThreadPool>(static_cast<size_t>(threadCount));
+    m_occupancy.setShared(true);
+}
+
+void PixelGrid::enablePaging(const std::string & pageFile, size_t memoryBudget) {
+    if (m_gridWidth % ChunkGrid::defaultChunkSize != 0 || m_gridHeight % ChunkGrid::defaultChunkSize != 0) {
+        throw std::invalid_argument("PixelGrid::enablePaging: the grid is not a whole number of chunks");
+    }
+    if (m_pager) {
+        throw std::logic_error("PixelGrid::enablePaging: paging is already on");
+    }
+    m_pager = std::make_unique<ChunkPager>(pageFile, memoryBudget);
+    m_pageFile = pageFile;
+    m_pageMemoryBudget = memoryBudget;
+    m_viewTarget = getViewCorner();
+}
+
+namespace {
+
+// rounds towards minus infinity, world cells left of and above the origin are negative
+int floorToMultiple(int value, int step) {
+    int quotient = value / step;
+    if (value % step != 0 && value < 0) { quotient--; }
+    return quotient * step;
+}
+}
+
+void PixelGrid::followViewport() {
+    CELLSIM_PROFILE_SCOPE("followViewport");
+    const int chunkSize = ChunkGrid::defaultChunkSize;
+    // per axis the distance from the view to the nearer window edge, and
+    // where the window goes to centre the view
+    auto edgeDistance = [](int viewStart, int viewSize, int origin, int gridSize) {
+        return std::min(viewStart - origin, origin + gridSize - (viewStart + viewSize));
+    };
+    auto centredOrigin = [&](int viewStart, int viewSize, int gridSize) {
+        return floorToMultiple(viewStart + viewSize / 2 - gridSize / 2, chunkSize);
+    };
+
+    int distanceX = edgeDistance(m_viewTarget.x, m_viewSize.x, m_worldOrigin.x, m_gridWidth);
+    int distanceY = edgeDistance(m_viewTarget.y, m_viewSize.y, m_worldOrigin.y, m_gridHeight);
+    Vec2i centred(centredOrigin(m_viewTarget.x, m_viewSize.x, m_gridWidth),
+                  centredOrigin(m_viewTarget.y, m_viewSize.y, m_gridHeight));
+
+    Vec2i scrollTo = m_worldOrigin;
+    Vec2i prefetchFor = m_worldOrigin;
+    if (distanceX < scrollMarginChunks * chunkSize) { scrollTo.x = centred.x; }
+    if (distanceY < scrollMarginChunks * chunkSize) { scrollTo.y = centred.y; }
+    if (distanceX < prefetchMarginChunks * chunkSize) { prefetchFor.x = centred.x; }
+    if (distanceY < prefetchMarginChunks * chunkSize) { prefetchFor.y = centred.y; }
+
+    if (scrollTo.x != m_worldOrigin.x || scrollTo.y != m_worldOrigin.y) {
+        scrollWorld(scrollTo);
+    } else if (prefetchFor.x != m_worldOrigin.x || prefetchFor.y != m_worldOrigin.y) {
+        prefetchWindow(prefetchFor);
+    }
+
+    m_viewCorner = m_viewTarget - m_worldOrigin;
+    clampViewport();
+}
+
+void PixelGrid::prefetchWindow(Vec2i origin) const {
+    const int chunkSize = ChunkGrid::defaultChunkSize;
+    const int chunksX = m_gridWidth / chunkSize;
+    const int chunksY = m_gridHeight / chunkSize;
+    Vec2i current = m_worldOrigin / chunkSize;
+    Vec2i next = origin / chunkSize;
+    for (int cy = next.y; cy < next.y + chunksY; cy++) {
+        for (int cx = next.x; cx < next.x + chunksX; cx++) {
+            bool resident = cx >= current.x && cx < current.x + chunksX && cy >= current.y && cy < current.y + chunksY;
+            if (!resident) {
+                m_pager->prefetch(ChunkCoord{cx, cy});
+            }
+        }
+    }
+}
+
+void PixelGrid::scrollWorld(Vec2i origin) {
+    const int chunkSize = ChunkGrid::defaultChunkSize;
+    const int chunksX = m_gridWidth / chunkSize;
+    const int chunksY = m_gridHeight / chunkSize;
+    const size_t chunkCells = static_cast<size_t>(chunkSize) * static_cast<size_t>(chunkSize);
+    const Vec2i shift = origin - m_worldOrigin;
+    const Vec2i oldChunk = m_worldOrigin / chunkSize;
+    const Vec2i newChunk = origin / chunkSize;
+    auto inWindow = [&](Vec2i windowChunk, int cx, int cy) {
+        return cx >= windowChunk.x && cx < windowChunk.x + chunksX && cy >= windowChunk.y && cy < windowChunk.y + chunksY;
+    };
+
+    // fire state moves with its cell or leaves with its chunk
+    std::vector<uint32_t> burning;
+    m_fireMap.appendCells(burning);
+    std::vector<std::vector<world_file::FireEntry>> leavingFire(static_cast<size_t>(chunksX * chunksY));
+    FireMap fireMap;
+    for (uint32_t cell : burning) {
+        const FirePixel & fire = *m_fireMap.find(cell);
+        int x = static_cast<int>(cell % static_cast<uint32_t>(m_gridWidth));
+        int y = static_cast<int>(cell / static_cast<uint32_t>(m_gridWidth));
+        Vec2i moved(x - shift.x, y - shift.y);
+        if (isInBounds(moved)) {
+            fireMap.insertOrAssign(cellIndex(moved), fire);
+            continue;
+        }
+        uint32_t local = static_cast<uint32_t>((y % chunkSize) * chunkSize + x % chunkSize);
+        leavingFire[static_cast<size_t>((y / chunkSize) * chunksX + x / chunkSize)].push_back(
+            world_file::FireEntry{local, fire.burnTime, fire.burnPercentageChance, static_cast<uint8_t>(fire.requiresAir)});
+    }
+
+    std::vector<uint8_t> material(std::max(chunkCells, static_cast<size_t>(m_gridWidth)));
+    std::vector<uint8_t> properties(material.size());
+    std::span<uint8_t> chunkMaterial = std::span(material).first(chunkCells);
+    std::span<uint8_t> chunkProperties = std::span(properties).first(chunkCells);
+    const size_t rowLength = static_cast<size_t>(chunkSize);
+
+    for (int cy = 0; cy < chunksY; cy++) {
+        for (int cx = 0; cx < chunksX; cx++) {
+            if (inWindow(newChunk, oldChunk.x + cx, oldChunk.y + cy)) { continue; }
+            for (int row = 0; row < chunkSize; row++) {
+                size_t offset = static_cast<size_t>(row) * rowLength;
+                m_pixelGrid.readRow(cx * chunkSize, cy * chunkSize + row,
+                    chunkMaterial.subspan(offset, rowLength), chunkProperties.subspan(offset, rowLength));
+            }
+            PagedChunk chunk;
+            chunk.material = chunkMaterial[0];
+            chunk.properties = chunkProperties[0];
+            chunk.encoding = world_file::packChunk(chunkMaterial, chunkProperties, chunk.payload)
+                ? world_file::ChunkEncoding::packBits : world_file::ChunkEncoding::uniform;
+            chunk.fire = std::move(leavingFire[static_cast<size_t>(cy * chunksX + cx)]);
+            m_pager->store(ChunkCoord{oldChunk.x + cx, oldChunk.y + cy}, std::move(chunk));
+        }
+    }
+
+    // pixels are moved or paged in whole, they are free to move next tick
+    PixelStorage pixels = makePixelStorage(m_gridWidth, m_gridHeight, Pixel{materials::air, m_globalUpdateFrame, pixel_properties::None});
+    int x0 = std::max(0, shift.x);
+    int x1 = std::min(m_gridWidth, m_gridWidth + shift.x);
+    int y0 = std::max(0, shift.y);
+    int y1 = std::min(m_gridHeight, m_gridHeight + shift.y);
+    if (x0 < x1) {
+        size_t length = static_cast<size_t>(x1 - x0);
+        for (int y = y0; y < y1; y++) {
+            m_pixelGrid.readRow(x0, y, std::span(material).first(length), std::span(properties).first(length));
+            pixels.writeRow(x0 - shift.x, y - shift.y,
+                std::span<const uint8_t>(material).first(length), std::span<const uint8_t>(properties).first(length),
+                m_globalUpdateFrame);
+        }
+    }
+
+    for (int cy = 0; cy < chunksY; cy++) {
+        for (int cx = 0; cx < chunksX; cx++) {
+            if (inWindow(oldChunk, newChunk.x + cx, newChunk.y + cy)) { continue; }
+            std::optional<PagedChunk> chunk = m_pager->take(ChunkCoord{newChunk.x + cx, newChunk.y + cy});
+            if (!chunk) { continue; }
+
+            if (chunk->encoding == world_file::ChunkEncoding::uniform) {
+                for (int row = 0; row < chunkSize; row++) {
+                    pixels.fillRow(cx * chunkSize, cy * chunkSize + row, rowLength,
+                        Pixel{chunk->material, m_globalUpdateFrame, chunk->properties});
+                }
+            } else {
+                if (!world_file::unpackChunk(chunk->payload, chunkMaterial, chunkProperties)) {
+                    throw std::runtime_error("chunk_pager: a paged chunk does not decode");
+                }
+                for (int row = 0; row < chunkSize; row++) {
+                    size_t offset = static_cast<size_t>(row) * rowLength;
+                    pixels.writeRow(cx * chunkSize, cy * chunkSize + row,
+                        std::span<const uint8_t>(chunkMaterial).subspan(offset, rowLength),
+                        std::span<const uint8_t>(chunkProperties).subspan(offset, rowLength),
+                        m_globalUpdateFrame);
+                }
+            }
+            for (const world_file::FireEntry & entry : chunk->fire) {
+                Vec2i pos(cx * chunkSize + static_cast<int>(entry.cell) % chunkSize,
+                          cy * chunkSize + static_cast<int>(entry.cell) / chunkSize);
+                fireMap.insertOrAssign(cellIndex(pos), FirePixel{entry.burnTime, entry.burnPercentageChance, entry.requiresAir != 0});
+            }
+        }
+    }
+
+    m_pixelGrid = std::move(pixels);
+    m_fireMap = std::move(fireMap);
+    m_worldOrigin = origin;
+    // every cell moved, so every chunk is swept and redrawn once
+    m_chunkGrid.markAllDirty();
+    rebuildOccupancy();
+    resetFallSpeeds();
+}
+
+void PixelGrid::loadWorld(const std::string & path) {
+    if (m_recorder) {
+        throw std::runtime_error("world_file: cannot load " + path + " while recording, the log would replay on the old world");
+    }
+    world_file::MappedWorld world(path);
+    const world_file::Header & header = world.header();
+
+    const int width = static_cast<int>(header.width);
+    const int height = static_cast<int>(header.height);
+    const Pixel fill{materials::air, header.globalUpdateFrame, pixel_properties::None};
+
+    if (m_pager && (width % ChunkGrid::defaultChunkSize != 0 || height % ChunkGrid::defaultChunkSize != 0)) {
+        throw std::runtime_error("world_file: " + path + " is not a whole number of chunks and cannot be paged");
+    }
+
+    for (size_t i = 0; i < header.fireCount; i++) {
+        if (world.fire(i).cell >= static_cast<uint64_t>(width) * static_cast<uint64_t>(height)) {
+            throw std::runtime_error("world_file: " + path + ": fire outside the world");
+        }
+    }
+
+    // decoded into a new grid so a corrupt chunk leaves the current world alone
+    PixelStorage pixels = makePixelStorage(width, height, fill);
+    std::atomic<bool> corrupt{false};
+
+    auto loadChunk = [&](size_t index, std::vector<uint8_t> & material, std::vector<uint8_t> & properties) {
+        world_file::ChunkEntry entry = world.chunk(index);
+        world_file::MappedWorld::ChunkBounds bounds = world.chunkBounds(index);
+        size_t rowLength = static_cast<size_t>(bounds.width);
+
+        if (entry.encoding == world_file::ChunkEncoding::uniform) {
+            Pixel pixel{entry.material, header.globalUpdateFrame, entry.properties};
+            // the grid was created full of fill
+            if (pixel.material == fill.material && pixel.properties == fill.properties) { return; }
+            for (int row = 0; row < bounds.height; row++) {
+                pixels.fillRow(bounds.x0, bounds.y0 + row, rowLength, pixel);
+            }
+            return;
+        }
+
+        size_t cellCount = rowLength * static_cast<size_t>(bounds.height);
+        material.resize(cellCount);
+        properties.resize(cellCount);
+        if (!world.decodeChunk(index, material, properties)) {
+            corrupt.store(true, std::memory_order_relaxed);
+            return;
+        }
+        for (int row = 0; row < bounds.height; row++) {
+            size_t offset = static_cast<size_t>(row) * rowLength;
+            pixels.writeRow(bounds.x0, bounds.y0 + row,
+                std::span<const uint8_t>(material).subspan(offset, rowLength),
+                std::span<const uint8_t>(properties).subspan(offset, rowLength),
+                header.globalUpdateFrame);
+        }
+    };
+
+    if (m_threadPool) {
+        // chunks cover disjoint cells, so they decode in any order
+        std::vector<std::vector<uint8_t>> materialScratch(m_threadPool->threadCount());
+        std::vector<std::vector<uint8_t>> propertiesScratch(m_threadPool->threadCount());
+        m_threadPool->parallelFor(world.chunkCount(), [&](size_t index, size_t threadIndex) {
+            loadChunk(index, materialScratch[threadIndex], propertiesScratch[threadIndex]);
+        });
+    } else {
+        std::vector<uint8_t> materialScratch;
+        std::vector<uint8_t> propertiesScratch;
+        for (size_t index = 0; index < world.chunkCount(); index++) {
+            loadChunk(index, materialScratch, propertiesScratch);
+        }
+    }
+    if (corrupt.load()) {
+        throw std::runtime_error("world_file: " + path + ": corrupt chunk");
+    }
+
+    FireMap fireMap;
+    for (size_t i = 0; i < header.fireCount; i++) {
+        world_file::FireEntry entry = world.fire(i);
+        int x = static_cast<int>(entry.cell % header.width);
+        int y = static_cast<int>(entry.cell / header.width);
+        if (!(pixels.properties(x, y) & pixel_properties::OnFire)) {
+            throw std::runtime_error("world_file: " + path + ": fire on a pixel that is not burning");
+        }
+        fireMap.insertOrAssign(entry.cell, FirePixel{entry.burnTime, entry.burnPercentageChance, entry.requiresAir != 0});
+    }
+
+    bool resized = width != m_gridWidth || height != m_gridHeight;
+    m_gridWidth = width;
+    m_gridHeight = height;
+    m_pixelGrid = std::move(pixels);
+    m_fireMap = std::move(fireMap);
+    m_randomSeed = header.randomSeed;
+    m_tickCount = header.tickCount;
+    m_globalUpdateFrame = header.globalUpdateFrame;
+
+    // actions queued for the old world do not apply to this one
+    m_commandBuffer.reset();
+    if (m_pager) {
+        // the chunks paged out belong to the old world, the view target stays
+        // and the window scrolls to it again
+        m_worldOrigin = Vec2i(0, 0);
+        // the old pager removes its page file before the new one creates it
+        m_pager.reset();
+        m_pager = std::make_unique<ChunkPager>(m_pageFile, m_pageMemoryBudget);
+    }
+    m_chunkGrid = ChunkGrid(m_gridWidth, m_gridHeight);
+    m_chunkGrid.markAllDirty();
+    rebuildOccupancy();
+    resetFallSpeeds();
+    // reloading a world of the same size keeps the big per cell buffers and
+    // the viewport, a world of another size is shown whole
+    if (resized) {
+        initStampMask();
+        setViewport(Vec2i(0, 0), Vec2i(m_gridWidth, m_gridHeight));
+    }
+}
+
+world_file::WorldSnapshot PixelGrid::snapshotWorld() const {
+    world_file::WorldSnapshot world;
+    world.width = m_gridWidth;
+    world.height = m_gridHeight;
+    world.chunkSize = ChunkGrid::defaultChunkSize;
+    world.globalUpdateFrame = m_globalUpdateFrame;
+    world.randomSeed = m_randomSeed;
+    world.tickCount = m_tickCount;
+
+    size_t rowLength = static_cast<size_t>(m_gridWidth);
+    world.material.resize(rowLength * static_cast<size_t>(m_gridHeight));
+    world.properties.resize(rowLength * static_cast<size_t>(m_gridHeight));
+    for (int row = 0; row < m_gridHeight; row++) {
+        size_t offset = static_cast<size_t>(row) * rowLength;
+        m_pixelGrid.readRow(0, row,
+            std::span(world.material).subspan(offset, rowLength),
+            std::span(world.properties).subspan(offset, rowLength));
+    }
+
+    std::vector<uint32_t> cells;
+    m_fireMap.appendCells(cells);
+    std::sort(cells.begin(), cells.end());
+    world.fire.reserve(cells.size());
+    for (uint32_t cell : cells) {
+        world.fire.emplace_back(cell, *m_fireMap.find(cell));
+    }
+    return world;
+}
+
+void PixelGrid::startRecording(const std::string & path) {
+    if (m_pager) {
+        throw std::runtime_error("action_log: paged worlds cannot be recorded, the log only replays the resident window");
+    }
+    stopRecording();
+    saveWorld(path + ".world");
+    // world files hold no fall speeds, the replay starts without them too
+    resetFallSpeeds();
+
+    action_log::Header header{};
+    std::memcpy(header.magic, action_log::magic, sizeof(action_log::magic));
+    header.version = action_log::version;
+    header.width = static_cast<uint32_t>(m_gridWidth);
+    header.height = static_cast<uint32_t>(m_gridHeight);
+    header.parallelPhysics = m_threadPool ? 1 : 0;
+    header.boundaryMode = static_cast<uint8_t>(m_boundaryMode);
+    header.randomSeed = m_randomSeed;
+    header.startTick = m_tickCount;
+    m_recorder = std::make_unique<action_log::ActionRecorder>(path, header);
+
+    m_commandBuffer.forEach([this](const auto & command) {
+        m_recorder->record(m_tickCount, Action(command));
+    });
+}
+
+void PixelGrid::stopRecording() {
+    if (m_recorder) {
+        m_recorder->finish(m_tickCount);
+        m_recorder.reset();
+    }
+}
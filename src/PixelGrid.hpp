@@ -1,24 +1,42 @@
 #include "Materials.h"
 #include "Vec2.hpp"
-// #include "imgui-SFML.h"
-#include <SFML/Config.hpp>
+#include <array>
 #include <cmath>
 #include <cstddef>
 #include <cstdint>
+#include <future>
 #include <iostream>
-// #include <memory>
+#include <memory>
+#include <mutex>
 #include <random>
+#include <span>
 #include <iostream>
 #include <stdexcept>
+#include <string>
 #include <strings.h>
 #include <sys/types.h>
+#include <type_traits>
 #include <utility>
 #include <variant>
 #include <vector>
 #include "BitOperationHelpers.hpp"
 #include "maybeResult.hpp"
 #include "PixelGridContainer.hpp"
+#include "PixelPlaneContainer.hpp"
+#include "ChunkGrid.hpp"
+#include "ThreadPool.hpp"
+#include "CellRandom.hpp"
 #include "action_types.h"
+#include "CommandBuffer.hpp"
+#include "Colorize.hpp"
+#include "FireMap.hpp"
+#include "WorldFile.hpp"
+#include "ActionLog.hpp"
+#include "ChunkPager.hpp"
+#include "OccupancyPlanes.hpp"
+#include "Prefab.hpp"
+#include "ImageImport.hpp"
+#include "MovementRules.hpp"
 
 #pragma once
 
@@ -27,44 +45,157 @@
 // need to test this to find out whether it is faster or not 
 // using a 2D vector simplifies the program and is more intuitive
 
-// Custom game colors
-const sf::Color GrassGreen(106, 190, 48);          // Lush grass
-const sf::Color DirtBrown(155, 118, 83);           // Soil or dirt
-const sf::Color WaterBlue(64, 164, 223, 200);      // Semi-transparent water
-const sf::Color LavaOrange(255, 69, 0);            // Hot lava
-const sf::Color SandYellow(237, 201, 175);         // Sandy ground
-const sf::Color FireYellow(255, 200, 0, 220);      // Flickering fire (semi-transparent)
-const sf::Color SmokeGray(96, 96, 96, 150);        // Translucent smoke
-const sf::Color MetalGray(127, 128, 128);           // Metal surfaces
+// define CELLSIM_AOS_PIXELS to store one Pixel struct per cell instead of
+// separate planes, useful to benchmark the two layouts against each other
+#ifdef CELLSIM_AOS_PIXELS
+using PixelStorage = PixelPlaneContainer<pixel_layout::AoS>;
+#else
+using PixelStorage = PixelPlaneContainer<pixel_layout::SoA>;
+#endif
 
 
 class PixelGrid
 {
     public:
     // bool updated {false};
-    PixelGridContainer<Pixel>     m_pixelGrid;
-    PixelGridContainer<Vec2f>     m_velocityField;
-    PixelGridContainer<FirePixel> m_fireField;
+    PixelStorage                  m_pixelGrid;
+    FireMap                       m_fireMap;
+    ChunkGrid                     m_chunkGrid;
 
     int m_gridWidth;
     int m_gridHeight;
     std::vector<SetPixelAction> m_SetPixelQueue;
     std::vector<std::uint8_t> m_buffer;
 
-    std::vector<ActionIncludingPair> m_actionQueue;
-
-    FirePixel m_nullFire = material_properties::nullBurnProperties;
-
-    std::mt19937 m_randomGen;
+    // the cells m_buffer shows, see setViewport
+    Vec2i m_viewCorner {0, 0};
+    Vec2i m_viewSize {0, 0};
+    // the corner last asked for in world cells, with paging on the grid
+    // scrolls until m_viewCorner can show it
+    Vec2i m_viewTarget {0, 0};
+
+    // with paging on the grid is a window onto an unbounded world, see
+    // enablePaging. m_worldOrigin is the world cell at the grid's (0, 0)
+    // and always a whole number of chunks.
+    std::unique_ptr<ChunkPager> m_pager;
+    Vec2i       m_worldOrigin {0, 0};
+    std::string m_pageFile;
+    size_t      m_pageMemoryBudget = 0;
+
+    // user actions for the next stepActions(), see CommandBuffer.hpp
+    CommandBuffer m_commandBuffer;
+
+    // Consecutive brush stamps of the same pixel are unioned in m_stampMask
+    // and every covered cell is written once when the run ends, rather than
+    // once per overlapping stamp.
+    std::vector<uint8_t>  m_stampMask;
+    std::vector<uint32_t> m_stampedCells;
+    Pixel                 m_stampPixel{};
+
+    // burning pixels that move during a parallel sweep carry their fire
+    // state across chunks, the map is only touched under this lock
+    std::unique_ptr<std::mutex> m_fireMutex = std::make_unique<std::mutex>();
+
+    // the cells the fire pass visits, copied out of m_fireMap each tick
+    std::vector<uint32_t> m_burningCells;
+
+    // Speed of the cells that fell freely last tick, see fall(). Only
+    // falling cells have one. m_fallSpeeds is sorted by cell and only read
+    // during the sweep, the cells falling this tick are collected per chunk
+    // swept, so sweep workers never share a list, and replace it afterwards.
+    struct FallingCell {
+        uint32_t cell;
+        uint8_t  material; // a cell that was swapped away is not taken for its replacement
+        uint8_t  speed;
+    };
+    std::vector<FallingCell> m_fallSpeeds;
+    std::vector<std::vector<FallingCell>> m_fallingByChunk;
+
+    // which cells are gas, powder, each liquid or falling, 64 cells to a
+    // word, see OccupancyPlanes.hpp. Define CELLSIM_SCALAR_SWEEP to run the
+    // movement rules on every cell of an awake chunk instead, so simbench
+    // can compare the two. The flag chain is kept as it was and does too.
+#if defined(CELLSIM_SCALAR_SWEEP) || defined(CELLSIM_FLAG_CHAIN_DISPATCH)
+    static constexpr bool useOccupancyPlanes = false;
+#else
+    static constexpr bool useOccupancyPlanes = true;
+#endif
+    OccupancyPlanes m_occupancy;
+
+    // every userAction is logged here while a recording runs, see ActionLog.hpp
+    std::unique_ptr<action_log::ActionRecorder> m_recorder;
+
+    // physics randomness is a hash of (seed, cell, tick), see CellRandom.hpp
+    uint64_t m_randomSeed = 0;
+    uint64_t m_tickCount = 0;
+
+    // parallel physics, a single thread (no pool) runs the reference sweep
+    std::unique_ptr<ThreadPool>  m_threadPool;
+    std::vector<std::pair<int, int>> m_passChunks;
 
     uint8_t m_globalUpdateFrame = 0;
 
+    // Cells only swept in dirty rects keep the frame of the last tick they
+    // were, and the 8 bit frame comes round again every 256 ticks, when such
+    // a cell would be taken for one already moved this tick. Every
+    // updateFrameRenewal ticks each cell is given the frame before, so no
+    // stamp is older than that when its frame comes round again.
+    static constexpr int updateFrameRenewal = 128;
+
     // Define colors per material in RGBA, 4 bytes per material
     // Indexing: materialToColor_c[material * 4 + 0..3]
 
     std::vector<std::uint8_t> m_fireColor = {189, 84, 40, 180};
+
+    // rebuilt from the material colours and m_fireColor every draw
+    colorize::Palette m_palette{};
+
+    // what updateDrawBuffer writes, see setDrawFormat
+    colorize::DrawFormat m_drawFormat = colorize::DrawFormat::rgba;
+
+    // What lies past the edge of the grid. A wall stops everything as stone
+    // would, a void swallows any cell that moves into it.
+    enum class BoundaryMode : uint8_t {
+        wall,
+        voidEdge,
+    };
+    BoundaryMode m_boundaryMode = BoundaryMode::wall;
+
+    // what fills the border ring of each mode
+    static constexpr uint8_t wallMaterial = materials::stone;
+    static constexpr uint8_t voidMaterial = materials::air;
+
+    // How powders and liquids pick their move. Branching probes the
+    // neighbours one by one as the rules ask for them, the neighbourhood
+    // table gathers every neighbour the rules could look at into a
+    // signature and looks the move up, see MovementRules.hpp. Both make the
+    // same moves.
+    enum class MovementRules : uint8_t {
+        branching,
+        neighbourhoodTable,
+    };
+    MovementRules m_movementRules = MovementRules::branching;
+
+    // The pixel planes are surrounded by a ring of sentinel cells this wide,
+    // enough for the furthest neighbour a movement rule probes (gas looks two
+    // cells aside and then one up), so the rules index without bounds checks.
+    // Only falling looks further and it stops at the last row itself.
+    static constexpr int borderWidth = 3;
     private:
 
+    // stone for a wall, air for a void, then swapPixels takes out whatever moves in
+    Pixel borderPixel() const {
+        return m_boundaryMode == BoundaryMode::wall
+            ? Pixel{wallMaterial, 0, pixel_properties::DefaultMaterialProperties[wallMaterial]}
+            : Pixel{voidMaterial, 0, pixel_properties::None};
+    }
+
+    // a grid of initial cells with the border ring of the boundary mode
+    PixelStorage makePixelStorage(int width, int height, Pixel initial) const {
+        return PixelStorage(width, height, initial, borderWidth, borderPixel());
+    }
+
+    // only for positions from the public API, the physics reads the ring instead
     bool isInBounds(Vec2i pos) const {
         if (pos.x < 0 || pos.x >= m_gridWidth) {
             /*pos.print();*/
@@ -78,634 +209,309 @@ class PixelGrid
     }
 
     template<typename T>
-    static T selectRandomElement(std::vector<T> & vec, std::mt19937 randomGen)  {
+    static T selectRandomElement(std::span<const T> vec, CellRandom & random)  {
         size_t vectorLength = vec.size();
         if (vectorLength == 1) {
             return vec[0];
         }
-        size_t index = std::uniform_int_distribution<size_t>(0, vectorLength - 1) (randomGen);
+        size_t index = random.below(static_cast<uint32_t>(vectorLength));
         return vec[index];
     }
 
-    maybeResult<Vec2i> generalSandPhysics(Vec2i currentPosition) const {
-        const Vec2i down = Vec2i(0,1);
-        const Vec2i downRight = Vec2i(1,1);
-        const Vec2i downLeft = Vec2i(-1,1);
-        const Vec2i right = Vec2i(1,0);
-        const Vec2i left = Vec2i(-1,0);
-
-        auto f_checkPos = [&currentPosition, this](Vec2i movement) {
-            return (safeShouldSwapGasses(currentPosition, movement));
-        };
-
-        if (f_checkPos(down)) 
-        {
-            return maybeResult(currentPosition + down);
-        } 
-        else if (f_checkPos(right) && f_checkPos(downRight)) 
-        {
-            return maybeResult(currentPosition + downRight);
-        } 
-        else if (f_checkPos(left) && f_checkPos(downLeft)) 
-        {
-            return maybeResult(currentPosition + downLeft);
-        } 
-        else 
-        {
-            return maybeResult<Vec2i>();
-        }
-    }
+    maybeResult<Vec2i> generalSandPhysics(Vec2i currentPosition) const;
 
-    bool isDenserThanTarget(int density, Vec2i target) const {
-        int targetDensity = material_properties::materialLookup[getPixelConst(target).material].density;
+    bool isDenserThanTarget(int density, Vec2i target) const;
 
-        return (density > targetDensity);
-    }
+    bool safeShouldSwapGasses(Vec2i currentPosition, Vec2i movement) const;
 
-    bool safeShouldSwapGasses(Vec2i currentPosition, Vec2i movement) const {
-        if(!isInBounds(currentPosition + movement)){
-            return false;
-        };
-
-        Pixel currentPixel = getPixelConst(currentPosition);
-        Pixel targetPixel = getPixelConst(currentPosition + movement);
-        if (hasProperty(targetPixel.material, material_properties::IsLiquid)) {
-            return (isDenserThanTarget(material_properties::materialLookup[currentPixel.material].density, currentPosition + movement));
-        } else {
-            return (checkIsGas(currentPosition + movement));
-        }
-    }
+    maybeResult<Vec2i> generalGasMovementHorizontalDelta(Vec2i currentPosition, CellRandom & random, Pixel pixelToMove) const;
 
-    maybeResult<Vec2i> generalGasMovementHorizontalDelta(Vec2i currentPosition, std::mt19937 & randomGen, Pixel pixelToMove) const {
-        const Vec2i right = {1,0};
-        const Vec2i left = {-1,0};
-        const Vec2i right2 = 2 * right;
-        const Vec2i left2 = 2 * left; 
+    maybeResult<Vec2i> generalGasMovementVerticalDelta(Vec2i currentPosition, Pixel pixelToMove) const;
 
-        auto f_checkPos = [&pixelToMove, &currentPosition, this](Vec2i movement) {
-            if (!isInBounds(currentPosition + movement)) { return false; }
+    maybeResult<Vec2i> generalWaterPhysics(Vec2i currentPosition, CellRandom & random) const;
 
-            const Pixel& candidatePixel = getPixelConst(currentPosition + movement);
+    maybeResult<Vec2i> generalFallingPhysics(Vec2i currentPosition) const;
 
-            if (pixelToMove.material != candidatePixel.material && hasProperty(candidatePixel.material, material_properties::IsGas)) {
-                return true;
-            }
-            return false;
-        };
-
-        if (std::uniform_int_distribution<>(0, 1)(randomGen)) {
-            if (f_checkPos(right)) 
-            {
-                return f_checkPos(right2) ? maybeResult(right2) : maybeResult(right);
-            } 
-            else if (f_checkPos(left))
-            {
-                return f_checkPos(left2) ? maybeResult(left2) : maybeResult(left);
-            }
-        } else 
-        {
-            if (f_checkPos(left))
-            {
-                return f_checkPos(left2) ? maybeResult(left2) : maybeResult(left);
-            }
-            else if (f_checkPos(right)) 
-            {
-                return f_checkPos(right2) ? maybeResult(right2) : maybeResult(right);
-            } 
-        }
-        return maybeResult<Vec2i>();
-    }
-
-    maybeResult<Vec2i> generalGasMovementVerticalDelta(Vec2i currentPosition, Pixel pixelToMove) const {
-        const Vec2i up = {0,-1};
-
-
-        auto f_checkPosGas = [&pixelToMove, &currentPosition, this](Vec2i movement) {
-            if (!isInBounds(currentPosition + movement)) {
-                return false;
-            }
-            const Pixel& candidatePixel = getPixelConst(currentPosition + movement);
-            return (pixelToMove.material != candidatePixel.material && hasProperty(candidatePixel.material, material_properties::IsGas));
-        };
-
-        auto f_checkPosDensityUnsafe = [&pixelToMove, &currentPosition, this](Vec2i movement) {
-            const Pixel& candidatePixel = getPixelConst(currentPosition + movement);
-
-            return (material_properties::materialLookup[pixelToMove.material].density < material_properties::materialLookup[candidatePixel.material].density);
-        };
-
-        auto f_checkPos = [&f_checkPosGas, &f_checkPosDensityUnsafe](Vec2i movement) {return f_checkPosGas(movement) && f_checkPosDensityUnsafe(movement);};
-
-        return (f_checkPos(up) ? maybeResult(up) : maybeResult<Vec2i>());
-    }
-
-    maybeResult<Vec2i> generalWaterPhysics(Vec2i currentPosition, std::mt19937 & randomGen) const {
-        const Vec2i right = Vec2i(1,0);
-        const Vec2i right2 = Vec2i(2,0);
-        const Vec2i left = Vec2i(-1,0);
-        const Vec2i left2 = Vec2i(-2,0);
-        const Vec2i down = Vec2i(0,1);
-
-        auto f_checkPos = [&currentPosition, this](Vec2i movement) {
-            return (safeCheckIsGas(currentPosition + movement));
-        };
-
-        bool rightClear = f_checkPos(right);
-        bool leftClear = f_checkPos(left);
-        bool left2clear = f_checkPos(left2);
-        bool right2Clear = f_checkPos(right2);
-
-        bool prefferedDirection = std::uniform_int_distribution<>(0,1)(randomGen);
-
-        if (rightClear && leftClear) {
-            if (right2Clear && left2clear) {
-                return maybeResult(currentPosition + (prefferedDirection ? left : right));
-            } else if (right2Clear) {
-                return maybeResult(currentPosition + right2);
-            } else if (left2clear) {
-                return maybeResult(currentPosition + left2);
-            }
-            return maybeResult(currentPosition + (prefferedDirection ? left : right));
-        } else if (rightClear) {
-            if (right2Clear) {
-                return maybeResult(currentPosition + right2);
-            }
-            return maybeResult(currentPosition + right);
-        } else if (leftClear) {
-            if (left2clear) {
-                return maybeResult(currentPosition + left2);
-            }
-            return maybeResult(currentPosition + left);
-        }
-
-        return maybeResult<Vec2i>();
-    }
-
-    maybeResult<Vec2i> generalFallingPhysics(Vec2i currentPosition) const {
-        const Vec2i down = Vec2i(0,1);
-
-        auto f_checkPos = [&currentPosition, this](Vec2i movement) {
-            return (safeCheckIsGas(currentPosition + movement));
-        };
-
-        if (f_checkPos(down)) {
-            return maybeResult(currentPosition + down);
-        }
-        else { return maybeResult<Vec2i>(); }
-    }
-
-    const Pixel& getPixelConst(Vec2i pos) const {
-        return m_pixelGrid[pos.x][pos.y];
+    Pixel getPixelConst(Vec2i pos) const {
+        return m_pixelGrid.get(pos.x, pos.y);
     }
 
 
 
-    Pixel& getPixelRef(Vec2i pos) {
-        return m_pixelGrid[pos.x][pos.y];
+    PixelRef getPixelRef(Vec2i pos) {
+        return m_pixelGrid.ref(pos.x, pos.y);
     }
 
-    maybeResult<ActionIncludingPair> generalFireSpreadPhysics(Vec2i pos, std::mt19937 & randomGen) const {
-        std::vector<Vec2i> neighborDelta = {
-            Vec2i(1,0), Vec2i(1,-1), 
-            Vec2i(0,-1), Vec2i(-1,-1), 
-            Vec2i(-1,0), Vec2i(-1,1), 
-            Vec2i(0,1), Vec2i(1,1)
-        };
+    maybeResult<ActionIncludingPair> generalFireSpreadPhysics(Vec2i pos, CellRandom & random) const;
 
-        Pixel thisPixel = m_pixelGrid[pos.x][pos.y];
-        if (bitop::flag_has_mask(thisPixel.properties, pixel_properties::OnFire)) {
-
-            FirePixel burnProperties = material_properties::materialLookup[thisPixel.material].burnProperties;
-            if (m_fireField[pos.x][pos.y].burnPercentageChance > std::uniform_int_distribution<>(0,99)(randomGen)) {
-                Vec2i dPos = selectRandomElement(neighborDelta, randomGen);
-                if (!isInBounds(pos + dPos)   ) {
-                    return ( maybeResult<m_IgniteAction>() );
-                }
-                const Pixel candidatePixel = getPixelConst(pos + dPos);
-                const uint8_t & candiateMaterial = candidatePixel.material;
-                bool flammable = hasProperty(candiateMaterial, material_properties::Flammable);
-                return (flammable && !bitop::flag_has_mask(candidatePixel.properties, pixel_properties::OnFire)
-                ? maybeResult(m_IgniteAction{burnProperties, pos + dPos}) 
-                : maybeResult<m_IgniteAction>());
-            }
-        }
-        return maybeResult<m_IgniteAction>();
-    }
-
-    constexpr std::array<Vec2i, 48> neighboringDeltas() const {
-        int deltas[7] = {-3,-2,-1,0,1,2,3};
-
-        size_t count = 0;
-        std::array<Vec2i, 48> neighbors;
-        for (int i = 0; i < 3; i++) {
-            for (int j = 0; j < 3; j++) {
-                if ((i==0) && (j==0)) {continue;}
-                neighbors[count] = Vec2i(deltas[i], deltas[j]);
-                count ++;
-            }
-        }
+    // the eight cells touching a pixel
+    static constexpr std::array<Vec2i, 8> neighbourDeltas = {
+        Vec2i(1,0), Vec2i(1,-1),
+        Vec2i(0,-1), Vec2i(-1,-1),
+        Vec2i(-1,0), Vec2i(-1,1),
+        Vec2i(0,1), Vec2i(1,1)
+    };
 
-        return neighbors;
-     }
-    
-    maybeResult<ActionIncludingPair> generalFireInteractionPhysics(Vec2i pos) {
-        std::array<Vec2i, 48> neighbors = neighboringDeltas();
+    // first reaction for trigger between the pixel at pos and one of its neighbours
+    maybeResult<ActionIncludingPair> findReaction(Vec2i pos, material_reactions::Trigger trigger) const;
 
-        Pixel thisPixel = m_pixelGrid[pos.x][pos.y];
-        for (Vec2i neighborDelta : neighbors) {
-            Vec2i targetPos= neighborDelta + pos;
-            if(!isInBounds(targetPos)) {continue;};
-            Pixel targetPixel = m_pixelGrid[targetPos.x][targetPos.y];
-            auto reaction = material_reactions::on_fire_reactions.find(std::pair(thisPixel.material, targetPixel.material));
-            if (reaction != material_reactions::on_fire_reactions.end()) {
-                SetPixelMaterialAndProperties a1 = {pos, reaction->second.first.material, reaction->second.first.properties};
-                SetPixelMaterialAndProperties a2 = {targetPos, reaction->second.second.material, reaction->second.second.properties};
-                return maybeResult(ActionPair({a1, a2}));
-            }
-        };
-        return maybeResult<ActionIncludingPair>();
-    }
+    maybeResult<ActionIncludingPair> generalFireInteractionPhysics(Vec2i pos);
 
 
     bool checkIsGas(Vec2i pos) const {
-        return (hasProperty(m_pixelGrid[pos.x][pos.y].material, material_properties::IsGas));
+        return (hasProperty(m_pixelGrid.material(pos.x, pos.y), material_properties::IsGas));
     };
 
-    bool safeCheckIsGas(Vec2i pos) const {
-        if (isInBounds(pos)) {
-            return checkIsGas(pos);
-        } 
-        return false;
-    }
+    bool safeCheckIsGas(Vec2i pos) const;
 
     bool hasProperty(uint8_t material, material_properties::PixelFlags property) const {
         return bitop::flag_has_mask(material_properties::materialLookup[material].flags, property);
     }
 
-    void doPhysics() {
-        m_globalUpdateFrame ++;
-        bool n2 = bitop::check_nth_bit(m_globalUpdateFrame, 1);
-        if (bitop::check_nth_bit(m_globalUpdateFrame, 0)) {
-            for (int xi = 0; xi < m_gridWidth; xi++) {
-                if (n2) {
-                    for (int yi = 0; yi < m_gridHeight; yi ++) {
-                        doPhysicsOnPixel(xi, yi, m_randomGen);
-                    }
-                } else {
-                    for (int yi = m_gridHeight - 1; yi !=0; yi --) {
-                        doPhysicsOnPixel(xi,yi, m_randomGen);
-                    }
-                }
-            }
-        } else {
-            for (int xi = m_gridWidth - 1; xi !=0; xi --) {
-                if (n2) {
-                    for (int yi = 0; yi < m_gridHeight; yi ++) {
-                        doPhysicsOnPixel(xi,yi, m_randomGen);
-                    }
-                } else {
-                    for (int yi = m_gridHeight - 1; yi !=0; yi --) {
-                        doPhysicsOnPixel(xi,yi, m_randomGen);
-                    }
-                }
-            }
-        }
-    }
+    // a cell falling through gas gains fallAcceleration cells per tick of
+    // speed every tick, up to maxFallSpeed
+    static constexpr int fallAcceleration = 1;
+    static constexpr int maxFallSpeed = 16;
 
-    void doPhysicsOnPixel(int col, int row, std::mt19937 & randomGen)
-    {
-        // the pixel must have a path to move through if it moves diagonally
-        // othersie it seemingly phases through containers
+    // the furthest from its own position a pixel reads or writes during
+    // doPhysicsOnPixel, falling cells look maxFallSpeed cells down. Fire
+    // looks further but runs in its own single threaded pass.
+    static constexpr int physicsHalo = maxFallSpeed;
+    static_assert(ChunkGrid::defaultChunkSize >= 2 * physicsHalo,
+        "chunks swept in the same parallel pass must not share halo cells");
 
-        // assumption in all our next position functions, they cant returrn the same position they were given otherwise
-        // that pixel would just be set to air, the maybe type is to represent the case that the function does not find
-        // a new place to put the pixel
+    void doPhysics();
 
-        Pixel currentPixel = m_pixelGrid[col][row];
+    // Pixels never reach further than physicsHalo from where they start, so
+    // chunks two apart in both directions never touch the same cells. Each of
+    // the four passes sweeps one chunk parity (a checkerboard) on the pool.
+    void doPhysicsParallel(bool xAscending, bool yAscending);
 
+    // row by row, the pixel planes are row major
+    void sweepRect(const DirtyRect & rect, bool xAscending, bool yAscending);
 
-        if (currentPixel.material == materials::air) { return; }
+    // Cells [minX, maxX] of row y, 64 at a time. Settled cells only have
+    // their turn marked, the movement rules run for the rest. A cell that
+    // moves changes what the cells up to 3 columns away see, those are
+    // handed to the movement rules too rather than worked out again.
+    void sweepRow(int minX, int maxX, int y, bool xAscending);
 
-        if (currentPixel.updateFrame == m_globalUpdateFrame) { return; };
+    // The powders and liquids in word wordX of row y that cannot move this
+    // tick: nothing to fall into below, nothing to slide into diagonally,
+    // no gas beside a liquid and not resting on a cell that is still
+    // falling. Whether a cell sinks into a liquid of another kind is left to
+    // the movement rules, so such cells are never settled.
+    uint64_t settledCells(int wordX, int y) const;
 
-        Vec2i currentPos = Vec2i(col, row);
-        maybeResult<Vec2i> nextPos = maybeResult<Vec2i>();
-        maybeResult<Vec2i> nextNextPos = maybeResult<Vec2i>();
-        
-        auto scopeCapturedSandPhysics = [&currentPos, this](){return this->generalSandPhysics(currentPos);};
+    // the planes of the cells as they are now, no cell is falling
+    void rebuildOccupancy();
 
-        auto scopeCapturedWaterPhysics = [&randomGen, &currentPos, this](){return this->generalWaterPhysics(currentPos, randomGen);};
+    void doPhysicsOnPixel(int col, int row);
 
+    // One kernel per material class, picked from a table indexed by material
+    // that is built at compile time from materialLookup. Each kernel is
+    // straight line code for its class with no flag tests.
+    using PhysicsKernel = void (PixelGrid::*)(int col, int row);
 
+    template<material_properties::MaterialClass Class>
+    void physicsKernel(int col, int row);
 
+    // where a moving pixel goes this tick, specialised per moving class
+    template<material_properties::MaterialClass Class>
+    maybeResult<Vec2i> nextPosition(Vec2i pos, CellRandom & random) const;
 
-        // pixel movement doesnt change the type of pixels
-        if (hasProperty(currentPixel.material, material_properties::fallingLiquid))
-        {
-            nextPos = scopeCapturedSandPhysics().tryWith(scopeCapturedWaterPhysics);
+    // nextPosition of a powder or liquid from the neighbourhood tables. The
+    // liquid's random bit is drawn whether it flows or not, it is the first
+    // draw either way.
+    template<material_properties::MaterialClass Class>
+    maybeResult<Vec2i> tableNextPosition(Vec2i pos, CellRandom & random) const;
 
-            currentPos = swapIfExists(currentPos, nextPos);
-        }
-        
-        else if(hasProperty(currentPixel.material, material_properties::fallingPowder)) {
-            nextPos = scopeCapturedSandPhysics();
+    // where the cell at pos lands when it moves one cell down this tick.
+    // Through gas it keeps going for as many cells as its speed and, if
+    // nothing stopped it, falls faster next tick. Anything else slows it to
+    // one cell per tick.
+    Vec2i fall(Vec2i pos);
 
-            currentPos = swapIfExists(currentPos, nextPos);
-        }
+    // A cell resting on a falling cell that has not moved yet this tick
+    // waits for it and keeps its speed, rather than sliding off sideways,
+    // so a falling body stays together. True when the cell at pos waits.
+    bool followFallingCell(Vec2i pos);
 
-        else if (hasProperty(currentPixel.material, material_properties::IsSolid)) {
-            nextPos = maybeResult<Vec2i>(); // essentially a nothing
-            
-            currentPos = swapIfExists(currentPos, nextPos);
-        } 
+    // the speed the cell at pos fell with last tick, 0 when it did not fall freely
+    int fallSpeed(Vec2i pos, uint8_t material) const;
 
-        else if (hasProperty(currentPixel.material, material_properties::IsGas)) {
-            nextPos = maybeResult<Vec2i>(currentPos) + generalGasMovementHorizontalDelta(currentPos, randomGen, currentPixel);
+    // the cells that fell this tick become m_fallSpeeds
+    void collectFallSpeeds();
 
-            nextNextPos = nextPos + generalGasMovementVerticalDelta(nextPos.getValue(), currentPixel);
+    // forgets every speed, for when cells move by other means than physics
+    void resetFallSpeeds();
 
-            currentPos = swapIfExists(currentPos, nextNextPos);
+    // Fire runs after the sweep, over the burning cells in m_fireMap sorted
+    // into row major order so the result does not depend on the table layout.
+    void doFirePhysics();
 
-            // currentPos = swapIfExists(nextPos.getValue(), nextNextPos);
-        }
-        else {
-            throw std::runtime_error("UnknownMaterial fix in doPhysics method of pixelgrid class in PixelGridd.hpp");
-        } 
-
-        auto scopeCapturedFireSpreadPhysics= [&randomGen, &currentPos, this](){return this->generalFireSpreadPhysics(currentPos, randomGen);};
-        auto scopeCapturedIncinerationPhysics = [&currentPos, this](){return this->incinerationCheck(currentPos);};
-        auto scopeCapturedFireInteractionPhysics=  [&currentPos, this](){return this->generalFireInteractionPhysics(currentPos);}; 
-
-        if (bitop::flag_has_mask(currentPixel.properties, pixel_properties::OnFire)) {
-            if (!bitop::flag_has_mask(currentPixel.properties, pixel_properties::AlwaysOnFire)) {
-                m_fireField[currentPos.x][currentPos.y].burnTime -= 1;
-            }
-            // maybeResult<Action> fireResult = scopeCapturedIncinerationPhysics().tryWith(scopeCapturedFireSpreadPhysics);
-            // maybeResult<Action> fireResult = scopeCapturedFireSpreadPhysics();
-
-            maybeResult<ActionIncludingPair> fireResult = scopeCapturedIncinerationPhysics().tryWith(scopeCapturedFireInteractionPhysics).tryWith(scopeCapturedFireSpreadPhysics);
-            if (fireResult.exists()) {
-                executeAction(fireResult.getValue());
-            }
-            currentPixel = m_pixelGrid[currentPos.x][currentPos.y];
+    // burn time, incineration, reactions and spread of one burning cell
+    void burnPixel(Vec2i pos, CellRandom & random);
 
-        }
+    // fire decisions draw from a different stream than movement in the same cell
+    static constexpr uint64_t fireRandomSalt = 0xf17ef17ef17ef17eULL;
 
-        m_pixelGrid[currentPos.x][currentPos.y].updateFrame = m_globalUpdateFrame;
+    uint32_t cellIndex(Vec2i pos) const {
+        return static_cast<uint32_t>(pos.y * m_gridWidth + pos.x);
     }
 
-    Vec2i swapIfExists(Vec2i currentPos, maybeResult<Vec2i> nextPos) {
-        Vec2i v_nextPos;
-        if (nextPos.exists()) {
-            v_nextPos = nextPos.getValue();
-            swapPixels(currentPos, v_nextPos);
-        } else {
-            v_nextPos = currentPos;
-        }
-        return v_nextPos;
+    template<size_t... Material>
+    static constexpr std::array<PhysicsKernel, materials::NumMaterials> makeKernelTable(std::index_sequence<Material...>) {
+        return {&PixelGrid::physicsKernel<material_properties::materialClass(Material)>...};
     }
 
-    void m_incineratePixel(IncinerationAction action) {
-        Pixel currentPixel = m_pixelGrid[action.pos.x][action.pos.y];
-        uint8_t newMaterial = materials::incineration_table[currentPixel.material];
-        currentPixel.material = newMaterial;
+    static const std::array<PhysicsKernel, materials::NumMaterials> s_physicsKernels;
 
-        setPixel({action.pos, currentPixel}); 
-    }
+    // the hasProperty if-chain the kernels replaced, built instead of the
+    // table when CELLSIM_FLAG_CHAIN_DISPATCH is defined so simbench can
+    // compare the two
+    void doPhysicsOnPixelFlagChain(int col, int row);
 
-    maybeResult<ActionIncludingPair> incinerationCheck(Vec2i pos) const {
-        if (m_fireField[pos.x][pos.y].burnTime == 0) {
-            return maybeResult<IncinerationAction>({pos, m_pixelGrid[pos.x][pos.y]});
-        }
-        return maybeResult<IncinerationAction>();
-    }
+    Vec2i swapIfExists(Vec2i currentPos, maybeResult<Vec2i> nextPos);
 
-    void m_Ignition(m_IgniteAction action) {
-        getPixelRef(action.pos).properties |= pixel_properties::OnFire;     
+    void m_incineratePixel(IncinerationAction action);
 
-        m_fireField[action.pos.x][action.pos.y] = action.fireProperties;
-    }
+    maybeResult<ActionIncludingPair> incinerationCheck(Vec2i pos) const;
 
-    void swapPixels(Vec2i pos1, Vec2i pos2) {
-        Pixel pixel2 = getPixelConst(pos2);
-        if(!isInBounds(pos1) || !isInBounds(pos2)) {
-            throw std::runtime_error("trying to swap not in bounds");
-        }
-        m_pixelGrid[pos2.x][pos2.y] = m_pixelGrid[pos1.x][pos1.y];
-        m_pixelGrid[pos1.x][pos1.y] = pixel2;
-        // m_pixelGrid[pos2.x][pos2.y].updateFrame = m_globalUpdateFrame;
+    void m_Ignition(m_IgniteAction action);
+
+    void swapPixels(Vec2i pos1, Vec2i pos2);
+
+    // the cell at pos moved into a void border and is gone
+    void dropIntoVoid(Vec2i pos);
 
-        FirePixel fire2 = m_fireField[pos2.x][pos2.y];
-        m_fireField[pos2.x][pos2.y] = m_fireField[pos1.x][pos1.y];
-        m_fireField[pos1.x][pos1.y] = fire2;
+    // The bulk edits write whole spans of a row at once. Both take cells
+    // inside the grid, the callers clip. Fire state and the occupancy planes
+    // follow, marking chunks dirty is left to the caller.
+    void fillSpan(int x, int y, int count, uint8_t material);
+
+    void writeSpan(int x, int y, std::span<const uint8_t> material, std::span<const uint8_t> properties);
+
+    // drops the fire state of the burning cells in the span, before it is overwritten
+    void eraseFireInSpan(int x, int y, int count);
+
+    void init();
+
+    void initStampMask() {
+        m_stampMask.assign(static_cast<size_t>(m_gridWidth) * static_cast<size_t>(m_gridHeight), 0);
+        m_stampedCells.clear();
     }
 
-    void init()
-    {
-        initRandom();
-        initGrid();
-        initDrawBuffer();
+    size_t drawBufferSize() const {
+        return static_cast<size_t>(m_viewSize.x) * static_cast<size_t>(m_viewSize.y) * colorize::bytesPerCell(m_drawFormat);
     }
 
     void initDrawBuffer() {
-        m_buffer.assign(static_cast<size_t>(m_gridWidth * m_gridHeight * 4), static_cast<size_t>(0));
+        m_buffer.assign(drawBufferSize(), 0);
     }
 
-    void initRandom()
-    {
+    // keeps the viewport inside the grid, at least one cell and at most the grid in size
+    void clampViewport() {
+        m_viewSize.x = std::clamp(m_viewSize.x, std::min(1, m_gridWidth), m_gridWidth);
+        m_viewSize.y = std::clamp(m_viewSize.y, std::min(1, m_gridHeight), m_gridHeight);
+        m_viewCorner.x = std::clamp(m_viewCorner.x, 0, m_gridWidth - m_viewSize.x);
+        m_viewCorner.y = std::clamp(m_viewCorner.y, 0, m_gridHeight - m_viewSize.y);
     }
 
-    void initGrid()
+    void initRandom()
     {
-        // TODO overload the function to take a config file name
-        // and load all the pixels from that config file
-        // currently this sets all the pixels to air 
-        m_pixelGrid = PixelGridContainer<Pixel>(m_gridWidth, m_gridHeight, Pixel{materials::air, 0, 0});
-        m_fireField = PixelGridContainer<FirePixel>(m_gridWidth, m_gridHeight, m_nullFire);
     }
+
+    void initGrid();
     
-    void tryIgnitePixel(IgnitionAction action) {
+    void tryIgnitePixel(IgnitionAction action);
 
-        Pixel & pixel = getPixelRef(action.pos);
-        if (hasProperty(pixel.material, material_properties::Flammable) && !bitop::flag_has_mask(pixel.properties, pixel_properties::OnFire)) 
-        {
-            pixel.properties |= pixel_properties::OnFire;   
-            FirePixel burnProperties = material_properties::materialLookup[pixel.material].burnProperties;
-            m_IgniteAction immolate = {burnProperties, action.pos}; 
-            m_Ignition(immolate);
-        };
-    }
+    void doActionPair(ActionPair actions);
 
-    void doActionPair(ActionPair actions) {
-        _executeAction(actions.this_action.first);
 
-        _executeAction(actions.this_action.second);
-    }
+    void executeAction(ActionIncludingPair a);
 
+    void _executeAction(Action a);
 
-    void executeAction(ActionIncludingPair a) {
-        if (std::holds_alternative<ActionPair>(a)) {
-            doActionPair(std::get<ActionPair>(a));
-        } else {
-            _executeAction(std::get<Action>(a));
-        }
-    }
+    void applyAction(const SetPixelAction & a)                { setPixel(a); }
+    void applyAction(const DrawCircle & a)                    { drawCircle(a); }
+    void applyAction(const DrawLineAction & a)                { drawLine(a); }
+    void applyAction(const DrawParallelogramAction & a)       { drawParallelogram(a); }
+    void applyAction(const IgnitionAction & a)                { tryIgnitePixel(a); }
+    void applyAction(const IncinerationAction & a)            { m_incineratePixel(a); }
+    void applyAction(const m_IgniteAction & a)                { m_Ignition(a); }
+    void applyAction(const SetPixelMaterialAndProperties & a) { m_SetPixelMaterialAndProperties(a); }
 
-    void _executeAction(Action a) {
-        if (std::holds_alternative<SetPixelAction>(a)) {
-            setPixel(std::get<SetPixelAction>(a));
-        } else if (std::holds_alternative<DrawLineAction>(a)) {
-            drawLine(std::get<DrawLineAction>(a));
-        } else if (std::holds_alternative<DrawCircle>(a)) {
-            drawCircle(std::get<DrawCircle>(a));
-        } else if (std::holds_alternative<DrawParallelogramAction>(a)) {
-            drawParallelogram(std::get<DrawParallelogramAction>(a));
-        } else if (std::holds_alternative<IgnitionAction>(a)) {
-            tryIgnitePixel(std::get<IgnitionAction>(a));
-        } else if (std::holds_alternative<IncinerationAction>(a)) {
-            m_incineratePixel(std::get<IncinerationAction>(a));
-        } else if (std::holds_alternative<m_IgniteAction>(a)) {
-            m_Ignition(std::get<m_IgniteAction>(a));
-        } else if (std::holds_alternative<SetPixelMaterialAndProperties>(a) ) { 
-            m_SetPixelMaterialAndProperties(std::get<SetPixelMaterialAndProperties>(a));
-        }
-        else {
-            throw std::runtime_error("Tried to execute action but execution function is not defined (executeAction)\n");
-        }
-    }
+    // runs every queued command in one pass, then empties the buffer
+    void executeActions(CommandBuffer & commands);
 
-    void executeActions(std::vector<ActionIncludingPair> & actions) 
-    {
-        /*std::cout << "Size of queue : " << actions.size() << "\n";*/
-        for (auto a = actions.begin(); a != actions.end();) {
-            executeAction(*a);
-            a = actions.erase(a);
-        }
-    }
+    // add a shape to the pending stamp run, starting a new run if the pixel differs
+    void stampCircle(DrawCircle action);
 
-    void drawParallelogram(DrawParallelogramAction action) {
-        std::vector<Vec2i> topLine = getLine(action.cornerTL, action.cornerTR);
-        Vec2i TLtoBL = action.cornerBL - action.cornerTR;
-        for (Vec2i pixelPos : topLine) {
-            DrawLineAction line = {pixelPos, pixelPos + TLtoBL, 1,action.pixel_type};
-            drawLine(line);
-        }
-    }
+    void stampLine(DrawLineAction action);
 
-    void setPixel(SetPixelAction action) 
-    {
-        action.pixel_type.properties = pixel_properties::DefaultMaterialProperties[action.pixel_type.material];
+    void stampParallelogram(DrawParallelogramAction action);
 
-        m_pixelGrid[action.pos.x][action.pos.y] = action.pixel_type;       
+    // writes every cell covered by the pending stamp run
+    void flushStamps();
 
-        material_properties::ignitionProperties newBurnProperties = material_properties::materialLookup[action.pixel_type.material].burnProperties;
+    void drawParallelogram(DrawParallelogramAction action);
 
-        m_fireField[action.pos.x][action.pos.y] = newBurnProperties;
-    }
+    void setPixel(SetPixelAction action);
 
-    void m_SetPixelMaterialAndProperties(SetPixelMaterialAndProperties action) {
-        m_pixelGrid[action.pos.x][action.pos.y].material = action.material;
-        m_pixelGrid[action.pos.x][action.pos.y].properties = action.properties;
-    }
+    void m_SetPixelMaterialAndProperties(SetPixelMaterialAndProperties action);
 
 
-    void trySetPixel(SetPixelAction action)
-    {
-        if (isInBounds(action.pos)) {
-            setPixel(action);
-        };
-    }
-
-    std::vector<Vec2i> getLine(Vec2i start, Vec2i end) {
-        std::vector<Vec2i> resultingPath = {};
-
-        // Extract start and end points
-        int x0 = start.x;
-        int y0 = start.y;
-        int x1 = end.x;
-        int y1 = end.y;
+    void trySetPixel(SetPixelAction action);
 
-        // Calculate differences
-        int dx = std::abs(x1 - x0);
-        int dy = std::abs(y1 - y0);
+    std::vector<Vec2i> getLine(Vec2i start, Vec2i end);
 
-        // Determine the direction of the step
-        int sx = (x0 < x1) ? 1 : -1;
-        int sy = (y0 < y1) ? 1 : -1;
+    void drawLine(DrawLineAction action);
 
-        int err = dx - dy;
+    void drawCircle(DrawCircle action);
 
-        int x = x0;
-        int y = y0;
+    // the window scrolls to centre the view once it is this many chunks
+    // from an edge, the chunks a scroll would bring in are prefetched from
+    // further out
+    static constexpr int scrollMarginChunks = 1;
+    static constexpr int prefetchMarginChunks = 3;
 
-        while (true) {
-            // Set pixel at the current position
-            resultingPath.push_back(Vec2i{x, y});
-            if (x == x1 && y == y1) break;
+    // scrolls or prefetches for the view target, then moves the viewport to it
+    void followViewport();
 
-            int e2 = 2 * err;
+    // pages out the chunks outside a window at origin, moves the cells both
+    // windows share and pages in the rest
+    void scrollWorld(Vec2i origin);
 
-            if (e2 > -dy) {
-                err -= dy;
-                x += sx;
-            }
+    // asks the pager for the chunks a window at origin has and this one lacks
+    void prefetchWindow(Vec2i origin) const;
 
-            if (e2 < dx) {
-                err += dx;
-                y += sy;
-            }
+    // moves a command's positions from world cells to grid cells
+    template<typename Command>
+    Command toGridCoordinates(Command command) const {
+        if constexpr (std::is_same_v<Command, DrawLineAction>) {
+            command.start -= m_worldOrigin;
+            command.end -= m_worldOrigin;
+        } else if constexpr (std::is_same_v<Command, DrawParallelogramAction>) {
+            command.cornerTL -= m_worldOrigin;
+            command.cornerTR -= m_worldOrigin;
+            command.cornerBL -= m_worldOrigin;
+        } else {
+            command.pos -= m_worldOrigin;
         }
-        return resultingPath;
+        return command;
     }
 
-    void drawLine(DrawLineAction action)
-    {
-        std::vector<Vec2i> path = getLine(action.start, action.end);
-        for (Vec2i pos : path) {
-            drawCircle(DrawCircle{.pos=pos, .radius=action.width, .pixel_type=action.pixel_type});
-        }
-    }
+    // the draw buffer is coloured in bands of rows, one band per pool job
+    static constexpr int drawBandRows = 32;
 
-    void drawCircle(DrawCircle action)
-    {
-        Vec2i pos = action.pos;
-        int radius = action.radius;
-        
-        for (int x = pos.x - radius; x  <= pos.x + radius; x ++) 
-        {
-            for (int y = pos.y - radius; y <= pos.y + radius; y ++) 
-            {
-                Vec2i pos2 = Vec2i(x,y);
-                if (pos.distsq(pos2) <= pow(radius, 2)) {
-                    trySetPixel(SetPixelAction{pos2, action.pixel_type});
-                }           
-            }
-        }
-    }
+    void updateDrawBuffer();
 
-    void updateDrawBuffer()
-    {
-        for (size_t i = 0; i < static_cast<size_t>(m_gridWidth); i++) 
-        {
-            for (size_t j = 0; j < static_cast<size_t>(m_gridHeight); j ++)
-            {
-                size_t q =  (j * static_cast<size_t>(m_gridWidth) + i);
-                size_t p = q * 4;
-                // if its not on fire and is not lava
-                if ((! bitop::flag_has_mask(m_pixelGrid[i][j].properties, pixel_properties::OnFire)) || (m_pixelGrid[i][j].material == materials::lava)) {
-                    m_buffer[p  ] = materials::m_materialToColor_c[4 * m_pixelGrid[i][j].material];
-                    m_buffer[p+1] = materials::m_materialToColor_c[4 * m_pixelGrid[i][j].material + 1];
-                    m_buffer[p+2] = materials::m_materialToColor_c[4 * m_pixelGrid[i][j].material + 2];
-                    m_buffer[p+3] = materials::m_materialToColor_c[4 * m_pixelGrid[i][j].material + 3];
-                } else {
-                    m_buffer[p  ] = m_fireColor[0];
-                    m_buffer[p+1] = m_fireColor[1]; 
-                    m_buffer[p+2] = m_fireColor[2];
-                    m_buffer[p+3] = m_fireColor[3];
-                }
-            }
-        }
-    }
+    // colours rows [firstRow, endRow) of the draw buffer, counted from the viewport's top
+    void colorizeRows(int firstRow, int endRow);
+
+    // the same rows as cell codes
+    void cellCodeRows(int firstRow, int endRow);
 
 
 public:
@@ -713,8 +519,8 @@ public:
 
     PixelGrid(int width, int height) 
         : m_gridWidth(width), m_gridHeight(height),
-        m_buffer(static_cast<size_t>(width * height * 4)),
-        m_randomGen(std::random_device{}())
+        m_viewSize(width, height),
+        m_randomSeed(std::random_device{}())
     {
         init();
     }
@@ -729,34 +535,240 @@ public:
     // }
 
 
-    void update()
-    {
-        // loops over all pixels in the current pixel grid
-        // executing any actions that are qued from either user input or any
-        // other sources in the game system
-        // then after this is finished call doPhysics()
+    void update();
 
+    // the stages of update(), run one at a time so tools can time them
+    void stepPhysics() {
         doPhysics();
-        executeActions(m_actionQueue);
+    }
+
+    void stepActions() {
+        executeActions(m_commandBuffer);
+    }
+
+    void stepDrawBuffer() {
         updateDrawBuffer();
+    }
+
+    // Threads used by the physics sweep, 1 keeps the single threaded
+    // reference path. Runs on 2 or more threads end in the same world
+    // whatever the count, the single threaded sweep visits cells in another
+    // order and ends in a different one.
+    void setPhysicsThreads(int threadCount);
+
+    // Solid walls (the default) or a void around the grid. Cells already
+    // in the grid stay, from the next tick on they meet the new boundary.
+    void setBoundaryMode(BoundaryMode mode);
+
+    BoundaryMode getBoundaryMode() const {
+        return m_boundaryMode;
+    }
+
+    // takes effect from the next cell moved, the moves do not change
+    void setMovementRules(MovementRules rules) {
+        m_movementRules = rules;
+    }
+
+    MovementRules getMovementRules() const {
+        return m_movementRules;
+    }
+
+    // the same seed and the same actions replay the same simulation
+    void setRandomSeed(uint64_t seed) {
+        m_randomSeed = seed;
+    }
+
+    uint64_t getRandomSeed() const {
+        return m_randomSeed;
+    }
+
+    // Bulk edits for building worlds in code, far cheaper than a
+    // SetPixelAction per cell. They write straight into the planes, a row
+    // span at a time, and wake the chunks they touch once. Cells get the
+    // default properties of their material and are free to move on the next
+    // tick. Positions are world cells as for userAction, whatever falls
+    // outside the grid is clipped. They change the grid there and then, so
+    // they must not run while update() does, and they are not recorded by
+    // startRecording.
+
+    // the size.x by size.y cells from corner
+    void fillRect(Vec2i corner, Vec2i size, uint8_t material);
+
+    // the cells whose centres are inside the polygon, even-odd rule
+    void fillPolygon(std::span<const Vec2i> vertices, uint8_t material);
+
+    // the size.x by size.y cells from corner as they are now, cells outside the grid are air
+    Prefab copyPrefab(Vec2i corner, Vec2i size) const;
+
+    // every cell of the prefab, air included, with its top left at corner
+    void stampPrefab(Vec2i corner, const Prefab & prefab);
+
+    // the image at path mapped to materials by colour, see ImageImport.hpp,
+    // with its top left at corner. Throws std::runtime_error when the image
+    // cannot be read.
+    void stampImage(Vec2i corner, const std::string & path) {
+        stampPrefab(corner, image_import::toPrefab(image_import::read(path)));
+    }
+
+    // Replaces the world, its size, seed and tick with the one saved in
+    // path. Chunks are decoded on the physics pool and single valued chunks
+    // never touch their payload. Throws std::runtime_error when the file is
+    // missing or corrupt, the grid is left as it was in that case. With
+    // paging on the file becomes the window at the world origin and the
+    // paged out chunks of the old world are dropped. A log being recorded
+    // would replay on the wrong world, so it throws while recording.
+    void loadWorld(const std::string & path);
+
+    // everything saveWorld writes, copied out so the grid can keep running.
+    // With paging on only the resident window is saved.
+    world_file::WorldSnapshot snapshotWorld() const;
+
+    void saveWorld(const std::string & path) const {
+        world_file::write(snapshotWorld(), path);
+    }
 
-        /*std::cout << "done draw buffer\n";*/
+    // takes the snapshot now and encodes and writes it on its own thread,
+    // errors are rethrown by the future's get()
+    std::future<void> saveWorldAsync(const std::string & path) const {
+        return std::async(std::launch::async,
+            [world = snapshotWorld(), path] { world_file::write(world, path); });
     }
 
     void userAction(ActionIncludingPair userAction) {
-        std::cout<<"here\n";
-        m_actionQueue.push_back(userAction);
+        if (m_recorder) {
+            m_recorder->record(m_tickCount, userAction);
+        }
+        m_commandBuffer.push(userAction);
+    }
+
+    // Logs every following userAction to path. Paged worlds cannot be
+    // recorded, throws std::runtime_error for those. The world as it is now is
+    // saved to path + ".world" so the log can be replayed on it, actions
+    // already queued for the next update are logged first.
+    void startRecording(const std::string & path);
+
+    void stopRecording();
+
+    bool isRecording() const {
+        return m_recorder != nullptr;
+    }
+
+    // physics steps run so far, actions queued now run after the next one
+    uint64_t getTickCount() const {
+        return m_tickCount;
     }
 
     auto& getPixels() {
         return m_buffer;
     }
 
+    // the cells the last update() changed inside the viewport, in draw
+    // buffer coordinates, one rect per chunk row added to bands, which must
+    // hold getChunkRows() rects
+    void includeChangedBands(std::vector<DirtyRect> & bands) const {
+        DirtyRect view{m_viewCorner.x, m_viewCorner.y,
+                       m_viewCorner.x + m_viewSize.x - 1, m_viewCorner.y + m_viewSize.y - 1};
+        m_chunkGrid.includeChangedBands(bands, view);
+    }
+
+    int getChunkRows() const {
+        return m_chunkGrid.chunksY();
+    }
+
+    // Hands the draw buffer to the caller without copying it, rgba takes
+    // its place and is resized to fit. updateDrawBuffer writes every byte,
+    // so whatever rgba held is never seen.
+    void swapDrawBuffer(std::vector<uint8_t> & rgba) {
+        rgba.resize(m_buffer.size());
+        m_buffer.swap(rgba);
+    }
+
     auto& getPixelData() {
         return m_pixelGrid;
     }
 
+    // number of chunks swept by the last physics step, out of getChunkCount()
+    int getActiveChunkCount() const {
+        return m_chunkGrid.activeChunkCount();
+    }
+
+    int getChunkCount() const {
+        return m_chunkGrid.chunkCount();
+    }
+
+    int getWidth() const {
+        return m_gridWidth;
+    }
+
+    int getHeight() const {
+        return m_gridHeight;
+    }
+
+    // Only the cells in the viewport are coloured, the draw buffer holds
+    // exactly those, row major with getViewSize().x cells per row. The whole
+    // grid is the default, the rect is clipped to the grid and a view
+    // that would hang over an edge is moved back inside. With paging on the
+    // corner is a world cell and the grid scrolls to it over the next update.
+    void setViewport(Vec2i corner, Vec2i size) {
+        m_viewTarget = corner;
+        m_viewCorner = corner - m_worldOrigin;
+        m_viewSize = size;
+        clampViewport();
+        if (m_buffer.size() != drawBufferSize()) {
+            initDrawBuffer();
+        }
+    }
+
+    // RGBA colours (the default) or one cell code per cell for renderers
+    // that colour on the GPU, which skips the palette lookups entirely
+    void setDrawFormat(colorize::DrawFormat format) {
+        m_drawFormat = format;
+        if (m_buffer.size() != drawBufferSize()) {
+            initDrawBuffer();
+        }
+    }
+
+    colorize::DrawFormat getDrawFormat() const {
+        return m_drawFormat;
+    }
+
+    // in world cells
+    Vec2i getViewCorner() const {
+        return m_viewCorner + m_worldOrigin;
+    }
+
+    Vec2i getViewSize() const {
+        return m_viewSize;
+    }
+
+    // Turns the grid into a window onto an unbounded world. Chunks the
+    // window leaves are handed to a ChunkPager that keeps memoryBudget bytes
+    // of them in memory and the rest in pageFile, chunks it reaches come
+    // back from there or start as air. From now on the window follows the
+    // viewport and viewport and action positions are world cells. The grid
+    // must be a whole number of chunks, throws std::invalid_argument if not,
+    // std::logic_error when paging is already on and std::runtime_error
+    // when the page file cannot be created.
+    void enablePaging(const std::string & pageFile, size_t memoryBudget);
+
+    bool isPaging() const {
+        return m_pager != nullptr;
+    }
+
+    // the world cell at the grid's (0, 0)
+    Vec2i getWorldOrigin() const {
+        return m_worldOrigin;
+    }
+
+    ChunkPager::Stats getPagingStats() const {
+        return m_pager ? m_pager->stats() : ChunkPager::Stats{};
+    }
+
+    // moves the viewport to (corner, boxSize) and colours it now, the
+    // returned buffer is the draw buffer itself
     const std::vector<uint8_t>& getWindowView(Vec2i corner, Vec2i boxSize) {
-        
+        setViewport(corner, boxSize);
+        updateDrawBuffer();
+        return m_buffer;
     }
 };
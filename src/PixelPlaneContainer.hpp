@@ -0,0 +1,272 @@
+#pragma once
+
+#include "debugAssert.hpp"
+#include "action_types.h"
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// Storage for the Pixel grid. The layout is a template parameter so the two
+// can be benchmarked against each other:
+//   AoS - one Pixel struct per cell
+//   SoA - separate contiguous planes for material, properties and update frame,
+//         hot loops that only look at the material stream a single byte per cell
+// Both are row major (index = y * width + x) and keep the [x][y] accessor of
+// PixelGridContainer, m_grid[x][y] hands out a PixelRef whose members alias
+// the stored bytes so existing code like m_grid[x][y].material = ... compiles.
+//
+// The cells can be surrounded by a border ring of the given width, cells
+// from -border to width + border - 1 (and the same for y) can be read and
+// written, so a neighbour probe near an edge needs no bounds check. Rows are
+// then width + 2 * border apart in the planes, see rowStride.
+
+namespace pixel_layout {
+struct AoS {};
+struct SoA {};
+}
+
+struct PixelRef
+{
+    uint8_t& material;
+    uint8_t& updateFrame;
+    uint8_t& properties;
+
+    operator Pixel() const {
+        return Pixel{material, updateFrame, properties};
+    }
+
+    PixelRef& operator=(const Pixel& pixel) {
+        material = pixel.material;
+        updateFrame = pixel.updateFrame;
+        properties = pixel.properties;
+        return *this;
+    }
+
+    // assigns the referenced values, a PixelRef can never be rebound
+    PixelRef& operator=(const PixelRef& other) {
+        return *this = static_cast<Pixel>(other);
+    }
+};
+
+template<typename Layout>
+class PixelPlaneContainer
+{
+    static constexpr bool isSoA = std::is_same_v<Layout, pixel_layout::SoA>;
+
+    size_t m_width{};
+    size_t m_height{};
+    int m_border{};
+    size_t m_stride{};
+
+    // AoS storage
+    std::vector<Pixel> m_cells{};
+
+    // SoA storage
+    std::vector<uint8_t> m_material{};
+    std::vector<uint8_t> m_updateFrame{};
+    std::vector<uint8_t> m_properties{};
+
+    void checkBounds(int x, int y, const char* message) const {
+        if (debugAssert::isDebugBuild && ((x < -m_border) || (y < -m_border)
+            || (x >= static_cast<int>(m_width) + m_border) || (y >= static_cast<int>(m_height) + m_border))) {
+            debugAssert::assertFailiure(message);
+        }
+    }
+
+  public:
+    class Column
+    {
+        PixelPlaneContainer& m_grid;
+        int m_x;
+
+      public:
+        Column(PixelPlaneContainer& grid, int x) : m_grid(grid), m_x(x) {}
+
+        PixelRef operator[](int y) {
+            return m_grid.ref(m_x, y);
+        }
+    };
+
+    class ConstColumn
+    {
+        const PixelPlaneContainer& m_grid;
+        int m_x;
+
+      public:
+        ConstColumn(const PixelPlaneContainer& grid, int x) : m_grid(grid), m_x(x) {}
+
+        Pixel operator[](int y) const {
+            return m_grid.get(m_x, y);
+        }
+    };
+
+    PixelPlaneContainer() = default;
+
+    // every cell initial, the border ring borderPixel
+    PixelPlaneContainer(int width, int height, Pixel initial, int border = 0, Pixel borderPixel = Pixel{})
+      : m_width(static_cast<size_t>(width))
+      , m_height(static_cast<size_t>(height))
+      , m_border(border)
+      , m_stride(static_cast<size_t>(width + 2 * border))
+    {
+        size_t cellCount = m_stride * static_cast<size_t>(height + 2 * border);
+        if constexpr (isSoA) {
+            m_material.assign(cellCount, initial.material);
+            m_updateFrame.assign(cellCount, initial.updateFrame);
+            m_properties.assign(cellCount, initial.properties);
+        } else {
+            m_cells.assign(cellCount, initial);
+        }
+        fillBorder(borderPixel);
+    }
+
+    size_t index(int x, int y) const {
+        return static_cast<size_t>(y + m_border) * m_stride + static_cast<size_t>(x + m_border);
+    }
+
+    // overwrites every cell of the border ring
+    void fillBorder(Pixel pixel) {
+        if (m_border == 0) { return; }
+        const int width = static_cast<int>(m_width);
+        const int height = static_cast<int>(m_height);
+        for (int y = -m_border; y < height + m_border; y++) {
+            if (y < 0 || y >= height) {
+                fillRow(-m_border, y, m_stride, pixel);
+            } else {
+                fillRow(-m_border, y, static_cast<size_t>(m_border), pixel);
+                fillRow(width, y, static_cast<size_t>(m_border), pixel);
+            }
+        }
+    }
+
+    Column operator[](int x) {
+        return Column(*this, x);
+    }
+
+    ConstColumn operator[](int x) const {
+        return ConstColumn(*this, x);
+    }
+
+    PixelRef ref(int x, int y) {
+        checkBounds(x, y, "index out of bounds in PixelPlaneContainer::ref");
+        size_t i = index(x, y);
+        if constexpr (isSoA) {
+            return PixelRef{m_material[i], m_updateFrame[i], m_properties[i]};
+        } else {
+            return PixelRef{m_cells[i].material, m_cells[i].updateFrame, m_cells[i].properties};
+        }
+    }
+
+    Pixel get(int x, int y) const {
+        checkBounds(x, y, "index out of bounds in PixelPlaneContainer::get");
+        size_t i = index(x, y);
+        if constexpr (isSoA) {
+            return Pixel{m_material[i], m_updateFrame[i], m_properties[i]};
+        } else {
+            return m_cells[i];
+        }
+    }
+
+    // single field accessors, with SoA these only touch one plane
+    uint8_t material(int x, int y) const {
+        checkBounds(x, y, "index out of bounds in PixelPlaneContainer::material");
+        size_t i = index(x, y);
+        if constexpr (isSoA) { return m_material[i]; } else { return m_cells[i].material; }
+    }
+
+    uint8_t properties(int x, int y) const {
+        checkBounds(x, y, "index out of bounds in PixelPlaneContainer::properties");
+        size_t i = index(x, y);
+        if constexpr (isSoA) { return m_properties[i]; } else { return m_cells[i].properties; }
+    }
+
+    uint8_t updateFrame(int x, int y) const {
+        checkBounds(x, y, "index out of bounds in PixelPlaneContainer::updateFrame");
+        size_t i = index(x, y);
+        if constexpr (isSoA) { return m_updateFrame[i]; } else { return m_cells[i].updateFrame; }
+    }
+
+    void swap(int x1, int y1, int x2, int y2) {
+        checkBounds(x1, y1, "first index out of bounds in PixelPlaneContainer::swap");
+        checkBounds(x2, y2, "second index out of bounds in PixelPlaneContainer::swap");
+        size_t i1 = index(x1, y1);
+        size_t i2 = index(x2, y2);
+        if constexpr (isSoA) {
+            std::swap(m_material[i1], m_material[i2]);
+            std::swap(m_updateFrame[i1], m_updateFrame[i2]);
+            std::swap(m_properties[i1], m_properties[i2]);
+        } else {
+            std::swap(m_cells[i1], m_cells[i2]);
+        }
+    }
+
+    // material and properties of the material.size() cells from (x, y) along the row
+    void readRow(int x, int y, std::span<uint8_t> material, std::span<uint8_t> properties) const {
+        checkBounds(x + static_cast<int>(material.size()) - 1, y, "row out of bounds in PixelPlaneContainer::readRow");
+        size_t i = index(x, y);
+        if constexpr (isSoA) {
+            std::copy_n(m_material.begin() + static_cast<std::ptrdiff_t>(i), material.size(), material.begin());
+            std::copy_n(m_properties.begin() + static_cast<std::ptrdiff_t>(i), properties.size(), properties.begin());
+        } else {
+            for (size_t n = 0; n < material.size(); n++) {
+                material[n] = m_cells[i + n].material;
+                properties[n] = m_cells[i + n].properties;
+            }
+        }
+    }
+
+    // overwrites material.size() cells from (x, y) along the row
+    void writeRow(int x, int y, std::span<const uint8_t> material, std::span<const uint8_t> properties, uint8_t updateFrame) {
+        checkBounds(x + static_cast<int>(material.size()) - 1, y, "row out of bounds in PixelPlaneContainer::writeRow");
+        size_t i = index(x, y);
+        if constexpr (isSoA) {
+            std::copy(material.begin(), material.end(), m_material.begin() + static_cast<std::ptrdiff_t>(i));
+            std::copy(properties.begin(), properties.end(), m_properties.begin() + static_cast<std::ptrdiff_t>(i));
+            std::fill_n(m_updateFrame.begin() + static_cast<std::ptrdiff_t>(i), material.size(), updateFrame);
+        } else {
+            for (size_t n = 0; n < material.size(); n++) {
+                m_cells[i + n] = Pixel{material[n], updateFrame, properties[n]};
+            }
+        }
+    }
+
+    void fillRow(int x, int y, size_t count, Pixel pixel) {
+        checkBounds(x + static_cast<int>(count) - 1, y, "row out of bounds in PixelPlaneContainer::fillRow");
+        size_t i = index(x, y);
+        if constexpr (isSoA) {
+            std::fill_n(m_material.begin() + static_cast<std::ptrdiff_t>(i), count, pixel.material);
+            std::fill_n(m_updateFrame.begin() + static_cast<std::ptrdiff_t>(i), count, pixel.updateFrame);
+            std::fill_n(m_properties.begin() + static_cast<std::ptrdiff_t>(i), count, pixel.properties);
+        } else {
+            std::fill_n(m_cells.begin() + static_cast<std::ptrdiff_t>(i), count, pixel);
+        }
+    }
+
+    // the update frame of every cell, border included
+    void fillUpdateFrames(uint8_t updateFrame) {
+        if constexpr (isSoA) {
+            std::fill(m_updateFrame.begin(), m_updateFrame.end(), updateFrame);
+        } else {
+            for (Pixel& cell : m_cells) {
+                cell.updateFrame = updateFrame;
+            }
+        }
+    }
+
+    // cells from one row to the next in the planes
+    size_t rowStride() const { return m_stride; }
+
+    int border() const { return m_border; }
+
+    // contiguous row major planes, border included, only the SoA layout has them
+    std::span<const uint8_t> materialPlane() const requires isSoA { return m_material; }
+    std::span<const uint8_t> propertiesPlane() const requires isSoA { return m_properties; }
+    std::span<const uint8_t> updateFramePlane() const requires isSoA { return m_updateFrame; }
+
+    size_t width() const { return m_width; }
+    size_t height() const { return m_height; }
+};
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+// A block of cells built once and stamped into worlds with
+// PixelGrid::stampPrefab, row major like the pixel planes. Every cell is
+// copied, air included. Take one out of a grid with PixelGrid::copyPrefab or
+// out of an image with image_import::toPrefab.
+struct Prefab {
+    int width = 0;
+    int height = 0;
+    std::vector<uint8_t> material;
+    std::vector<uint8_t> properties;
+
+    Prefab() = default;
+
+    Prefab(int width, int height, uint8_t fillMaterial = 0, uint8_t fillProperties = 0)
+      : width(width)
+      , height(height)
+      , material(static_cast<size_t>(width) * static_cast<size_t>(height), fillMaterial)
+      , properties(material.size(), fillProperties) {}
+
+    size_t index(int x, int y) const {
+        return static_cast<size_t>(y) * static_cast<size_t>(width) + static_cast<size_t>(x);
+    }
+
+    std::span<const uint8_t> materialRow(int y) const {
+        return std::span<const uint8_t>(material).subspan(index(0, y), static_cast<size_t>(width));
+    }
+
+    std::span<const uint8_t> propertiesRow(int y) const {
+        return std::span<const uint8_t>(properties).subspan(index(0, y), static_cast<size_t>(width));
+    }
+};
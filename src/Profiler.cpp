@@ -0,0 +1,200 @@
+#include "Profiler.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+
+namespace profiler {
+
+namespace {
+
+const std::chrono::steady_clock::time_point epoch = std::chrono::steady_clock::now();
+
+// Only its own thread writes a ring. The lock is there for the reader, so
+// a thread timing a scope never waits for another thread timing one.
+struct ThreadRing {
+    uint32_t id = 0;
+    std::mutex mutex;
+    std::string name;
+    std::vector<Event> events = std::vector<Event>(ringCapacity);
+    uint64_t written = 0;
+};
+
+struct Registry {
+    std::mutex mutex;
+    // rings outlive their threads, a trace still shows what they did
+    std::vector<std::shared_ptr<ThreadRing>> rings;
+    uint32_t nextId = 1;
+    std::vector<uint64_t> frames = std::vector<uint64_t>(frameCapacity);
+    uint64_t frameCount = 0;
+};
+
+Registry & registry() {
+    static Registry instance;
+    return instance;
+}
+
+ThreadRing & localRing() {
+    thread_local std::shared_ptr<ThreadRing> ring = [] {
+        auto created = std::make_shared<ThreadRing>();
+        Registry & reg = registry();
+        std::lock_guard lock(reg.mutex);
+        created->id = reg.nextId++;
+        created->name = "thread " + std::to_string(created->id);
+        reg.rings.push_back(created);
+        return created;
+    }();
+    return *ring;
+}
+
+thread_local uint32_t openScopes = 0;
+
+// trace_event times are microseconds, printed with the nanoseconds as decimals
+void writeMicroseconds(std::ostream & out, uint64_t ns) {
+    char digits[32];
+    std::snprintf(digits, sizeof(digits), "%llu.%03llu",
+        static_cast<unsigned long long>(ns / 1000), static_cast<unsigned long long>(ns % 1000));
+    out << digits;
+}
+
+void writeJsonString(std::ostream & out, const std::string & text) {
+    out << '"';
+    for (char c : text) {
+        if (c == '"' || c == '\\') {
+            out << '\\' << c;
+        } else if (static_cast<unsigned char>(c) >= 0x20) {
+            out << c;
+        }
+    }
+    out << '"';
+}
+}
+
+uint64_t now() {
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now() - epoch).count());
+}
+
+void record(const char* name, uint64_t startNs, uint64_t endNs, uint32_t depth) {
+    ThreadRing & ring = localRing();
+    std::lock_guard lock(ring.mutex);
+    ring.events[ring.written % ringCapacity] = Event{name, startNs, endNs - startNs, depth};
+    ring.written++;
+}
+
+void setThreadName(const std::string & name) {
+    ThreadRing & ring = localRing();
+    std::lock_guard lock(ring.mutex);
+    ring.name = name;
+}
+
+void markFrame() {
+    uint64_t start = now();
+    Registry & reg = registry();
+    std::lock_guard lock(reg.mutex);
+    reg.frames[reg.frameCount % frameCapacity] = start;
+    reg.frameCount++;
+}
+
+std::vector<uint64_t> frameStarts(size_t count) {
+    Registry & reg = registry();
+    std::lock_guard lock(reg.mutex);
+    count = static_cast<size_t>(std::min<uint64_t>({count, reg.frameCount, frameCapacity}));
+    std::vector<uint64_t> starts;
+    starts.reserve(count);
+    for (uint64_t frame = reg.frameCount - count; frame < reg.frameCount; frame++) {
+        starts.push_back(reg.frames[frame % frameCapacity]);
+    }
+    return starts;
+}
+
+std::vector<ThreadEvents> collect(uint64_t sinceNs) {
+    std::vector<std::shared_ptr<ThreadRing>> rings;
+    {
+        Registry & reg = registry();
+        std::lock_guard lock(reg.mutex);
+        rings = reg.rings;
+    }
+
+    std::vector<ThreadEvents> threads;
+    threads.reserve(rings.size());
+    for (const auto & ring : rings) {
+        std::lock_guard lock(ring->mutex);
+        ThreadEvents & thread = threads.emplace_back();
+        thread.id = ring->id;
+        thread.name = ring->name;
+        uint64_t kept = std::min<uint64_t>(ring->written, ringCapacity);
+        for (uint64_t i = ring->written - kept; i < ring->written; i++) {
+            const Event & event = ring->events[i % ringCapacity];
+            if (event.startNs + event.durationNs >= sinceNs) {
+                thread.events.push_back(event);
+            }
+        }
+    }
+    return threads;
+}
+
+void writeChromeTrace(std::ostream & out, size_t frames) {
+    // one more start than frames, the oldest frame needs its beginning
+    std::vector<uint64_t> starts = frameStarts(frames + 1);
+    uint64_t since = starts.empty() ? 0 : starts.front();
+    std::vector<ThreadEvents> threads = collect(since);
+
+    out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+    bool first = true;
+    auto separate = [&] {
+        if (!first) { out << ",\n"; }
+        first = false;
+    };
+    for (const ThreadEvents & thread : threads) {
+        separate();
+        out << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << thread.id << ",\"args\":{\"name\":";
+        writeJsonString(out, thread.name);
+        out << "}}";
+        for (const Event & event : thread.events) {
+            separate();
+            out << "{\"name\":";
+            writeJsonString(out, event.name);
+            out << ",\"ph\":\"X\",\"pid\":1,\"tid\":" << thread.id << ",\"ts\":";
+            writeMicroseconds(out, event.startNs);
+            out << ",\"dur\":";
+            writeMicroseconds(out, event.durationNs);
+            out << "}";
+        }
+    }
+    // frame boundaries as global instant events
+    for (uint64_t start : starts) {
+        separate();
+        out << "{\"name\":\"frame\",\"ph\":\"i\",\"s\":\"g\",\"pid\":1,\"tid\":0,\"ts\":";
+        writeMicroseconds(out, start);
+        out << "}";
+    }
+    out << "\n]}\n";
+}
+
+void writeChromeTrace(const std::string & path, size_t frames) {
+    std::ofstream out(path, std::ios::trunc);
+    if (!out) {
+        throw std::runtime_error("profiler: cannot write " + path);
+    }
+    writeChromeTrace(out, frames);
+    if (!out) {
+        throw std::runtime_error("profiler: cannot write " + path);
+    }
+}
+
+Scope::Scope(const char* name)
+  : m_name(name)
+  , m_start(now())
+  , m_depth(openScopes++)
+{
+}
+
+Scope::~Scope() {
+    openScopes--;
+    record(m_name, m_start, now(), m_depth);
+}
+}
@@ -0,0 +1,95 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+// Scoped timers for attributing frame time. CELLSIM_PROFILE_SCOPE("name")
+// times the rest of the enclosing block and records it in a ring buffer
+// owned by the calling thread, so threads never wait on each other. The
+// GUI reads the rings back for its overlay and writeChromeTrace() dumps
+// them as Chrome trace_event JSON (chrome://tracing or ui.perfetto.dev).
+//
+// Scopes compile to nothing unless CELLSIM_PROFILING is defined, which the
+// ENABLE_PROFILING CMake option does. Names must be string literals, only
+// the pointer is stored.
+
+namespace profiler {
+
+#ifdef CELLSIM_PROFILING
+constexpr bool compiledIn = true;
+#else
+constexpr bool compiledIn = false;
+#endif
+
+// events kept per thread, older ones are overwritten
+constexpr size_t ringCapacity = 1 << 16;
+// frame starts kept, also the most frames writeChromeTrace can dump
+constexpr size_t frameCapacity = 1024;
+
+struct Event {
+    const char* name;
+    uint64_t startNs;
+    uint64_t durationNs;
+    // scopes open on the thread when this one began
+    uint32_t depth;
+};
+
+struct ThreadEvents {
+    uint32_t id;
+    std::string name;
+    // oldest first
+    std::vector<Event> events;
+};
+
+// nanoseconds since the profiler first ran
+uint64_t now();
+
+void record(const char* name, uint64_t startNs, uint64_t endNs, uint32_t depth);
+
+// what the thread is called in traces, "thread <id>" otherwise
+void setThreadName(const std::string & name);
+
+// the render loop starts a frame, frames are counted on this thread
+void markFrame();
+
+// the start of the count most recent frames, oldest first, the last one
+// is the frame in progress
+std::vector<uint64_t> frameStarts(size_t count);
+
+// events of every thread that ended at or after sinceNs
+std::vector<ThreadEvents> collect(uint64_t sinceNs);
+
+// the last frames frames of every thread as a trace_event JSON object
+void writeChromeTrace(std::ostream & out, size_t frames);
+
+// throws std::runtime_error when path cannot be written
+void writeChromeTrace(const std::string & path, size_t frames);
+
+class Scope
+{
+    const char* m_name;
+    uint64_t m_start;
+    uint32_t m_depth;
+
+  public:
+    explicit Scope(const char* name);
+    ~Scope();
+
+    Scope(const Scope&) = delete;
+    Scope& operator=(const Scope&) = delete;
+};
+}
+
+#define CELLSIM_PROFILE_CONCAT_(a, b) a##b
+#define CELLSIM_PROFILE_CONCAT(a, b) CELLSIM_PROFILE_CONCAT_(a, b)
+
+#ifdef CELLSIM_PROFILING
+#define CELLSIM_PROFILE_SCOPE(name) ::profiler::Scope CELLSIM_PROFILE_CONCAT(profileScope, __LINE__) {name}
+#define CELLSIM_PROFILE_FRAME() ::profiler::markFrame()
+#else
+#define CELLSIM_PROFILE_SCOPE(name) static_cast<void>(0)
+#define CELLSIM_PROFILE_FRAME() static_cast<void>(0)
+#endif
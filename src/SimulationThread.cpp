@@ -0,0 +1,127 @@
+#include "SimulationThread.hpp"
+#include "Profiler.hpp"
+#include <utility>
+
+SimulationThread::SimulationThread(PixelGrid & grid, double tickRate)
+  : m_grid(grid)
+  , m_tickPeriod(tickRate > 0.0
+        ? std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::duration<double>(1.0 / tickRate))
+        : std::chrono::nanoseconds(0))
+{
+    m_thread = std::thread([this] { run(); });
+}
+
+SimulationThread::~SimulationThread() {
+    m_running.store(false);
+    m_thread.join();
+}
+
+void SimulationThread::publishFrame() {
+    CELLSIM_PROFILE_SCOPE("publishFrame");
+    SimulationFrame & frame = m_frames.back();
+    size_t bandCount = static_cast<size_t>(m_grid.getChunkRows());
+
+    // a moved or resized viewport shows other cells everywhere, another
+    // draw format other bytes
+    Vec2i corner = m_grid.getViewCorner();
+    Vec2i size = m_grid.getViewSize();
+    colorize::DrawFormat format = m_grid.getDrawFormat();
+    bool viewChanged = corner.x != m_publishedCorner.x || corner.y != m_publishedCorner.y
+        || size.x != m_publishedSize.x || size.y != m_publishedSize.y || format != m_publishedFormat;
+    m_tickChanged.assign(bandCount, DirtyRect{});
+    m_grid.includeChangedBands(m_tickChanged);
+
+    m_pendingChanged.resize(bandCount);
+    frame.full = m_pendingFull || viewChanged;
+    frame.changed.assign(bandCount, DirtyRect{});
+    if (!frame.full) {
+        for (size_t band = 0; band < bandCount; band++) {
+            for (const DirtyRect & rect : {m_pendingChanged[band], m_tickChanged[band]}) {
+                if (!rect.empty()) {
+                    frame.changed[band].include(rect.minX, rect.minY, rect.maxX, rect.maxY);
+                }
+            }
+        }
+    }
+
+    m_grid.swapDrawBuffer(frame.pixels);
+    frame.format = format;
+    frame.corner = corner;
+    frame.width = size.x;
+    frame.height = size.y;
+    frame.tick = m_grid.getTickCount();
+    m_publishedCorner = corner;
+    m_publishedSize = size;
+    m_publishedFormat = format;
+
+    // only after publishing do we learn whether the frame before this one
+    // was taken. If it was, the renderer holds it or this one, so the next
+    // frame needs this tick's changes. If not, it may still hold any frame
+    // since the last one known to be taken, and everything this frame
+    // carries has to go into the next one as well.
+    m_pendingChanged = frame.changed;
+    bool full = frame.full;
+    if (m_frames.publish()) {
+        m_pendingFull = full;
+    } else {
+        std::swap(m_pendingChanged, m_tickChanged);
+        m_pendingFull = viewChanged;
+    }
+}
+
+void SimulationThread::run() {
+    using clock = std::chrono::steady_clock;
+    profiler::setThreadName("simulation");
+
+    std::vector<ActionIncludingPair> actions;
+    std::vector<std::function<void(PixelGrid&)>> jobs;
+
+    clock::time_point nextTick = clock::now();
+    clock::time_point rateStart = nextTick;
+    int ticksSinceRateStart = 0;
+
+    while (m_running.load(std::memory_order_relaxed)) {
+        {
+            std::lock_guard lock(m_queueMutex);
+            std::swap(actions, m_actions);
+            std::swap(jobs, m_jobs);
+        }
+        for (auto & job : jobs) {
+            job(m_grid);
+        }
+        jobs.clear();
+        for (const ActionIncludingPair & action : actions) {
+            m_grid.userAction(action);
+        }
+        actions.clear();
+
+        m_grid.update();
+        publishFrame();
+
+        m_activeChunks.store(m_grid.getActiveChunkCount(), std::memory_order_relaxed);
+        m_chunkCount.store(m_grid.getChunkCount(), std::memory_order_relaxed);
+        m_recording.store(m_grid.isRecording(), std::memory_order_relaxed);
+        ChunkPager::Stats paging = m_grid.getPagingStats();
+        m_pageIns.store(paging.pageIns, std::memory_order_relaxed);
+        m_pageOuts.store(paging.pageOuts, std::memory_order_relaxed);
+        m_pageStallNs.store(paging.stallNs, std::memory_order_relaxed);
+
+        ticksSinceRateStart ++;
+        clock::time_point now = clock::now();
+        std::chrono::duration<double> sinceRateStart = now - rateStart;
+        if (sinceRateStart.count() >= 0.5) {
+            m_ticksPerSecond.store(ticksSinceRateStart / sinceRateStart.count(), std::memory_order_relaxed);
+            ticksSinceRateStart = 0;
+            rateStart = now;
+        }
+
+        if (m_tickPeriod.count() > 0) {
+            nextTick += m_tickPeriod;
+            // a tick that ran long does not make the next ones rush to catch up
+            if (nextTick < now) {
+                nextTick = now;
+            }
+            std::this_thread::sleep_until(nextTick);
+        }
+    }
+}
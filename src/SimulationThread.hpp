@@ -0,0 +1,128 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+#include "PixelGrid.hpp"
+#include "TripleBuffer.hpp"
+
+// Runs PixelGrid::update() on its own thread so rendering, vsync and input
+// never hold up the simulation or the other way round. Every finished draw
+// buffer is published through a TripleBuffer and the renderer shows the
+// newest one. Everything else reaches the grid through the thread: user
+// actions are queued and handed to userAction() before the next tick, and
+// call() runs any other work on the grid between two ticks.
+//
+// Once started the grid belongs to the simulation thread, do not touch it
+// from anywhere else until the SimulationThread is destroyed.
+
+// the grid's viewport after one tick, see PixelGrid::setViewport
+struct SimulationFrame {
+    // the draw buffer, RGBA or cell codes as format says
+    std::vector<uint8_t> pixels;
+    colorize::DrawFormat format = colorize::DrawFormat::rgba;
+    Vec2i corner {0, 0};
+    int width = 0;
+    int height = 0;
+    uint64_t tick = 0;
+
+    // what differs from the frame the renderer took before this one, one
+    // rect per chunk row, changes of frames it never took are included
+    std::vector<DirtyRect> changed;
+    // the first frame and the first after the viewport moved have to be drawn whole
+    bool full = true;
+};
+
+class SimulationThread
+{
+    PixelGrid & m_grid;
+    std::chrono::nanoseconds m_tickPeriod;
+
+    TripleBuffer<SimulationFrame> m_frames;
+    // changes since the last frame the renderer is known to have taken,
+    // every published frame includes them on top of its own tick's
+    std::vector<DirtyRect> m_pendingChanged;
+    bool m_pendingFull = true;
+    std::vector<DirtyRect> m_tickChanged;
+    Vec2i m_publishedCorner {0, 0};
+    Vec2i m_publishedSize {0, 0};
+    colorize::DrawFormat m_publishedFormat = colorize::DrawFormat::rgba;
+
+    // filled by the other threads, swapped out by the simulation thread
+    std::mutex m_queueMutex;
+    std::vector<ActionIncludingPair> m_actions;
+    std::vector<std::function<void(PixelGrid&)>> m_jobs;
+
+    std::atomic<bool>     m_running {true};
+    std::atomic<double>   m_ticksPerSecond {0.0};
+    std::atomic<int>      m_activeChunks {0};
+    std::atomic<int>      m_chunkCount {0};
+    std::atomic<bool>     m_recording {false};
+    std::atomic<uint64_t> m_pageIns {0};
+    std::atomic<uint64_t> m_pageOuts {0};
+    std::atomic<uint64_t> m_pageStallNs {0};
+
+    std::thread m_thread;
+
+    void run();
+
+    void publishFrame();
+
+  public:
+    // tickRate is the most ticks per second to run, 0 runs as fast as it can
+    SimulationThread(PixelGrid & grid, double tickRate);
+
+    // stops after the tick in progress and joins the thread
+    ~SimulationThread();
+
+    SimulationThread(const SimulationThread&) = delete;
+    SimulationThread& operator=(const SimulationThread&) = delete;
+
+    void userAction(const ActionIncludingPair & action) {
+        std::lock_guard lock(m_queueMutex);
+        m_actions.push_back(action);
+    }
+
+    // runs f(grid) on the simulation thread before the next tick, the
+    // future holds what f returns or what it throws
+    template<typename F>
+    auto call(F f) -> std::future<std::invoke_result_t<F, PixelGrid&>> {
+        using Result = std::invoke_result_t<F, PixelGrid&>;
+        auto task = std::make_shared<std::packaged_task<Result(PixelGrid&)>>(std::move(f));
+        std::future<Result> result = task->get_future();
+        std::lock_guard lock(m_queueMutex);
+        m_jobs.push_back([task](PixelGrid & grid) { (*task)(grid); });
+        return result;
+    }
+
+    // render thread side, true when a newer frame than latestFrame() was
+    // published since the last call
+    bool acquireFrame() {
+        return m_frames.acquire();
+    }
+
+    // empty until the first tick has finished
+    const SimulationFrame & latestFrame() const {
+        return m_frames.front();
+    }
+
+    double ticksPerSecond() const { return m_ticksPerSecond.load(std::memory_order_relaxed); }
+    int activeChunkCount() const { return m_activeChunks.load(std::memory_order_relaxed); }
+    int chunkCount() const { return m_chunkCount.load(std::memory_order_relaxed); }
+    bool isRecording() const { return m_recording.load(std::memory_order_relaxed); }
+
+    // the grid's ChunkPager::Stats, all zero without paging
+    ChunkPager::Stats pagingStats() const {
+        return ChunkPager::Stats{
+            m_pageIns.load(std::memory_order_relaxed),
+            m_pageOuts.load(std::memory_order_relaxed),
+            m_pageStallNs.load(std::memory_order_relaxed)};
+    }
+};
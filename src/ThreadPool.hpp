@@ -0,0 +1,113 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed set of worker threads that run one parallelFor at a time.
+// The calling thread takes part in the work, so a pool of N threads
+// spawns N - 1 workers and a pool of 1 runs everything inline.
+
+class ThreadPool
+{
+  public:
+    // job(index, threadIndex), threadIndex is in [0, threadCount())
+    using Job = std::function<void(size_t, size_t)>;
+
+  private:
+    std::vector<std::thread> m_workers;
+
+    std::mutex              m_mutex;
+    std::condition_variable m_wakeWorkers;
+    std::condition_variable m_workersDone;
+
+    const Job*          m_job = nullptr;
+    size_t              m_jobCount = 0;
+    std::atomic<size_t> m_nextIndex {0};
+    size_t              m_finishedWorkers = 0;
+    uint64_t            m_generation = 0;
+    bool                m_stopping = false;
+
+    void runJobs(size_t threadIndex) {
+        for (size_t i = m_nextIndex.fetch_add(1); i < m_jobCount; i = m_nextIndex.fetch_add(1)) {
+            (*m_job)(i, threadIndex);
+        }
+    }
+
+    void workerLoop(size_t threadIndex) {
+        uint64_t seenGeneration = 0;
+        while (true) {
+            {
+                std::unique_lock lock(m_mutex);
+                m_wakeWorkers.wait(lock, [&] { return m_stopping || m_generation != seenGeneration; });
+                if (m_stopping) { return; }
+                seenGeneration = m_generation;
+            }
+
+            runJobs(threadIndex);
+
+            {
+                std::lock_guard lock(m_mutex);
+                m_finishedWorkers ++;
+            }
+            m_workersDone.notify_one();
+        }
+    }
+
+  public:
+    explicit ThreadPool(size_t threadCount) {
+        for (size_t i = 1; i < threadCount; i++) {
+            m_workers.emplace_back([this, i] { workerLoop(i); });
+        }
+    }
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    ~ThreadPool() {
+        {
+            std::lock_guard lock(m_mutex);
+            m_stopping = true;
+        }
+        m_wakeWorkers.notify_all();
+        for (std::thread& worker : m_workers) {
+            worker.join();
+        }
+    }
+
+    size_t threadCount() const {
+        return m_workers.size() + 1;
+    }
+
+    // run job for every index in [0, count) and return once all of them are done
+    void parallelFor(size_t count, const Job& job) {
+        if (count == 0) { return; }
+        if (m_workers.empty() || count == 1) {
+            for (size_t i = 0; i < count; i++) {
+                job(i, 0);
+            }
+            return;
+        }
+
+        {
+            std::lock_guard lock(m_mutex);
+            m_job = &job;
+            m_jobCount = count;
+            m_nextIndex.store(0);
+            m_finishedWorkers = 0;
+            m_generation ++;
+        }
+        m_wakeWorkers.notify_all();
+
+        runJobs(0);
+
+        std::unique_lock lock(m_mutex);
+        m_workersDone.wait(lock, [&] { return m_finishedWorkers == m_workers.size(); });
+        m_job = nullptr;
+    }
+};
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+
+// Lock free hand over of whole values from one producer thread to one
+// consumer thread. The producer fills back() and publishes it, the consumer
+// picks up the most recently published value with acquire(). Neither side
+// ever waits for the other: three slots mean the producer always has one to
+// write that the consumer is not reading, values that are overwritten before
+// the consumer gets to them are simply skipped.
+
+template<typename T>
+class TripleBuffer
+{
+    // the slot between the two threads, newBit is set while it holds a value
+    // the consumer has not taken yet
+    static constexpr uint8_t indexMask = 0b011;
+    static constexpr uint8_t newBit    = 0b100;
+
+    std::array<T, 3> m_slots{};
+    std::atomic<uint8_t> m_middle{1};
+    uint8_t m_back  = 0; // producer only
+    uint8_t m_front = 2; // consumer only
+
+  public:
+    // producer side, the slot to fill before the next publish()
+    T& back() {
+        return m_slots[m_back];
+    }
+
+    // producer side, hands back() over and takes the middle slot as the
+    // next back(). Returns true when that slot was published and never
+    // acquired, back() then still holds the skipped value.
+    bool publish() {
+        uint8_t previous = m_middle.exchange(static_cast<uint8_t>(m_back | newBit), std::memory_order_acq_rel);
+        m_back = previous & indexMask;
+        return previous & newBit;
+    }
+
+    // consumer side, true when a value newer than front() was published
+    // since the last call, front() is that value afterwards
+    bool acquire() {
+        if (!(m_middle.load(std::memory_order_relaxed) & newBit)) {
+            return false;
+        }
+        uint8_t previous = m_middle.exchange(m_front, std::memory_order_acq_rel);
+        m_front = previous & indexMask;
+        return true;
+    }
+
+    // consumer side
+    const T& front() const {
+        return m_slots[m_front];
+    }
+};
@@ -1,7 +1,5 @@
 #pragma once
 
-#include <SFML/Graphics.hpp>
-#include <SFML/System/Vector2.hpp>
 #include <cmath>
 #include <iostream>
 #include <math.h>
@@ -15,21 +13,13 @@ struct Vec2
 
     Vec2() = default;
 
-    Vec2(T xin, T yin)
+    constexpr Vec2(T xin, T yin)
         : x(xin), y(yin)
     { }
 
-    // 
-    Vec2(const sf::Vector2<T>& vec)
-        : x(vec.x), y(vec.y)
-    { }
+    // conversions to and from sf::Vector2 live in Vec2Sfml.hpp so the
+    // simulation core does not depend on SFML
 
-    // auto conversion
-    operator sf::Vector2<T>()
-    {
-        return sf::Vector2<T>(x, y);
-    }    
-    
     // operator conversion between vec2 types 
     template <typename U>
     operator Vec2<U>() const {
@@ -0,0 +1,19 @@
+#pragma once
+
+#include <SFML/System/Vector2.hpp>
+#include "Vec2.hpp"
+
+// conversions between Vec2 and sf::Vector2, only for code that already
+// depends on SFML (the game and renderers), the simulation core stays SFML free
+
+template <typename T>
+Vec2<T> toVec2(const sf::Vector2<T>& vec)
+{
+    return Vec2<T>(vec.x, vec.y);
+}
+
+template <typename T>
+sf::Vector2<T> toSfVector(const Vec2<T>& vec)
+{
+    return sf::Vector2<T>(vec.x, vec.y);
+}
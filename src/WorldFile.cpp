@@ -0,0 +1,274 @@
+#include "WorldFile.hpp"
+#include <algorithm>
+#include <bit>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <fstream>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static_assert(std::endian::native == std::endian::little,
+    "world files are little endian and written straight from memory");
+
+namespace world_file {
+
+void packBits(std::span<const uint8_t> in, std::vector<uint8_t>& out) {
+    size_t i = 0;
+    while (i < in.size()) {
+        size_t run = 1;
+        while (i + run < in.size() && run < 128 && in[i + run] == in[i]) { run++; }
+
+        if (run >= 2) {
+            out.push_back(static_cast<uint8_t>(257 - run));
+            out.push_back(in[i]);
+            i += run;
+            continue;
+        }
+
+        // literals up to the next run of two or more equal bytes
+        size_t start = i;
+        while (i < in.size() && i - start < 128) {
+            if (i + 1 < in.size() && in[i + 1] == in[i]) { break; }
+            i++;
+        }
+        out.push_back(static_cast<uint8_t>(i - start - 1));
+        out.insert(out.end(), in.begin() + static_cast<std::ptrdiff_t>(start), in.begin() + static_cast<std::ptrdiff_t>(i));
+    }
+}
+
+bool unpackBits(std::span<const uint8_t> in, std::span<uint8_t> out) {
+    size_t read = 0;
+    size_t written = 0;
+    while (read < in.size()) {
+        uint8_t control = in[read++];
+        if (control < 128) {
+            size_t count = static_cast<size_t>(control) + 1;
+            if (read + count > in.size() || written + count > out.size()) { return false; }
+            std::memcpy(out.data() + written, in.data() + read, count);
+            read += count;
+            written += count;
+        } else {
+            size_t count = 257 - static_cast<size_t>(control);
+            if (read >= in.size() || written + count > out.size()) { return false; }
+            std::memset(out.data() + written, in[read++], count);
+            written += count;
+        }
+    }
+    return written == out.size();
+}
+
+bool packChunk(std::span<const uint8_t> material, std::span<const uint8_t> properties, std::vector<uint8_t>& out) {
+    bool uniform = std::all_of(material.begin(), material.end(), [&](uint8_t m) { return m == material[0]; })
+        && std::all_of(properties.begin(), properties.end(), [&](uint8_t p) { return p == properties[0]; });
+    if (uniform) {
+        return false;
+    }
+    packBits(material, out);
+    packBits(properties, out);
+    return true;
+}
+
+bool unpackChunk(std::span<const uint8_t> payload, std::span<uint8_t> material, std::span<uint8_t> properties) {
+    // the planes are coded back to back, find where the material stream ends
+    size_t read = 0;
+    size_t written = 0;
+    while (written < material.size() && read < payload.size()) {
+        uint8_t control = payload[read];
+        if (control < 128) {
+            read += 2 + control;
+            written += 1 + static_cast<size_t>(control);
+        } else {
+            read += 2;
+            written += 257 - static_cast<size_t>(control);
+        }
+    }
+    if (read > payload.size()) { return false; }
+    return unpackBits(payload.first(read), material) && unpackBits(payload.subspan(read), properties)
+        && std::all_of(material.begin(), material.end(), [](uint8_t m) { return m < materials::NumMaterials; });
+}
+
+namespace {
+
+template<typename T>
+void appendBytes(std::vector<uint8_t>& out, const T& value) {
+    const uint8_t* bytes = reinterpret_cast<const uint8_t*>(&value);
+    out.insert(out.end(), bytes, bytes + sizeof(T));
+}
+}
+
+void write(const WorldSnapshot& world, const std::string& path) {
+    const size_t width = static_cast<size_t>(world.width);
+    const size_t height = static_cast<size_t>(world.height);
+    const size_t chunkSize = static_cast<size_t>(world.chunkSize);
+    if (chunkSize == 0 || world.material.size() != width * height || world.properties.size() != width * height) {
+        throw std::runtime_error("world_file::write: snapshot planes do not match its size");
+    }
+
+    Header header{};
+    std::memcpy(header.magic, magic, sizeof(magic));
+    header.version = version;
+    header.headerSize = sizeof(Header);
+    header.width = static_cast<uint32_t>(width);
+    header.height = static_cast<uint32_t>(height);
+    header.chunkSize = static_cast<uint32_t>(chunkSize);
+    header.chunksX = static_cast<uint32_t>((width + chunkSize - 1) / chunkSize);
+    header.chunksY = static_cast<uint32_t>((height + chunkSize - 1) / chunkSize);
+    header.globalUpdateFrame = world.globalUpdateFrame;
+    header.randomSeed = world.randomSeed;
+    header.tickCount = world.tickCount;
+    header.fireCount = world.fire.size();
+
+    const size_t chunkCount = static_cast<size_t>(header.chunksX) * header.chunksY;
+    const size_t payloadStart = sizeof(Header) + chunkCount * sizeof(ChunkEntry);
+
+    std::vector<ChunkEntry> index(chunkCount);
+    std::vector<uint8_t> payload;
+    std::vector<uint8_t> materialScratch(chunkSize * chunkSize);
+    std::vector<uint8_t> propertiesScratch(chunkSize * chunkSize);
+
+    for (size_t cy = 0; cy < header.chunksY; cy++) {
+        for (size_t cx = 0; cx < header.chunksX; cx++) {
+            size_t x0 = cx * chunkSize;
+            size_t y0 = cy * chunkSize;
+            size_t chunkWidth = std::min(chunkSize, width - x0);
+            size_t chunkHeight = std::min(chunkSize, height - y0);
+
+            for (size_t row = 0; row < chunkHeight; row++) {
+                std::memcpy(materialScratch.data() + row * chunkWidth, world.material.data() + (y0 + row) * width + x0, chunkWidth);
+                std::memcpy(propertiesScratch.data() + row * chunkWidth, world.properties.data() + (y0 + row) * width + x0, chunkWidth);
+            }
+
+            ChunkEntry& entry = index[cy * header.chunksX + cx];
+            entry.material = materialScratch[0];
+            entry.properties = propertiesScratch[0];
+            size_t cellCount = chunkWidth * chunkHeight;
+            size_t before = payload.size();
+            if (!packChunk(std::span(materialScratch.data(), cellCount), std::span(propertiesScratch.data(), cellCount), payload)) {
+                entry.encoding = ChunkEncoding::uniform;
+                continue;
+            }
+            entry.encoding = ChunkEncoding::packBits;
+            entry.offset = payloadStart + before;
+            entry.size = static_cast<uint32_t>(payload.size() - before);
+        }
+    }
+
+    header.fireOffset = payloadStart + payload.size();
+    for (const auto& [cell, fire] : world.fire) {
+        appendBytes(payload, FireEntry{cell, fire.burnTime, fire.burnPercentageChance, static_cast<uint8_t>(fire.requiresAir)});
+    }
+
+    std::string tempPath = path + ".tmp";
+    {
+        std::ofstream file(tempPath, std::ios::binary | std::ios::trunc);
+        if (!file.is_open()) {
+            throw std::runtime_error("world_file::write: cannot open " + tempPath);
+        }
+        file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        file.write(reinterpret_cast<const char*>(index.data()), static_cast<std::streamsize>(index.size() * sizeof(ChunkEntry)));
+        file.write(reinterpret_cast<const char*>(payload.data()), static_cast<std::streamsize>(payload.size()));
+        if (!file.good()) {
+            throw std::runtime_error("world_file::write: failed writing " + tempPath);
+        }
+    }
+    if (std::rename(tempPath.c_str(), path.c_str()) != 0) {
+        throw std::runtime_error("world_file::write: cannot replace " + path + ": " + std::strerror(errno));
+    }
+}
+
+MappedWorld::MappedWorld(const std::string& path) {
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw std::runtime_error("world_file: cannot open " + path + ": " + std::strerror(errno));
+    }
+    struct stat info{};
+    if (::fstat(fd, &info) != 0 || info.st_size < static_cast<off_t>(sizeof(Header))) {
+        ::close(fd);
+        throw std::runtime_error("world_file: " + path + " is too short to be a world");
+    }
+    m_size = static_cast<size_t>(info.st_size);
+    void* mapping = ::mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (mapping == MAP_FAILED) {
+        throw std::runtime_error("world_file: cannot map " + path + ": " + std::strerror(errno));
+    }
+    m_data = static_cast<const uint8_t*>(mapping);
+
+    std::memcpy(&m_header, m_data, sizeof(Header));
+    auto fail = [&](const char* why) {
+        unmap();
+        throw std::runtime_error("world_file: " + path + ": " + why);
+    };
+    if (std::memcmp(m_header.magic, magic, sizeof(magic)) != 0) { fail("not a world file"); }
+    if (m_header.version != version) { fail("unsupported version"); }
+    if (m_header.headerSize != sizeof(Header)) { fail("bad header size"); }
+    if (m_header.width == 0 || m_header.height == 0 || m_header.chunkSize == 0
+        || m_header.width > INT32_MAX || m_header.height > INT32_MAX || m_header.chunkSize > INT32_MAX
+        || m_header.chunksX != (m_header.width + m_header.chunkSize - 1) / m_header.chunkSize
+        || m_header.chunksY != (m_header.height + m_header.chunkSize - 1) / m_header.chunkSize) {
+        fail("bad dimensions");
+    }
+    if (static_cast<uint64_t>(m_header.width) * m_header.height > maxCells) { fail("too large a world"); }
+    // divided rather than multiplied, a foreign chunk count could wrap the product
+    if (chunkCount() > (m_size - sizeof(Header)) / sizeof(ChunkEntry)) { fail("truncated chunk index"); }
+    if (m_header.fireOffset > m_size || m_header.fireCount > (m_size - m_header.fireOffset) / sizeof(FireEntry)) {
+        fail("truncated fire table");
+    }
+    for (size_t i = 0; i < chunkCount(); i++) {
+        ChunkEntry entry = chunk(i);
+        if (entry.encoding == ChunkEncoding::uniform) {
+            if (entry.material >= materials::NumMaterials) { fail("bad chunk entry"); }
+            continue;
+        }
+        if (entry.encoding != ChunkEncoding::packBits || entry.offset > m_size || entry.size > m_size - entry.offset) {
+            fail("bad chunk entry");
+        }
+    }
+    // chunks are decoded in whatever order the loader likes
+    ::madvise(const_cast<uint8_t*>(m_data), m_size, MADV_WILLNEED);
+}
+
+MappedWorld::~MappedWorld() {
+    unmap();
+}
+
+void MappedWorld::unmap() {
+    if (m_data) {
+        ::munmap(const_cast<uint8_t*>(m_data), m_size);
+        m_data = nullptr;
+    }
+}
+
+ChunkEntry MappedWorld::chunk(size_t index) const {
+    ChunkEntry entry;
+    std::memcpy(&entry, m_data + sizeof(Header) + index * sizeof(ChunkEntry), sizeof(entry));
+    return entry;
+}
+
+MappedWorld::ChunkBounds MappedWorld::chunkBounds(size_t index) const {
+    int chunkSize = static_cast<int>(m_header.chunkSize);
+    int x0 = static_cast<int>(index % m_header.chunksX) * chunkSize;
+    int y0 = static_cast<int>(index / m_header.chunksX) * chunkSize;
+    return ChunkBounds{
+        x0, y0,
+        std::min(chunkSize, static_cast<int>(m_header.width) - x0),
+        std::min(chunkSize, static_cast<int>(m_header.height) - y0)};
+}
+
+bool MappedWorld::decodeChunk(size_t index, std::span<uint8_t> material, std::span<uint8_t> properties) const {
+    ChunkEntry entry = chunk(index);
+    if (entry.encoding != ChunkEncoding::packBits) { return false; }
+
+    return unpackChunk(std::span<const uint8_t>(m_data + entry.offset, entry.size), material, properties);
+}
+
+FireEntry MappedWorld::fire(size_t index) const {
+    FireEntry entry;
+    std::memcpy(&entry, m_data + m_header.fireOffset + index * sizeof(FireEntry), sizeof(entry));
+    return entry;
+}
+}
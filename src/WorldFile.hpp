@@ -0,0 +1,151 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <string>
+#include <utility>
+#include <vector>
+#include "action_types.h"
+
+// Binary world snapshots. A file is
+//   Header
+//   ChunkEntry[chunksX * chunksY]   row major, one per chunkSize square
+//   chunk payloads                  material then properties, PackBits coded
+//   FireEntry[fireCount]            burn state of every burning cell
+// all little endian. A chunk that holds a single pixel value has no payload,
+// the value lives in its index entry, so empty sky and solid rock cost 16
+// bytes a chunk. Files are read through mmap and every chunk decodes on its
+// own, so a loader can spread chunks over threads and never reads the pages
+// of chunks it does not need.
+//
+// The update frame plane is not stored, loaded pixels all start free to move.
+
+namespace world_file {
+
+constexpr char     magic[8] = {'C', 'S', 'W', 'O', 'R', 'L', 'D', '\0'};
+constexpr uint32_t version  = 1;
+
+// the most cells a world may have, 3 GiB of pixel planes. Fire entries
+// address cells with 32 bits and the grid with ints, both fit well within.
+constexpr uint64_t maxCells = uint64_t{1} << 30;
+
+struct Header {
+    char     magic[8];
+    uint32_t version;
+    uint32_t headerSize;
+    uint32_t width;
+    uint32_t height;
+    uint32_t chunkSize;
+    uint32_t chunksX;
+    uint32_t chunksY;
+    uint8_t  globalUpdateFrame;
+    uint8_t  reserved[3];
+    uint64_t randomSeed;
+    uint64_t tickCount;
+    uint64_t fireOffset;
+    uint64_t fireCount;
+};
+static_assert(sizeof(Header) == 72, "the header is written byte for byte");
+
+enum class ChunkEncoding : uint8_t {
+    uniform  = 0, // every cell is (material, properties), no payload
+    packBits = 1,
+};
+
+struct ChunkEntry {
+    uint64_t      offset; // from the start of the file
+    uint32_t      size;
+    ChunkEncoding encoding;
+    uint8_t       material;
+    uint8_t       properties;
+    uint8_t       reserved;
+};
+static_assert(sizeof(ChunkEntry) == 16, "chunk entries are written byte for byte");
+
+struct FireEntry {
+    uint32_t cell; // y * width + x
+    uint16_t burnTime;
+    uint8_t  burnPercentageChance;
+    uint8_t  requiresAir;
+};
+static_assert(sizeof(FireEntry) == 8, "fire entries are written byte for byte");
+
+// a copy of everything a file stores, taken on the simulation thread so it
+// can be encoded and written on another
+struct WorldSnapshot {
+    int width = 0;
+    int height = 0;
+    int chunkSize = 0;
+    uint8_t  globalUpdateFrame = 0;
+    uint64_t randomSeed = 0;
+    uint64_t tickCount = 0;
+
+    // row major, width * height bytes each
+    std::vector<uint8_t> material;
+    std::vector<uint8_t> properties;
+
+    std::vector<std::pair<uint32_t, FirePixel>> fire;
+};
+
+// encodes and writes the snapshot to path.tmp, then renames it over path so
+// an interrupted save never leaves a half written world behind.
+// Throws std::runtime_error when the file cannot be written.
+void write(const WorldSnapshot& world, const std::string& path);
+
+// PackBits: a control byte c < 128 is followed by c + 1 literal bytes, any
+// other c repeats the next byte 257 - c times
+void packBits(std::span<const uint8_t> in, std::vector<uint8_t>& out);
+
+// false when in does not decode to exactly out.size() bytes
+bool unpackBits(std::span<const uint8_t> in, std::span<uint8_t> out);
+
+// Appends the payload of one chunk, given as chunk local planes. Returns
+// false and appends nothing when every cell holds the same pixel, such a
+// chunk is stored as ChunkEncoding::uniform.
+bool packChunk(std::span<const uint8_t> material, std::span<const uint8_t> properties, std::vector<uint8_t>& out);
+
+// decodes a packChunk payload, false if it is corrupt or names a material
+// that does not exist
+bool unpackChunk(std::span<const uint8_t> payload, std::span<uint8_t> material, std::span<uint8_t> properties);
+
+// A world file mapped read only. The constructor checks the header, that
+// the index and fire table lie inside the file and that uniform chunks hold
+// a material that exists, chunk payloads are only touched by decodeChunk.
+// Throws std::runtime_error for missing, truncated or foreign files and for
+// worlds of more than maxCells cells.
+class MappedWorld
+{
+    const uint8_t* m_data = nullptr;
+    size_t m_size = 0;
+    Header m_header{};
+
+    void unmap();
+
+  public:
+    explicit MappedWorld(const std::string& path);
+    ~MappedWorld();
+
+    MappedWorld(const MappedWorld&) = delete;
+    MappedWorld& operator=(const MappedWorld&) = delete;
+
+    const Header& header() const { return m_header; }
+
+    size_t chunkCount() const {
+        return static_cast<size_t>(m_header.chunksX) * m_header.chunksY;
+    }
+
+    ChunkEntry chunk(size_t index) const;
+
+    // the cells of chunk index in grid coordinates, x0 y0 inclusive
+    struct ChunkBounds { int x0, y0, width, height; };
+    ChunkBounds chunkBounds(size_t index) const;
+
+    // decodes a packBits chunk into chunk local row major planes of
+    // width * height bytes, false if the payload is corrupt or names a
+    // material that does not exist
+    bool decodeChunk(size_t index, std::span<uint8_t> material, std::span<uint8_t> properties) const;
+
+    FireEntry fire(size_t index) const;
+};
+}
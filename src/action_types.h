@@ -1,4 +1,7 @@
 #include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <variant>
 #include "Vec2.hpp"
 #include "Materials.h"
 
@@ -0,0 +1,15 @@
+#pragma once
+
+// Public header of the cellsim_core library, the simulation without any
+// SFML, ImGui or OpenGL dependency. Tools and tests that only simulate should
+// include this and link against cellsim_core.
+
+#define CELLSIM_CORE_VERSION_MAJOR 1
+#define CELLSIM_CORE_VERSION_MINOR 0
+
+#include "Materials.h"
+#include "Vec2.hpp"
+#include "action_types.h"
+#include "maybeResult.hpp"
+#include "PixelGridContainer.hpp"
+#include "PixelGrid.hpp"
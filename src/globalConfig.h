@@ -1,16 +1,24 @@
 #include <cstddef>
+#include <SFML/Graphics.hpp>
 #include "PixelGrid.hpp"
+#include "GlRenderer.hpp"
+#include "SimulationThread.hpp"
 #include "Materials.h"
 #include <random>
 #include "Vec2.hpp"
 #include "UserInputOptions.h"
 #include <functional>
+#include <future>
 #include <map>
+#include <memory>
 #include "configHelp.h"
 
 
 struct LoadedConfig {
     int fps = 60;
+    // simulation ticks per second, the simulation runs on its own thread
+    // and does not follow the frame rate, 0 runs it as fast as it can
+    int tick_rate = 60;
     int scale = 1;
     std::string rendering_engine = "SFML2";
 
@@ -20,16 +28,57 @@ struct LoadedConfig {
     size_t window_width = 1600;
     size_t window_height = 900;
 
+    // threads used by the physics sweep, 1 keeps the single threaded path
+    int physics_threads = 1;
+
+    // seed for the physics randomness, 0 picks a new seed every run
+    size_t random_seed = 0;
+
+    // what lies past the grid's edges, wall or void, which deletes the
+    // cells that move into it
+    std::string boundary_mode = "wall";
+
+    // how powders and liquids pick their moves, branching or table, which
+    // looks them up by neighbourhood. Both make the same moves.
+    std::string movement_rules = "branching";
+
+    // world loaded at startup and written by the Save world button, none when empty
+    std::string world_file = "";
+
+    // where the Record actions button logs user input for bench/replay
+    std::string action_log = "session.actions";
+
+    // with a page file the grid is a window onto an unbounded world that
+    // follows the camera, chunks it leaves are kept in page_memory_mb of
+    // memory and the rest in this file, none when empty
+    std::string page_file = "";
+    size_t page_memory_mb = 256;
+
+    // F9 writes the last trace_frames frames of profiler timings here as
+    // Chrome trace_event JSON
+    std::string trace_file = "frames.trace.json";
+    size_t trace_frames = 300;
 };
 
 inline void printConfig(const LoadedConfig& cfg, std::ostream& os = std::cout)
 {
     os << "LoadedConfig:\n";
     os << "  fps              = " << cfg.fps              << "\n";
+    os << "  tick_rate        = " << cfg.tick_rate        << "\n";
     os << "  scale            = " << cfg.scale            << "\n";
     os << "  rendering_engine = " << cfg.rendering_engine << "\n";
     os << "  pGrid_width      = " << cfg.pGrid_width      << "\n";
     os << "  pGrid_height     = " << cfg.pGrid_height     << "\n";
+    os << "  physics_threads  = " << cfg.physics_threads  << "\n";
+    os << "  random_seed      = " << cfg.random_seed      << "\n";
+    os << "  boundary_mode    = " << cfg.boundary_mode    << "\n";
+    os << "  movement_rules   = " << cfg.movement_rules   << "\n";
+    os << "  world_file       = " << cfg.world_file       << "\n";
+    os << "  action_log       = " << cfg.action_log       << "\n";
+    os << "  page_file        = " << cfg.page_file        << "\n";
+    os << "  page_memory_mb   = " << cfg.page_memory_mb   << "\n";
+    os << "  trace_file       = " << cfg.trace_file       << "\n";
+    os << "  trace_frames     = " << cfg.trace_frames     << "\n";
 }
 using FieldPtr = std::variant<
     int LoadedConfig::*,
@@ -59,7 +108,11 @@ struct SFML2State {
     sf::Clock delta_clock;
 };
 
-struct OpenGLState {};
+// set when renderingEngine is OpenGL, the frame is then drawn by the
+// renderer instead of the SFML sprite
+struct OpenGLState {
+    std::unique_ptr<GlRenderer> renderer;
+};
 
 struct ParallelogramState {
     enum DrawParallelogramStates : uint8_t {
@@ -85,10 +138,14 @@ struct GameState {
 
     bool running = true;
     int frame_count {};
+    double render_rate = 0.0;
+    // texture bytes sent to the GPU by the last sRender
+    size_t uploaded_bytes = 0;
+    std::vector<uint8_t> upload_staging;
     bool left_button_pressed = false;
     bool right_button_pressed = false;
     bool prev_left_button_pressed = false;
-    Vec2st previous_mouse_position;
+    Vec2i previous_mouse_position;
     Vec2st drag_line_start_simulation_pos;
 
     PixelGrid pixel_grid;
@@ -101,6 +158,16 @@ struct GameState {
     int paint_brush_width = 1;
 
     Vec2i window_position = {0,0};
+    // the viewport last sent to the simulation
+    Vec2i view_corner = {0,0};
+    Vec2i view_size = {0,0};
+
+    // the save in flight, saving runs off the main thread
+    std::future<void> world_save;
+
+    // runs pixel_grid from the end of Game::init on, declared after it so
+    // the thread is stopped before the grid is destroyed
+    std::unique_ptr<SimulationThread> simulation;
 };
 
 // GameState createInitialGameState(const LoadedConfig & lc) {
@@ -1,4 +1,8 @@
+#pragma once
+
+#include <concepts>
 #include <iostream>
+#include <stdexcept>
 
 template<typename T>
 class maybeResult{
@@ -0,0 +1,172 @@
+#include <catch2/catch_test_macros.hpp>
+#include <catch2/generators/catch_generators.hpp>
+
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#include <GL/glcorearb.h>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+#include "GlRenderer.hpp"
+
+// GlRenderer on a surfaceless EGL context, so Mesa's llvmpipe runs it with
+// no GPU and no display. Frames of cell codes are drawn into a renderbuffer
+// and read back, every pixel must be its palette colour blended over black
+// as colorize::Palette gives it. Skipped where no such context can be made.
+
+namespace {
+
+struct HeadlessContext {
+    EGLDisplay display = EGL_NO_DISPLAY;
+    EGLContext context = EGL_NO_CONTEXT;
+
+    // a core profile context of at least version major.minor, check made() after
+    HeadlessContext(int major, int minor) {
+        auto getPlatformDisplay = reinterpret_cast<PFNEGLGETPLATFORMDISPLAYEXTPROC>(
+            eglGetProcAddress("eglGetPlatformDisplayEXT"));
+        if (!getPlatformDisplay) { return; }
+        display = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, nullptr);
+        if (display == EGL_NO_DISPLAY || !eglInitialize(display, nullptr, nullptr)) {
+            display = EGL_NO_DISPLAY;
+            return;
+        }
+        eglBindAPI(EGL_OPENGL_API);
+        const EGLint attributes[] = {
+            EGL_CONTEXT_MAJOR_VERSION, major,
+            EGL_CONTEXT_MINOR_VERSION, minor,
+            EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+            EGL_NONE};
+        context = eglCreateContext(display, EGL_NO_CONFIG_KHR, EGL_NO_CONTEXT, attributes);
+        if (context != EGL_NO_CONTEXT && !eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, context)) {
+            eglDestroyContext(display, context);
+            context = EGL_NO_CONTEXT;
+        }
+    }
+
+    ~HeadlessContext() {
+        if (context != EGL_NO_CONTEXT) {
+            eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+            eglDestroyContext(display, context);
+        }
+        if (display != EGL_NO_DISPLAY) {
+            eglTerminate(display);
+        }
+    }
+
+    bool made() const {
+        return context != EGL_NO_CONTEXT;
+    }
+};
+
+template<typename Proc>
+Proc glProc(const char* name) {
+    return reinterpret_cast<Proc>(eglGetProcAddress(name));
+}
+
+// a width x height RGBA8 renderbuffer bound as the draw and read framebuffer
+class Target {
+    unsigned m_framebuffer = 0;
+    unsigned m_renderbuffer = 0;
+    int m_width;
+    int m_height;
+
+  public:
+    Target(int width, int height) : m_width(width), m_height(height) {
+        glProc<PFNGLGENFRAMEBUFFERSPROC>("glGenFramebuffers")(1, &m_framebuffer);
+        glProc<PFNGLBINDFRAMEBUFFERPROC>("glBindFramebuffer")(GL_FRAMEBUFFER, m_framebuffer);
+        glProc<PFNGLGENRENDERBUFFERSPROC>("glGenRenderbuffers")(1, &m_renderbuffer);
+        glProc<PFNGLBINDRENDERBUFFERPROC>("glBindRenderbuffer")(GL_RENDERBUFFER, m_renderbuffer);
+        glProc<PFNGLRENDERBUFFERSTORAGEPROC>("glRenderbufferStorage")(GL_RENDERBUFFER, GL_RGBA8, width, height);
+        glProc<PFNGLFRAMEBUFFERRENDERBUFFERPROC>("glFramebufferRenderbuffer")(
+            GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, m_renderbuffer);
+    }
+
+    ~Target() {
+        glProc<PFNGLDELETEFRAMEBUFFERSPROC>("glDeleteFramebuffers")(1, &m_framebuffer);
+        glProc<PFNGLDELETERENDERBUFFERSPROC>("glDeleteRenderbuffers")(1, &m_renderbuffer);
+    }
+
+    // RGBA, row 0 at the bottom as glReadPixels has it
+    std::vector<uint8_t> read() const {
+        std::vector<uint8_t> pixels(static_cast<size_t>(m_width) * static_cast<size_t>(m_height) * 4);
+        glProc<PFNGLPIXELSTOREIPROC>("glPixelStorei")(GL_PACK_ALIGNMENT, 1);
+        glProc<PFNGLREADPIXELSPROC>("glReadPixels")(0, 0, m_width, m_height, GL_RGBA, GL_UNSIGNED_BYTE, pixels.data());
+        return pixels;
+    }
+};
+
+// the cells of a frame drawn one framebuffer pixel each that are not the
+// colour the palette gives their code
+int wrongPixels(const std::vector<uint8_t> & drawn, const std::vector<uint8_t> & cells,
+                int width, int height, const colorize::Palette & palette) {
+    int wrong = 0;
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++) {
+            uint8_t code = cells[static_cast<size_t>(y * width + x)];
+            uint32_t colour = palette[(code & ~colorize::cellCodeFireBit)
+                + (code & colorize::cellCodeFireBit ? colorize::fireOffset : 0)];
+            uint8_t rgba[4];
+            std::memcpy(rgba, &colour, sizeof(rgba));
+            const uint8_t * pixel = &drawn[static_cast<size_t>((height - 1 - y) * width + x) * 4];
+            for (int channel = 0; channel < 3; channel++) {
+                int expected = (rgba[channel] * rgba[3] + 127) / 255;
+                if (std::abs(pixel[channel] - expected) > 1) {
+                    wrong++;
+                    break;
+                }
+            }
+        }
+    }
+    return wrong;
+}
+}
+
+TEST_CASE("GlRenderer colours cell codes as the palette does", "[gl]") {
+    // Mesa hands out its newest core profile whatever is asked for, so the
+    // upload path of contexts without buffer storage is taken by hiding it
+    auto persistent = GENERATE(true, false);
+    HeadlessContext context(3, 3);
+    if (!context.made()) {
+        SKIP("no surfaceless EGL context");
+    }
+    GlRenderer renderer([persistent](const char* name) {
+        if (!persistent && std::strcmp(name, "glBufferStorage") == 0) { return GlRenderer::GlProc(nullptr); }
+        return glProc<GlRenderer::GlProc>(name);
+    });
+    if (persistent && !renderer.usesPersistentMapping()) {
+        SKIP("the context has no buffer storage");
+    }
+    REQUIRE(renderer.usesPersistentMapping() == persistent);
+
+    const uint8_t fireColor[4] = {189, 84, 40, 180};
+    colorize::Palette palette = colorize::buildPalette(fireColor);
+    renderer.setPalette(palette);
+
+    // every material, burning and not, in every column and row
+    const int width = 61;
+    const int height = 37;
+    std::vector<uint8_t> cells(static_cast<size_t>(width * height));
+    for (size_t i = 0; i < cells.size(); i++) {
+        uint8_t material = static_cast<uint8_t>(i % materials::NumMaterials);
+        bool burning = (i / materials::NumMaterials) % 2 != 0;
+        cells[i] = static_cast<uint8_t>(material | (burning ? colorize::cellCodeFireBit : 0));
+    }
+
+    Target target(width, height);
+    renderer.upload(cells, width, height, {}, true);
+    renderer.draw(0, 0, width, height);
+    REQUIRE(wrongPixels(target.read(), cells, width, height, palette) == 0);
+
+    SECTION("only the changed rects are sent and the rest of the frame stays") {
+        const DirtyRect changed{10, 5, 29, 20};
+        for (int y = changed.minY; y <= changed.maxY; y++) {
+            for (int x = changed.minX; x <= changed.maxX; x++) {
+                cells[static_cast<size_t>(y * width + x)] = materials::water;
+            }
+        }
+        size_t sent = renderer.upload(cells, width, height, std::span<const DirtyRect>(&changed, 1), false);
+        REQUIRE(sent < cells.size());
+        renderer.draw(0, 0, width, height);
+        REQUIRE(wrongPixels(target.read(), cells, width, height, palette) == 0);
+    }
+}
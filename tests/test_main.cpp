@@ -1,5 +1,20 @@
 #define CATCH_CONFIG_MAIN  // This tells Catch2 to provide a main() function.
 #include <catch2/catch_test_macros.hpp>
+#include <catch2/generators/catch_generators.hpp>
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <map>
+#include <random>
+#include <stdexcept>
+#include <thread>
+#include "ChunkPager.hpp"
+#include "ImageImport.hpp"
+#include "PixelGrid.hpp"
 
 // A sample test case for demonstration.
 TEST_CASE("Addition works correctly", "[math]") {
@@ -8,3 +23,826 @@ TEST_CASE("Addition works correctly", "[math]") {
     int sum = a + b;
     REQUIRE(sum == 5);
 }
+
+// A world of every material in random cells, half of them air, so the
+// powders and liquids meet every kind of neighbour on the way down.
+static Prefab randomSoup(int width, int height, uint32_t seed) {
+    // mt19937 draws are the same everywhere, distributions are not
+    std::mt19937 generator(seed);
+    Prefab soup(width, height);
+    for (size_t i = 0; i < soup.material.size(); i++) {
+        soup.material[i] = generator() % 2 ? static_cast<uint8_t>(1 + generator() % (materials::NumMaterials - 1)) : materials::air;
+        soup.properties[i] = pixel_properties::DefaultMaterialProperties[soup.material[i]];
+    }
+    return soup;
+}
+
+TEST_CASE("Neighbourhood tables move cells as the branching rules do", "[physics]") {
+    const int width = 160;
+    const int height = 90;
+    const int ticks = 200;
+
+    auto boundary = GENERATE(PixelGrid::BoundaryMode::wall, PixelGrid::BoundaryMode::voidEdge);
+    auto threads = GENERATE(1, 3);
+    auto seed = GENERATE(1u, 2u);
+    Prefab soup = randomSoup(width, height, seed);
+
+    auto simulate = [&](PixelGrid::MovementRules rules) {
+        PixelGrid grid(width, height);
+        grid.setRandomSeed(seed);
+        grid.setPhysicsThreads(threads);
+        grid.setBoundaryMode(boundary);
+        grid.setMovementRules(rules);
+        grid.stampPrefab(Vec2i(0, 0), soup);
+        for (int tick = 0; tick < ticks; tick++) {
+            grid.update();
+        }
+        return grid.copyPrefab(Vec2i(0, 0), Vec2i(width, height));
+    };
+
+    Prefab branching = simulate(PixelGrid::MovementRules::branching);
+    Prefab table = simulate(PixelGrid::MovementRules::neighbourhoodTable);
+    REQUIRE(branching.material == table.material);
+    REQUIRE(branching.properties == table.properties);
+    // the soup has to have moved for the comparison to mean anything
+    REQUIRE(branching.material != soup.material);
+}
+
+// Sand, water, oil and stone, which neither burn nor react with each other
+// without a flame, so a world of them keeps every cell it starts with.
+static Prefab inertSoup(int width, int height, uint32_t seed) {
+    const uint8_t inert[] = {materials::sand, materials::water, materials::oil, materials::stone};
+    std::mt19937 generator(seed);
+    Prefab soup(width, height);
+    for (size_t i = 0; i < soup.material.size(); i++) {
+        soup.material[i] = generator() % 2 ? inert[generator() % std::size(inert)] : materials::air;
+        soup.properties[i] = pixel_properties::DefaultMaterialProperties[soup.material[i]];
+    }
+    return soup;
+}
+
+// The checkerboard sweep draws randomness per cell and tick, so how many
+// workers share its chunks makes no difference. The single threaded sweep
+// visits cells in another order and ends elsewhere, with the same cells.
+TEST_CASE("Pooled sweeps end in the same world whatever the thread count", "[physics]") {
+    const int width = 192;
+    const int height = 128;
+    Prefab soup = inertSoup(width, height, 5);
+
+    auto simulate = [&](int threads) {
+        PixelGrid grid(width, height);
+        grid.setRandomSeed(5);
+        grid.setPhysicsThreads(threads);
+        grid.stampPrefab(Vec2i(0, 0), soup);
+        for (int tick = 0; tick < 150; tick++) {
+            grid.update();
+        }
+        return grid.copyPrefab(Vec2i(0, 0), Vec2i(width, height));
+    };
+
+    Prefab pooled = simulate(2);
+    REQUIRE(pooled.material != soup.material);
+    REQUIRE(simulate(3).material == pooled.material);
+    REQUIRE(simulate(4).material == pooled.material);
+
+    Prefab serial = simulate(1);
+    for (uint8_t material = 0; material < materials::NumMaterials; material++) {
+        INFO("material " << int{material});
+        REQUIRE(std::count(serial.material.begin(), serial.material.end(), material)
+            == std::count(pooled.material.begin(), pooled.material.end(), material));
+    }
+}
+
+// The same random edits made to both layouts and to a plain vector of
+// Pixels, border ring included, read back through every accessor.
+TEST_CASE("SoA and AoS pixel planes hold the same cells", "[pixel_planes]") {
+    const int width = 37;
+    const int height = 23;
+    const int border = 3;
+    const int stride = width + 2 * border;
+    const Pixel initial{materials::air, 1, pixel_properties::None};
+    const Pixel wall{materials::stone, 0, pixel_properties::None};
+
+    PixelPlaneContainer<pixel_layout::SoA> soa(width, height, initial, border, wall);
+    PixelPlaneContainer<pixel_layout::AoS> aos(width, height, initial, border, wall);
+    std::vector<Pixel> model(static_cast<size_t>(stride * (height + 2 * border)), initial);
+    auto at = [&](int x, int y) -> Pixel & { return model[static_cast<size_t>((y + border) * stride + x + border)]; };
+    for (int y = -border; y < height + border; y++) {
+        for (int x = -border; x < width + border; x++) {
+            if (x < 0 || y < 0 || x >= width || y >= height) { at(x, y) = wall; }
+        }
+    }
+
+    std::mt19937 generator(11);
+    auto any = [&](int from, int to) { return std::uniform_int_distribution<int>(from, to)(generator); };
+    auto anyPixel = [&] {
+        return Pixel{static_cast<uint8_t>(any(0, materials::NumMaterials - 1)),
+                     static_cast<uint8_t>(any(0, 255)), static_cast<uint8_t>(any(0, 3))};
+    };
+    for (int edit = 0; edit < 2000; edit++) {
+        int x = any(-border, width + border - 1);
+        int y = any(-border, height + border - 1);
+        switch (any(0, 4)) {
+        case 0: {
+            Pixel pixel = anyPixel();
+            soa.ref(x, y) = pixel;
+            aos[x][y] = pixel;
+            at(x, y) = pixel;
+            break;
+        }
+        case 1: {
+            int x2 = any(-border, width + border - 1);
+            int y2 = any(-border, height + border - 1);
+            soa.swap(x, y, x2, y2);
+            aos.swap(x, y, x2, y2);
+            std::swap(at(x, y), at(x2, y2));
+            break;
+        }
+        case 2: {
+            int count = any(1, width + border - x);
+            Pixel pixel = anyPixel();
+            soa.fillRow(x, y, static_cast<size_t>(count), pixel);
+            aos.fillRow(x, y, static_cast<size_t>(count), pixel);
+            for (int i = 0; i < count; i++) { at(x + i, y) = pixel; }
+            break;
+        }
+        case 3: {
+            std::vector<uint8_t> material(static_cast<size_t>(any(1, width + border - x)));
+            std::vector<uint8_t> properties(material.size());
+            for (size_t i = 0; i < material.size(); i++) {
+                material[i] = static_cast<uint8_t>(any(0, materials::NumMaterials - 1));
+                properties[i] = static_cast<uint8_t>(any(0, 3));
+            }
+            uint8_t frame = static_cast<uint8_t>(any(0, 255));
+            soa.writeRow(x, y, material, properties, frame);
+            aos.writeRow(x, y, material, properties, frame);
+            for (size_t i = 0; i < material.size(); i++) {
+                at(x + static_cast<int>(i), y) = Pixel{material[i], frame, properties[i]};
+            }
+            break;
+        }
+        default:
+            if (edit % 500 == 0) {
+                uint8_t frame = static_cast<uint8_t>(edit);
+                soa.fillUpdateFrames(frame);
+                aos.fillUpdateFrames(frame);
+                for (Pixel & pixel : model) { pixel.updateFrame = frame; }
+            }
+            break;
+        }
+    }
+
+    int differ = 0;
+    for (int y = -border; y < height + border; y++) {
+        for (int x = -border; x < width + border; x++) {
+            const Pixel expected = at(x, y);
+            for (Pixel pixel : {soa.get(x, y), aos.get(x, y), static_cast<Pixel>(soa.ref(x, y)), static_cast<Pixel>(aos[x][y])}) {
+                differ += pixel.material != expected.material || pixel.updateFrame != expected.updateFrame
+                    || pixel.properties != expected.properties;
+            }
+            differ += soa.material(x, y) != expected.material || aos.properties(x, y) != expected.properties
+                || aos.updateFrame(x, y) != expected.updateFrame;
+            differ += soa.materialPlane()[soa.index(x, y)] != expected.material;
+        }
+    }
+    REQUIRE(differ == 0);
+
+    std::vector<uint8_t> soaMaterial(width), soaProperties(width), aosMaterial(width), aosProperties(width);
+    for (int y = 0; y < height; y++) {
+        soa.readRow(0, y, soaMaterial, soaProperties);
+        aos.readRow(0, y, aosMaterial, aosProperties);
+        REQUIRE(soaMaterial == aosMaterial);
+        REQUIRE(soaProperties == aosProperties);
+    }
+}
+
+// A fixed soup of every material run single threaded, burning included,
+// and the world it ends in. tests/CMakeLists.txt builds these tests again
+// with CELLSIM_FLAG_CHAIN_DISPATCH, so the physics kernels and the
+// hasProperty chain they replaced both have to end in this world. Change
+// the hash only with a change meant to move cells differently.
+TEST_CASE("Physics dispatch ends a fixed world in the same place", "[physics]") {
+    const int width = 128;
+    const int height = 96;
+    PixelGrid grid(width, height);
+    grid.setRandomSeed(4);
+    grid.setPhysicsThreads(1);
+    grid.stampPrefab(Vec2i(0, 0), randomSoup(width, height, 4));
+    for (int tick = 0; tick < 120; tick++) {
+        grid.update();
+    }
+
+    Prefab world = grid.copyPrefab(Vec2i(0, 0), Vec2i(width, height));
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for (size_t i = 0; i < world.material.size(); i++) {
+        hash = (hash ^ world.material[i]) * 0x100000001b3ULL;
+        hash = (hash ^ world.properties[i]) * 0x100000001b3ULL;
+    }
+    REQUIRE(hash == 0xd85ec6fcc7f789aaULL);
+}
+
+// Brush strokes queued in one tick are stamped into a mask and written once
+// per run of the same pixel. Overlapping strokes of different materials
+// must still end as if each had been drawn on its own, in order.
+TEST_CASE("Coalesced brush stamps draw what unbatched strokes draw", "[actions]") {
+    auto pixelOf = [](uint8_t material) {
+        return Pixel{material, 0, pixel_properties::DefaultMaterialProperties[material]};
+    };
+    const std::vector<Action> strokes = {
+        DrawCircle{Vec2i(20, 20), 6, pixelOf(materials::sand)},
+        DrawCircle{Vec2i(24, 22), 5, pixelOf(materials::sand)},
+        DrawLineAction{Vec2i(5, 30), Vec2i(60, 12), 2, pixelOf(materials::water)},
+        DrawLineAction{Vec2i(10, 10), Vec2i(10, 50), 1, pixelOf(materials::sand)},
+        DrawParallelogramAction{Vec2i(30, 35), Vec2i(50, 35), Vec2i(40, 55), pixelOf(materials::stone)},
+        DrawCircle{Vec2i(-3, 40), 8, pixelOf(materials::wood)},
+        SetPixelAction{Vec2i(20, 20), pixelOf(materials::oil)},
+        DrawCircle{Vec2i(40, 40), 4, pixelOf(materials::sand)},
+    };
+
+    PixelGrid batched(64, 64);
+    for (const Action & stroke : strokes) {
+        batched.userAction(stroke);
+    }
+    batched.stepActions();
+
+    PixelGrid unbatched(64, 64);
+    for (const Action & stroke : strokes) {
+        unbatched.userAction(stroke);
+        unbatched.stepActions();
+    }
+
+    Prefab batchedWorld = batched.copyPrefab(Vec2i(0, 0), Vec2i(64, 64));
+    Prefab unbatchedWorld = unbatched.copyPrefab(Vec2i(0, 0), Vec2i(64, 64));
+    REQUIRE(batchedWorld.material == unbatchedWorld.material);
+    REQUIRE(batchedWorld.properties == unbatchedWorld.properties);
+
+    // a lone circle covers the cells within its radius and no others
+    PixelGrid circle(32, 32);
+    circle.userAction(Action(DrawCircle{Vec2i(16, 16), 5, pixelOf(materials::stone)}));
+    circle.stepActions();
+    Prefab disc = circle.copyPrefab(Vec2i(0, 0), Vec2i(32, 32));
+    int wrong = 0;
+    for (int y = 0; y < 32; y++) {
+        for (int x = 0; x < 32; x++) {
+            bool inside = (x - 16) * (x - 16) + (y - 16) * (y - 16) <= 25;
+            wrong += inside != (disc.material[static_cast<size_t>(y * 32 + x)] == materials::stone);
+        }
+    }
+    REQUIRE(wrong == 0);
+}
+
+// Random inserts, overwrites, erases and swaps over a few thousand cells,
+// enough to grow the table several times and to erase from the middle of
+// long probe runs, checked against std::map after every step.
+TEST_CASE("FireMap keeps the burn state std::map does", "[fire]") {
+    FireMap fires;
+    std::map<uint32_t, FirePixel> model;
+    std::mt19937 generator(3);
+    auto anyCell = [&] { return static_cast<uint32_t>(generator() % 4096); };
+
+    int wrong = 0;
+    for (int step = 0; step < 20000; step++) {
+        uint32_t cell = anyCell();
+        // inserts win early so the table grows, erases later so it empties out
+        uint32_t kind = generator() % 10;
+        if (kind < (step < 10000 ? 6u : 3u)) {
+            FirePixel fire{static_cast<uint16_t>(generator()), static_cast<uint8_t>(generator()), generator() % 2 != 0};
+            fires.insertOrAssign(cell, fire);
+            model[cell] = fire;
+        } else if (kind < 9) {
+            wrong += fires.erase(cell) != (model.erase(cell) == 1);
+        } else {
+            uint32_t other = anyCell();
+            fires.swap(cell, other);
+            auto a = model.extract(cell);
+            auto b = model.extract(other);
+            if (!a.empty()) { a.key() = other; model.insert(std::move(a)); }
+            if (!b.empty()) { b.key() = cell; model.insert(std::move(b)); }
+        }
+
+        const FirePixel * found = fires.find(cell);
+        auto expected = model.find(cell);
+        if ((found != nullptr) != (expected != model.end())) {
+            wrong++;
+        } else if (found && (found->burnTime != expected->second.burnTime
+                             || found->burnPercentageChance != expected->second.burnPercentageChance
+                             || found->requiresAir != expected->second.requiresAir)) {
+            wrong++;
+        }
+        wrong += fires.size() != model.size();
+    }
+    REQUIRE(wrong == 0);
+
+    std::vector<uint32_t> cells;
+    fires.appendCells(cells);
+    std::sort(cells.begin(), cells.end());
+    std::vector<uint32_t> expectedCells;
+    for (const auto & [cell, fire] : model) { expectedCells.push_back(cell); }
+    REQUIRE(cells == expectedCells);
+
+    fires.clear();
+    REQUIRE(fires.empty());
+    REQUIRE(fires.find(expectedCells.empty() ? 0 : expectedCells.front()) == nullptr);
+}
+
+// The compiled table answers every (trigger, material, neighbour) the way a
+// walk down reactions[] in declaration order would.
+TEST_CASE("The reaction table agrees with the reaction list", "[reactions]") {
+    using namespace material_reactions;
+
+    int wrong = 0;
+    for (size_t t = 0; t < triggerCount; t++) {
+        Trigger trigger = static_cast<Trigger>(t);
+        for (int material = 0; material < materials::NumMaterials; material++) {
+            bool anyReaction = false;
+            for (int neighbour = 0; neighbour < materials::NumMaterials; neighbour++) {
+                uint8_t expected = noReaction;
+                for (size_t i = 0; i < reactionCount; i++) {
+                    const Reaction & r = reactions[i];
+                    if (r.trigger == trigger && r.material == material) {
+                        anyReaction = true;
+                        if (r.neighbour == neighbour && expected == noReaction) {
+                            expected = static_cast<uint8_t>(i);
+                        }
+                    }
+                }
+                wrong += reactionTable.lookup(trigger, static_cast<uint8_t>(material), static_cast<uint8_t>(neighbour)) != expected;
+            }
+            wrong += reactionTable.reacts(trigger, static_cast<uint8_t>(material)) != anyReaction;
+        }
+    }
+    REQUIRE(wrong == 0);
+}
+
+// A rectangle given as a polygon by its corners covers the cells fillRect
+// does, inside the grid and clipped at every edge of it.
+TEST_CASE("Polygons that are rectangles fill what fillRect fills", "[world_building]") {
+    const int width = 64;
+    const int height = 48;
+    auto [corner, size] = GENERATE(
+        std::pair(Vec2i(5, 7), Vec2i(20, 11)),
+        std::pair(Vec2i(-6, -3), Vec2i(15, 9)),
+        std::pair(Vec2i(50, 40), Vec2i(30, 30)),
+        std::pair(Vec2i(-10, 20), Vec2i(100, 1)),
+        std::pair(Vec2i(31, -5), Vec2i(1, 80)));
+
+    Prefab soup = randomSoup(width, height, 24);
+    PixelGrid byRect(width, height);
+    PixelGrid byPolygon(width, height);
+    byRect.stampPrefab(Vec2i(0, 0), soup);
+    byPolygon.stampPrefab(Vec2i(0, 0), soup);
+
+    byRect.fillRect(corner, size, materials::stone);
+    const Vec2i vertices[] = {corner, corner + Vec2i(size.x, 0), corner + size, corner + Vec2i(0, size.y)};
+    byPolygon.fillPolygon(vertices, materials::stone);
+
+    Prefab rect = byRect.copyPrefab(Vec2i(0, 0), Vec2i(width, height));
+    Prefab polygon = byPolygon.copyPrefab(Vec2i(0, 0), Vec2i(width, height));
+    REQUIRE(polygon.material == rect.material);
+    REQUIRE(polygon.properties == rect.properties);
+    REQUIRE(rect.material != soup.material);
+}
+
+// A block copied out of a grid, half of it off the edge, comes back as air
+// where the grid was not and stamps into another grid cell for cell.
+TEST_CASE("Prefabs copied out of a grid stamp back the same cells", "[world_building]") {
+    const int width = 64;
+    const int height = 48;
+    PixelGrid source(width, height);
+    source.stampPrefab(Vec2i(0, 0), randomSoup(width, height, 25));
+
+    const Vec2i corner(40, -10);
+    const Vec2i size(40, 30);
+    Prefab copied = source.copyPrefab(corner, size);
+    REQUIRE(copied.width == size.x);
+    REQUIRE(copied.height == size.y);
+
+    Prefab expected = randomSoup(width, height, 25);
+    int wrong = 0;
+    for (int y = 0; y < size.y; y++) {
+        for (int x = 0; x < size.x; x++) {
+            int sourceX = corner.x + x;
+            int sourceY = corner.y + y;
+            bool inside = sourceX < width && sourceY >= 0;
+            uint8_t material = inside ? expected.material[expected.index(sourceX, sourceY)] : materials::air;
+            uint8_t properties = inside ? expected.properties[expected.index(sourceX, sourceY)] : pixel_properties::None;
+            wrong += copied.material[copied.index(x, y)] != material;
+            wrong += copied.properties[copied.index(x, y)] != properties;
+        }
+    }
+    REQUIRE(wrong == 0);
+
+    PixelGrid target(width, height);
+    target.fillRect(Vec2i(0, 0), Vec2i(width, height), materials::sand);
+    target.stampPrefab(Vec2i(3, 5), copied);
+    Prefab stamped = target.copyPrefab(Vec2i(3, 5), size);
+    REQUIRE(stamped.material == copied.material);
+    REQUIRE(stamped.properties == copied.properties);
+    // cells around the stamp are left alone
+    Prefab left = target.copyPrefab(Vec2i(0, 0), Vec2i(3, height));
+    REQUIRE(std::count(left.material.begin(), left.material.end(), materials::sand) == 3 * height);
+}
+
+// The same picture of sand, stone and steel written as a P6 and a P3 PPM,
+// the P3 one on a 0 to 15 scale, reads back as those materials.
+TEST_CASE("PPM images import as the materials of their colours", "[world_building]") {
+    auto binary = GENERATE(false, true);
+    const uint8_t picture[2][3] = {
+        {materials::sand, materials::stone, materials::steel},
+        {materials::steel, materials::sand, materials::stone},
+    };
+    std::string path = (std::filesystem::temp_directory_path() / "cellsim_import.ppm").string();
+    {
+        std::ofstream file(path, std::ios::binary | std::ios::trunc);
+        file << (binary ? "P6" : "P3") << "\n# a comment\n3 2\n" << (binary ? 255 : 15) << "\n";
+        for (const auto & row : picture) {
+            for (uint8_t material : row) {
+                for (int channel = 0; channel < 3; channel++) {
+                    uint8_t value = materials::m_materialToColor_c[4 * material + channel];
+                    if (binary) {
+                        file.put(static_cast<char>(value));
+                    } else {
+                        file << (value * 15 + 127) / 255 << " ";
+                    }
+                }
+            }
+        }
+    }
+
+    Prefab prefab = image_import::toPrefab(image_import::read(path));
+    REQUIRE(prefab.width == 3);
+    REQUIRE(prefab.height == 2);
+    int wrong = 0;
+    for (int y = 0; y < 2; y++) {
+        for (int x = 0; x < 3; x++) {
+            wrong += prefab.material[prefab.index(x, y)] != picture[y][x];
+            wrong += prefab.properties[prefab.index(x, y)] != pixel_properties::DefaultMaterialProperties[picture[y][x]];
+        }
+    }
+    REQUIRE(wrong == 0);
+
+    PixelGrid grid(16, 16);
+    grid.stampImage(Vec2i(4, 4), path);
+    REQUIRE(grid.copyPrefab(Vec2i(4, 4), Vec2i(3, 2)).material == prefab.material);
+
+    // one pixel short
+    std::filesystem::resize_file(path, std::filesystem::file_size(path) - (binary ? 3 : 6));
+    REQUIRE_THROWS_AS(grid.stampImage(Vec2i(4, 4), path), std::runtime_error);
+    std::filesystem::remove(path);
+}
+
+// Cells in chunks that are not swept keep the update frame of the last tick
+// they were, and the 8 bit frame comes round again every 256 ticks. A block
+// of sand boxed in on a ledge must still fall when the ledge goes, however
+// long it rested there.
+TEST_CASE("Cells resting for a whole round of update frames still fall", "[physics]") {
+    const int size = 128;
+    auto threads = GENERATE(1, 3);
+
+    for (int rest = 248; rest < 264; rest++) {
+        PixelGrid grid(size, size);
+        grid.setPhysicsThreads(threads);
+        grid.fillRect(Vec2i(51, 50), Vec2i(1, 11), materials::stone);
+        grid.fillRect(Vec2i(68, 50), Vec2i(1, 11), materials::stone);
+        grid.fillRect(Vec2i(52, 60), Vec2i(16, 1), materials::stone);
+        grid.fillRect(Vec2i(52, 50), Vec2i(16, 10), materials::sand);
+        for (int tick = 0; tick < rest; tick++) {
+            grid.update();
+        }
+        grid.fillRect(Vec2i(52, 60), Vec2i(16, 1), materials::air);
+        for (int tick = 0; tick < 200; tick++) {
+            grid.update();
+        }
+
+        Prefab above = grid.copyPrefab(Vec2i(0, 0), Vec2i(size, 100));
+        INFO("rested " << rest << " ticks");
+        REQUIRE(std::count(above.material.begin(), above.material.end(), materials::sand) == 0);
+    }
+}
+
+// A foreign header whose chunk index would wrap size_t when multiplied out,
+// in a file just long enough for the header and in one a page long.
+TEST_CASE("World files with impossible dimensions are refused", "[world_file]") {
+    auto fileSize = GENERATE(sizeof(world_file::Header), size_t{4096});
+
+    world_file::Header header{};
+    std::memcpy(header.magic, world_file::magic, sizeof(header.magic));
+    header.version = world_file::version;
+    header.headerSize = sizeof(world_file::Header);
+    header.width = uint32_t{1} << 30;
+    header.height = uint32_t{1} << 30;
+    header.chunkSize = 1;
+    header.chunksX = header.width;
+    header.chunksY = header.height;
+    header.fireOffset = sizeof(world_file::Header);
+
+    std::vector<uint8_t> bytes(fileSize);
+    std::memcpy(bytes.data(), &header, sizeof(header));
+    std::string path = (std::filesystem::temp_directory_path() / "cellsim_foreign.world").string();
+    {
+        std::ofstream file(path, std::ios::binary | std::ios::trunc);
+        file.write(reinterpret_cast<const char*>(bytes.data()), static_cast<std::streamsize>(bytes.size()));
+    }
+
+    PixelGrid grid(64, 64);
+    REQUIRE_THROWS_AS(world_file::MappedWorld(path), std::runtime_error);
+    REQUIRE_THROWS_AS(grid.loadWorld(path), std::runtime_error);
+    REQUIRE(grid.getWidth() == 64);
+    std::filesystem::remove(path);
+}
+
+// A soup burning for a while, so fire has spread and burn times have run
+// down, saved and loaded into a grid of another size. The loaded grid holds
+// the same cells and fire. Fall speeds and sleeping chunks are not saved,
+// so it goes on to the same world as the saved grid once that has loaded
+// the file too.
+TEST_CASE("Saved worlds load with their materials, properties and fire", "[world_file]") {
+    const int width = 96;
+    const int height = 80;
+    std::string path = (std::filesystem::temp_directory_path() / "cellsim_round_trip.world").string();
+
+    PixelGrid saved(width, height);
+    saved.setRandomSeed(12);
+    saved.setPhysicsThreads(1);
+    saved.stampPrefab(Vec2i(0, 0), randomSoup(width, height, 12));
+    for (int tick = 0; tick < 40; tick++) {
+        saved.update();
+    }
+    saved.saveWorld(path);
+
+    PixelGrid loaded(32, 32);
+    loaded.setPhysicsThreads(1);
+    loaded.loadWorld(path);
+    REQUIRE(loaded.getWidth() == width);
+
+    world_file::WorldSnapshot before = saved.snapshotWorld();
+    world_file::WorldSnapshot after = loaded.snapshotWorld();
+    REQUIRE(after.height == before.height);
+    REQUIRE(after.randomSeed == before.randomSeed);
+    REQUIRE(after.tickCount == before.tickCount);
+    REQUIRE(after.globalUpdateFrame == before.globalUpdateFrame);
+    REQUIRE(after.material == before.material);
+    REQUIRE(after.properties == before.properties);
+
+    auto fireOf = [](world_file::WorldSnapshot & world) {
+        std::vector<world_file::FireEntry> fire;
+        for (const auto & [cell, pixel] : world.fire) {
+            fire.push_back({cell, pixel.burnTime, pixel.burnPercentageChance, pixel.requiresAir});
+        }
+        std::sort(fire.begin(), fire.end(), [](const auto & a, const auto & b) { return a.cell < b.cell; });
+        return fire;
+    };
+    std::vector<world_file::FireEntry> fireBefore = fireOf(before);
+    std::vector<world_file::FireEntry> fireAfter = fireOf(after);
+    REQUIRE(!fireBefore.empty());
+    REQUIRE(fireAfter.size() == fireBefore.size());
+    REQUIRE(std::memcmp(fireAfter.data(), fireBefore.data(), fireBefore.size() * sizeof(world_file::FireEntry)) == 0);
+
+    saved.loadWorld(path);
+    std::filesystem::remove(path);
+    for (int tick = 0; tick < 40; tick++) {
+        saved.update();
+        loaded.update();
+    }
+    Prefab savedWorld = saved.copyPrefab(Vec2i(0, 0), Vec2i(width, height));
+    Prefab loadedWorld = loaded.copyPrefab(Vec2i(0, 0), Vec2i(width, height));
+    REQUIRE(loadedWorld.material == savedWorld.material);
+    REQUIRE(loadedWorld.properties == savedWorld.properties);
+}
+
+// A saved world with the first material byte of its first chunk turned into
+// a material that does not exist, in the index entry of a uniform chunk or
+// in the payload of a packed one. Loading it must throw and keep the world.
+TEST_CASE("World files naming a material that does not exist are refused", "[world_file]") {
+    auto packed = GENERATE(false, true);
+    std::string path = (std::filesystem::temp_directory_path() / "cellsim_bad_material.world").string();
+
+    PixelGrid saved(64, 64);
+    saved.fillRect(Vec2i(0, 0), Vec2i(64, 64), materials::sand);
+    if (packed) {
+        saved.fillRect(Vec2i(0, 0), Vec2i(1, 1), materials::stone);
+    }
+    saved.saveWorld(path);
+
+    std::vector<char> bytes(std::filesystem::file_size(path));
+    std::ifstream(path, std::ios::binary).read(bytes.data(), static_cast<std::streamsize>(bytes.size()));
+    world_file::ChunkEntry entry;
+    std::memcpy(&entry, bytes.data() + sizeof(world_file::Header), sizeof(entry));
+    REQUIRE((entry.encoding == world_file::ChunkEncoding::packBits) == packed);
+    if (packed) {
+        // the first control byte is followed by a literal or the byte it repeats
+        bytes[entry.offset + 1] = static_cast<char>(200);
+    } else {
+        bytes[sizeof(world_file::Header) + offsetof(world_file::ChunkEntry, material)] = static_cast<char>(200);
+    }
+    std::ofstream(path, std::ios::binary | std::ios::trunc).write(bytes.data(), static_cast<std::streamsize>(bytes.size()));
+
+    PixelGrid grid(64, 64);
+    grid.fillRect(Vec2i(0, 32), Vec2i(64, 32), materials::water);
+    REQUIRE_THROWS_AS(grid.loadWorld(path), std::runtime_error);
+    Prefab world = grid.copyPrefab(Vec2i(0, 0), Vec2i(64, 64));
+    REQUIRE(std::count(world.material.begin(), world.material.end(), materials::water) == 64 * 32);
+    std::filesystem::remove(path);
+}
+
+// the log and the world saved beside it only replay together if the world
+// is not swapped underneath the recording
+TEST_CASE("Worlds are not loaded during a recording", "[action_log]") {
+    std::filesystem::path directory = std::filesystem::temp_directory_path();
+    std::string worldPath = (directory / "cellsim_other.world").string();
+    std::string logPath = (directory / "cellsim_recording.alog").string();
+
+    PixelGrid other(64, 64);
+    other.fillRect(Vec2i(0, 32), Vec2i(64, 32), materials::stone);
+    other.saveWorld(worldPath);
+
+    PixelGrid grid(64, 64);
+    grid.startRecording(logPath);
+    REQUIRE_THROWS_AS(grid.loadWorld(worldPath), std::runtime_error);
+    REQUIRE(grid.isRecording());
+    Prefab world = grid.copyPrefab(Vec2i(0, 0), Vec2i(64, 64));
+    REQUIRE(std::count(world.material.begin(), world.material.end(), materials::stone) == 0);
+
+    grid.stopRecording();
+    grid.loadWorld(worldPath);
+    world = grid.copyPrefab(Vec2i(0, 0), Vec2i(64, 64));
+    REQUIRE(std::count(world.material.begin(), world.material.end(), materials::stone) == 64 * 32);
+
+    std::filesystem::remove(worldPath);
+    std::filesystem::remove(logPath);
+    std::filesystem::remove(logPath + ".world");
+}
+
+// a session on a void replayed as bench/replay.cpp does it, sand poured over
+// the bottom edge has to leave the grid in the replay too
+TEST_CASE("Logs replay with the boundary mode they were recorded with", "[action_log]") {
+    std::string logPath = (std::filesystem::temp_directory_path() / "cellsim_void.alog").string();
+    const Pixel sand{materials::sand, 0, pixel_properties::DefaultMaterialProperties[materials::sand]};
+
+    PixelGrid live(64, 64);
+    live.setBoundaryMode(PixelGrid::BoundaryMode::voidEdge);
+    live.startRecording(logPath);
+    for (int tick = 0; tick < 120; tick++) {
+        if (tick % 10 == 0) {
+            live.userAction(Action(DrawLineAction{Vec2i(8, 40), Vec2i(56, 40), 3, sand}));
+        }
+        live.update();
+    }
+    live.stopRecording();
+
+    action_log::ActionLog log(logPath);
+    REQUIRE(log.header().boundaryMode == static_cast<uint8_t>(PixelGrid::BoundaryMode::voidEdge));
+
+    PixelGrid replay(64, 64);
+    replay.loadWorld(logPath + ".world");
+    replay.setRandomSeed(log.header().randomSeed);
+    replay.setBoundaryMode(static_cast<PixelGrid::BoundaryMode>(log.header().boundaryMode));
+    for (const action_log::ActionLog::Entry & entry : log.entries()) {
+        while (replay.getTickCount() < entry.tick) { replay.update(); }
+        replay.userAction(entry.action);
+    }
+    while (replay.getTickCount() < live.getTickCount()) { replay.update(); }
+
+    Prefab liveWorld = live.copyPrefab(Vec2i(0, 0), Vec2i(64, 64));
+    Prefab replayWorld = replay.copyPrefab(Vec2i(0, 0), Vec2i(64, 64));
+    REQUIRE(replayWorld.material == liveWorld.material);
+    // less sand is left than was poured, some of it fell through the floor
+    REQUIRE(std::count(liveWorld.material.begin(), liveWorld.material.end(), materials::sand) < 12 * 49 * 3);
+
+    std::filesystem::remove(logPath);
+    std::filesystem::remove(logPath + ".world");
+}
+
+// Records no grid of the header's size could apply, each in a log of its
+// own after an action that is fine, so the log is refused rather than
+// replayed up to them.
+TEST_CASE("Logs with records a grid cannot apply are refused", "[action_log]") {
+    const Pixel sand{materials::sand, 0, pixel_properties::DefaultMaterialProperties[materials::sand]};
+    const Pixel unknown{200, 0, pixel_properties::None};
+    auto bad = GENERATE_COPY(
+        Action(SetPixelAction{Vec2i(10, 10), unknown}),
+        Action(SetPixelAction{Vec2i(64, 10), sand}),
+        Action(DrawCircle{Vec2i(10, 10), -1, sand}),
+        Action(DrawCircle{Vec2i(10, 10), 1 << 30, sand}),
+        Action(DrawLineAction{Vec2i(10, 10), Vec2i(1 << 30, 10), 2, sand}),
+        Action(DrawParallelogramAction{Vec2i(0, 0), Vec2i(10, 0), Vec2i(0, -1000), sand}),
+        Action(IncinerationAction{Vec2i(-1, 0), sand}),
+        Action(SetPixelMaterialAndProperties{Vec2i(5, 5), materials::sand, 0x80}));
+
+    std::string path = (std::filesystem::temp_directory_path() / "cellsim_corrupt.alog").string();
+    action_log::Header header{};
+    std::memcpy(header.magic, action_log::magic, sizeof(header.magic));
+    header.version = action_log::version;
+    header.width = 64;
+    header.height = 64;
+    {
+        action_log::ActionRecorder recorder(path, header);
+        recorder.record(0, Action(DrawCircle{Vec2i(10, 10), 3, sand}));
+        recorder.record(1, bad);
+        recorder.finish(2);
+    }
+    REQUIRE_THROWS_AS(action_log::ActionLog(path), std::runtime_error);
+    std::filesystem::remove(path);
+}
+
+// A packed chunk with fire, made different for every i so a chunk handed
+// back for the wrong coordinate shows.
+static PagedChunk packedChunk(int i) {
+    PagedChunk chunk;
+    chunk.encoding = world_file::ChunkEncoding::packBits;
+    for (int b = 0; b < 40 + i; b++) {
+        chunk.payload.push_back(static_cast<uint8_t>(b * 7 + i));
+    }
+    chunk.fire.push_back({static_cast<uint32_t>(i), static_cast<uint16_t>(100 + i), 30, 1});
+    chunk.fire.push_back({static_cast<uint32_t>(i + 64), 5, static_cast<uint8_t>(i), 0});
+    return chunk;
+}
+
+static bool sameChunk(const PagedChunk & a, const PagedChunk & b) {
+    return a.encoding == b.encoding && a.material == b.material && a.properties == b.properties
+        && a.payload == b.payload && a.fire.size() == b.fire.size()
+        && std::memcmp(a.fire.data(), b.fire.data(), a.fire.size() * sizeof(world_file::FireEntry)) == 0;
+}
+
+// Chunks kept in memory and chunks written out and read back, by prefetch
+// or by take on its own, come back as they were stored, once.
+TEST_CASE("Chunk pager hands back the chunks stored in it", "[chunk_pager]") {
+    std::string path = (std::filesystem::temp_directory_path() / "cellsim_round_trip.pages").string();
+    auto budget = GENERATE(size_t{1} << 20, size_t{0});
+    const int chunks = 16;
+
+    ChunkPager pager(path, budget);
+    for (int i = 0; i < chunks; i++) {
+        pager.store(ChunkCoord{i, i - 8}, packedChunk(i));
+    }
+    if (budget == 0) {
+        while (pager.stats().pageOuts < static_cast<uint64_t>(chunks)) {
+            std::this_thread::yield();
+        }
+    }
+    // air is never kept, a second store replaces the first
+    pager.store(ChunkCoord{100, 0}, PagedChunk{});
+    pager.store(ChunkCoord{0, -8}, packedChunk(99));
+
+    if (budget == 0) {
+        while (pager.stats().pageOuts < static_cast<uint64_t>(chunks + 1)) {
+            std::this_thread::yield();
+        }
+        for (int i = 0; i < chunks; i += 2) {
+            pager.prefetch(ChunkCoord{i, i - 8});
+        }
+    }
+
+    int wrong = 0;
+    for (int i = 0; i < chunks; i++) {
+        std::optional<PagedChunk> chunk = pager.take(ChunkCoord{i, i - 8});
+        wrong += !chunk || !sameChunk(*chunk, packedChunk(i == 0 ? 99 : i));
+        wrong += pager.take(ChunkCoord{i, i - 8}).has_value();
+    }
+    REQUIRE(wrong == 0);
+    REQUIRE(!pager.take(ChunkCoord{100, 0}).has_value());
+    REQUIRE(!pager.take(ChunkCoord{-5, 7}).has_value());
+    REQUIRE(pager.memoryBytes() == 0);
+    if (budget == 0) {
+        // a prefetched chunk is over the budget again and may be written out
+        // and read back a second time
+        REQUIRE(pager.stats().pageIns >= static_cast<uint64_t>(chunks));
+    } else {
+        REQUIRE(pager.stats().pageOuts == 0);
+    }
+}
+
+// A page read back for a chunk that is stored again before the read lands is
+// dropped, its extent has to be handed out again rather than the page file
+// growing by a chunk every time.
+TEST_CASE("Chunks stored over a read in flight give their page back", "[chunk_pager]") {
+    std::string path = (std::filesystem::temp_directory_path() / "cellsim_reread.pages").string();
+    PagedChunk sand;
+    sand.material = materials::sand;
+    sand.properties = pixel_properties::DefaultMaterialProperties[materials::sand];
+    const int chunks = 64;
+
+    // nothing fits the budget, every chunk stored is written out
+    ChunkPager pager(path, 0);
+    auto storeAll = [&](int round) {
+        for (int i = 0; i < chunks; i++) {
+            pager.store(ChunkCoord{i, -1}, sand);
+        }
+        while (pager.stats().pageOuts < static_cast<uint64_t>((round + 1) * chunks)) {
+            std::this_thread::yield();
+        }
+    };
+    storeAll(0);
+    const std::uintmax_t pageFileSize = std::filesystem::file_size(path);
+
+    // the I/O thread reads one chunk at a time, most are stored again
+    // while their read is still queued or under way
+    for (int round = 1; round <= 8; round++) {
+        for (int i = 0; i < chunks; i++) {
+            pager.prefetch(ChunkCoord{i, -1});
+        }
+        storeAll(round);
+    }
+    REQUIRE(std::filesystem::file_size(path) == pageFileSize);
+    REQUIRE(pager.take(ChunkCoord{0, -1}).has_value());
+}